@@ -65,6 +65,19 @@ Config Config::from_file(const fs::path& path) {
                 config.enable_hidexattr = o.at("enable_hidexattr").as_bool();
             if (o.count("hymofs_enabled"))
                 config.hymofs_enabled = o.at("hymofs_enabled").as_bool();
+            if (o.count("sync_jobs"))
+                config.sync_jobs = static_cast<int>(o.at("sync_jobs").as_number());
+            if (o.count("sync_hash"))
+                config.sync_hash = o.at("sync_hash").as_bool();
+            if (o.count("erofs_native"))
+                config.erofs_native = o.at("erofs_native").as_bool();
+            if (o.count("erofs_cluster_size"))
+                config.erofs_cluster_size =
+                    static_cast<int>(o.at("erofs_cluster_size").as_number());
+            if (o.count("ext4_prebuilt"))
+                config.ext4_prebuilt = o.at("ext4_prebuilt").as_bool();
+            if (o.count("magic_bind_subtrees"))
+                config.magic_bind_subtrees = o.at("magic_bind_subtrees").as_bool();
             if (o.count("mirror_path")) {
                 config.mirror_path = o.at("mirror_path").as_string();
                 // Treat legacy default as "auto" so HymoFS-on uses /dev/hymo_mirror
@@ -119,6 +132,12 @@ bool Config::save_to_file(const fs::path& path) const {
     root["enable_stealth"] = json::Value(enable_stealth);
     root["enable_hidexattr"] = json::Value(enable_hidexattr);
     root["hymofs_enabled"] = json::Value(hymofs_enabled);
+    root["sync_jobs"] = json::Value(sync_jobs);
+    root["sync_hash"] = json::Value(sync_hash);
+    root["erofs_native"] = json::Value(erofs_native);
+    root["erofs_cluster_size"] = json::Value(erofs_cluster_size);
+    root["ext4_prebuilt"] = json::Value(ext4_prebuilt);
+    root["magic_bind_subtrees"] = json::Value(magic_bind_subtrees);
     if (!mirror_path.empty())
         root["mirror_path"] = json::Value(mirror_path);
     if (!uname_release.empty())
@@ -57,6 +57,12 @@ struct Config {
     bool enable_stealth = true;
     bool enable_hidexattr = false;  // When true: mount_hide, maps_spoof, statfs_spoof, stealth
     bool hymofs_enabled = true;
+    int sync_jobs = 0;  // Parallel module sync workers; 0 = auto (online CPUs)
+    bool sync_hash = false;  // Confirm stat-changed files by content hash before recopying
+    bool erofs_native = true;         // Build EROFS images in-process instead of via mkfs.erofs
+    int erofs_cluster_size = 4096;    // Native EROFS max physical cluster in bytes (4096..1 MiB)
+    bool ext4_prebuilt = false;       // Ext4: build a populated read-only image instead of syncing
+    bool magic_bind_subtrees = true;  // Magic mount: bind untouched directories as a whole
     std::string mirror_path;
     std::string uname_release;
     std::string uname_version;
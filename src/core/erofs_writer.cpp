@@ -0,0 +1,710 @@
+// core/erofs_writer.cpp - Native EROFS image builder
+//
+// Image layout: block 0 holds the superblock (and the LZ4 config when big pclusters are
+// used), followed by regular file data, then the metadata area (inodes with inline xattrs,
+// inline tails and compression indexes; the root is nid 0), then directory blocks.
+// All inodes use the 64-byte extended format; compressed files use full (legacy) lcluster
+// indexes with 4 KiB logical clusters.
+#include "erofs_writer.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "../utils.hpp"
+#include "lz4.hpp"
+
+namespace hymo {
+
+// On-disk format, see fs/erofs/erofs_fs.h in the kernel
+static constexpr uint32_t BLK_BITS = 12;
+static constexpr uint32_t BLK_SIZE = 1U << BLK_BITS;
+static constexpr uint32_t SUPER_OFFSET = 1024;
+static constexpr uint32_t SUPER_SIZE = 128;
+static constexpr uint32_t SUPER_MAGIC = 0xE0F5E1E2;
+static constexpr uint32_t FEATURE_INCOMPAT_ZERO_PADDING = 0x1;
+static constexpr uint32_t FEATURE_INCOMPAT_BIG_PCLUSTER = 0x2;  // Implies compression cfgs
+static constexpr uint32_t ISLOT_SIZE = 32;                      // nid granularity
+static constexpr uint32_t INODE_SIZE = 64;                      // erofs_inode_extended
+static constexpr uint32_t XATTR_HEADER_SIZE = 12;
+static constexpr uint32_t DIRENT_SIZE = 12;
+static constexpr uint32_t ZMAP_HEADER_SIZE = 16;  // Map header + reserved before full indexes
+static constexpr uint32_t LCLUSTER_INDEX_SIZE = 8;
+static constexpr uint16_t D0_CBLKCNT = 1 << 11;
+static constexpr uint16_t ADVISE_BIG_PCLUSTER_1 = 0x2;
+static constexpr uint32_t MAX_PCLUSTER_SIZE = 1U << 20;
+
+enum DataLayout : uint16_t { FLAT_PLAIN = 0, COMPRESSED_FULL = 1, FLAT_INLINE = 2 };
+enum LclusterType : uint16_t { LCLUSTER_PLAIN = 0, LCLUSTER_HEAD = 1, LCLUSTER_NONHEAD = 2 };
+
+static inline void put16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+static inline void put32(uint8_t* p, uint32_t v) {
+    put16(p, static_cast<uint16_t>(v));
+    put16(p + 2, static_cast<uint16_t>(v >> 16));
+}
+
+static inline void put64(uint8_t* p, uint64_t v) {
+    put32(p, static_cast<uint32_t>(v));
+    put32(p + 4, static_cast<uint32_t>(v >> 32));
+}
+
+static inline uint64_t round_up(uint64_t v, uint64_t align) {
+    return (v + align - 1) / align * align;
+}
+
+static uint8_t erofs_file_type(mode_t mode) {
+    switch (mode & S_IFMT) {
+    case S_IFREG:
+        return 1;
+    case S_IFDIR:
+        return 2;
+    case S_IFCHR:
+        return 3;
+    case S_IFBLK:
+        return 4;
+    case S_IFIFO:
+        return 5;
+    case S_IFSOCK:
+        return 6;
+    case S_IFLNK:
+        return 7;
+    default:
+        return 0;
+    }
+}
+
+static uint32_t encode_dev(dev_t dev) {
+    const uint32_t major_num = major(dev);
+    const uint32_t minor_num = minor(dev);
+    return (minor_num & 0xff) | (major_num << 8) | ((minor_num & ~0xffU) << 12);
+}
+
+struct ErofsXattr {
+    uint8_t index;
+    std::string name;  // Without the namespace prefix
+    std::string value;
+};
+
+struct ErofsNode {
+    std::string name;
+    fs::path path;
+    struct stat st {};
+    size_t parent = 0;
+    std::vector<size_t> children;  // Sorted by name
+    std::vector<ErofsXattr> xattrs;
+    uint32_t xattr_size = 0;
+
+    uint16_t layout = FLAT_PLAIN;
+    uint64_t size = 0;         // i_size
+    uint32_t blkaddr = 0;      // First data block of flat layouts
+    uint32_t blocks = 0;       // Data blocks used
+    std::string tail;          // FLAT_INLINE data stored right after the inode
+    std::vector<uint8_t> zmap;  // COMPRESSED_FULL map header + lcluster indexes
+    uint64_t meta_offset = 0;  // Inode offset inside the metadata area (nid * 32)
+};
+
+struct DirEntry {
+    std::string name;
+    size_t node;
+};
+
+class ErofsBuilder {
+public:
+    ErofsBuilder(int fd, const ErofsWriterOptions& options) : fd_(fd), options_(options) {}
+
+    void build(const fs::path& src_dir, ErofsWriterStats& stats);
+
+private:
+    int fd_;
+    ErofsWriterOptions options_;
+    std::deque<ErofsNode> nodes_;  // nodes_[0] is the root
+    uint32_t next_blk_ = 1;        // Block 0 is the superblock
+    ErofsWriterStats stats_;
+
+    void write_at(uint64_t offset, const void* buf, size_t len);
+    uint32_t alloc_blocks(uint32_t count);
+
+    void scan(size_t index);
+    void read_xattrs(ErofsNode& node);
+    void write_file(ErofsNode& node);
+    void write_flat(ErofsNode& node, const uint8_t* data);
+    bool write_compressed(ErofsNode& node, const uint8_t* data);
+    std::vector<DirEntry> dir_entries(size_t index) const;
+    void write_dir(size_t index);
+    void write_inode(const ErofsNode& node, uint32_t ino, std::vector<uint8_t>& meta) const;
+    void write_super(uint32_t meta_blkaddr, uint32_t total_blocks);
+};
+
+void ErofsBuilder::write_at(uint64_t offset, const void* buf, size_t len) {
+    const auto* p = static_cast<const uint8_t*>(buf);
+    while (len > 0) {
+        ssize_t n = pwrite(fd_, p, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::system_error(errno, std::generic_category(), "erofs: write failed");
+        }
+        p += n;
+        offset += static_cast<uint64_t>(n);
+        len -= static_cast<size_t>(n);
+    }
+}
+
+uint32_t ErofsBuilder::alloc_blocks(uint32_t count) {
+    const uint32_t first = next_blk_;
+    next_blk_ += count;
+    return first;
+}
+
+void ErofsBuilder::read_xattrs(ErofsNode& node) {
+    static const struct {
+        const char* prefix;
+        uint8_t index;
+    } prefixes[] = {{"user.", 1}, {"trusted.", 4}, {"security.", 6}};
+
+    ssize_t len = llistxattr(node.path.c_str(), nullptr, 0);
+    if (len <= 0) {
+        return;
+    }
+    std::string names(static_cast<size_t>(len), '\0');
+    len = llistxattr(node.path.c_str(), names.data(), names.size());
+    if (len <= 0) {
+        return;
+    }
+    names.resize(static_cast<size_t>(len));
+
+    for (size_t pos = 0; pos < names.size();) {
+        const std::string full(names.c_str() + pos);
+        pos += full.size() + 1;
+
+        const auto* match =
+            std::find_if(std::begin(prefixes), std::end(prefixes),
+                         [&](const auto& p) { return full.rfind(p.prefix, 0) == 0; });
+        if (match == std::end(prefixes)) {
+            LOG_VERBOSE("erofs: skipping xattr " + full + " on " + node.path.string());
+            continue;
+        }
+        std::string suffix = full.substr(strlen(match->prefix));
+
+        ssize_t vlen = lgetxattr(node.path.c_str(), full.c_str(), nullptr, 0);
+        if (vlen < 0 || suffix.size() > 255 || vlen > 65535) {
+            continue;
+        }
+        std::string value(static_cast<size_t>(vlen), '\0');
+        vlen = lgetxattr(node.path.c_str(), full.c_str(), value.data(), value.size());
+        if (vlen < 0) {
+            continue;
+        }
+        value.resize(static_cast<size_t>(vlen));
+        node.xattrs.push_back({match->index, std::move(suffix), std::move(value)});
+    }
+
+    std::sort(node.xattrs.begin(), node.xattrs.end(), [](const auto& a, const auto& b) {
+        return a.index != b.index ? a.index < b.index : a.name < b.name;
+    });
+
+    if (!node.xattrs.empty()) {
+        node.xattr_size = XATTR_HEADER_SIZE;
+        for (const auto& x : node.xattrs) {
+            node.xattr_size += round_up(4 + x.name.size() + x.value.size(), 4);
+        }
+    }
+}
+
+void ErofsBuilder::scan(size_t index) {
+    std::vector<std::string> names;
+    for (const auto& entry : fs::directory_iterator(nodes_[index].path)) {
+        names.push_back(entry.path().filename().string());
+    }
+    std::sort(names.begin(), names.end());
+
+    for (auto& name : names) {
+        ErofsNode child;
+        child.path = nodes_[index].path / name;
+        child.name = std::move(name);
+        child.parent = index;
+        if (lstat(child.path.c_str(), &child.st) != 0) {
+            throw fs::filesystem_error("erofs: lstat", child.path,
+                                       std::error_code(errno, std::generic_category()));
+        }
+        read_xattrs(child);
+        nodes_.push_back(std::move(child));
+        nodes_[index].children.push_back(nodes_.size() - 1);
+    }
+
+    // Copy: recursion appends to nodes_
+    const std::vector<size_t> children = nodes_[index].children;
+    for (size_t child : children) {
+        if (S_ISDIR(nodes_[child].st.st_mode)) {
+            scan(child);
+        }
+    }
+}
+
+// Store data uncompressed: full blocks out of line, the tail inline when it fits
+void ErofsBuilder::write_flat(ErofsNode& node, const uint8_t* data) {
+    const uint64_t full = node.size / BLK_SIZE;
+    const size_t tail = node.size % BLK_SIZE;
+
+    if (tail > 0 && INODE_SIZE + node.xattr_size + tail <= BLK_SIZE) {
+        node.layout = FLAT_INLINE;
+        node.blocks = static_cast<uint32_t>(full);
+        node.tail.assign(reinterpret_cast<const char*>(data + full * BLK_SIZE), tail);
+    } else {
+        node.layout = FLAT_PLAIN;
+        node.blocks = static_cast<uint32_t>(round_up(node.size, BLK_SIZE) / BLK_SIZE);
+    }
+    if (node.blocks == 0) {
+        return;
+    }
+
+    node.blkaddr = alloc_blocks(node.blocks);
+    const uint64_t offset = static_cast<uint64_t>(node.blkaddr) * BLK_SIZE;
+    write_at(offset, data, full * BLK_SIZE);
+    if (node.layout == FLAT_PLAIN && tail > 0) {
+        std::vector<uint8_t> block(BLK_SIZE, 0);
+        memcpy(block.data(), data + full * BLK_SIZE, tail);
+        write_at(offset + full * BLK_SIZE, block.data(), BLK_SIZE);
+    }
+}
+
+// Split the file into extents that each compress into one physical cluster (LZ4, data
+// right-aligned for zero padding). Returns false when that saves no blocks overall.
+bool ErofsBuilder::write_compressed(ErofsNode& node, const uint8_t* data) {
+    struct Extent {
+        uint64_t start;
+        uint32_t rel_blk;
+        uint32_t blocks;
+        bool plain;
+    };
+
+    const uint32_t cluster = options_.cluster_size;
+    const size_t max_extent = std::min<size_t>(16ULL * cluster, MAX_PCLUSTER_SIZE);
+    std::vector<uint8_t> buf(cluster);
+    std::vector<uint8_t> out;
+    std::vector<Extent> extents;
+
+    // An extent must not end inside the EOF lcluster except at EOF itself: that lcluster's
+    // index is reserved for the end-of-file marker (see below)
+    const uint64_t eof_boundary = node.size / BLK_SIZE * BLK_SIZE;
+    auto fits_eof = [&](uint64_t end) { return end <= eof_boundary || end == node.size; };
+
+    for (uint64_t pos = 0; pos < node.size;) {
+        const uint32_t rel = static_cast<uint32_t>(out.size() / BLK_SIZE);
+        size_t in_len = static_cast<size_t>(std::min<uint64_t>(node.size - pos, max_extent));
+        size_t consumed = 0;
+        size_t clen = lz4_compress_dest_size(data + pos, in_len, buf.data(), buf.size(), consumed);
+        if (!fits_eof(pos + consumed) && pos < eof_boundary) {
+            in_len = static_cast<size_t>(eof_boundary - pos);
+            clen = lz4_compress_dest_size(data + pos, in_len, buf.data(), buf.size(), consumed);
+        }
+        const uint32_t blocks = static_cast<uint32_t>(round_up(clen, BLK_SIZE) / BLK_SIZE);
+
+        if (consumed > static_cast<uint64_t>(blocks) * BLK_SIZE) {
+            out.resize(out.size() + static_cast<size_t>(blocks) * BLK_SIZE, 0);
+            memcpy(out.data() + out.size() - clen, buf.data(), clen);
+            extents.push_back({pos, rel, blocks, false});
+            pos += consumed;
+        } else {
+            // Incompressible: one raw block, stored from the start of its block
+            uint64_t n = std::min<uint64_t>(node.size - pos, BLK_SIZE);
+            if (!fits_eof(pos + n)) {
+                n = eof_boundary - pos;
+            }
+            out.resize(out.size() + BLK_SIZE, 0);
+            memcpy(out.data() + static_cast<size_t>(rel) * BLK_SIZE, data + pos, n);
+            extents.push_back({pos, rel, 1, true});
+            pos += n;
+        }
+    }
+
+    const uint64_t total_blocks = out.size() / BLK_SIZE;
+    if (total_blocks >= round_up(node.size, BLK_SIZE) / BLK_SIZE) {
+        return false;
+    }
+
+    const uint32_t base = alloc_blocks(static_cast<uint32_t>(total_blocks));
+    write_at(static_cast<uint64_t>(base) * BLK_SIZE, out.data(), out.size());
+
+    const bool big = cluster > BLK_SIZE;
+    const uint64_t lclusters = round_up(node.size, BLK_SIZE) / BLK_SIZE;
+    node.zmap.assign(ZMAP_HEADER_SIZE + lclusters * LCLUSTER_INDEX_SIZE, 0);
+    // h_idata_size/h_fragmentoff = 0, h_algorithmtype = LZ4, h_clusterbits = 0 (4 KiB)
+    put16(node.zmap.data() + 4, big ? ADVISE_BIG_PCLUSTER_1 : 0);
+
+    // When the last extent starts before the EOF lcluster, that lcluster gets a PLAIN head
+    // whose clusterofs marks EOF, so the last extent's decoded length is exact
+    const bool eof_marker =
+        node.size % BLK_SIZE != 0 && extents.back().start / BLK_SIZE < lclusters - 1;
+    const uint64_t last = eof_marker ? lclusters - 1 : lclusters;
+
+    size_t e = 0;
+    for (uint64_t lcn = 0; lcn < lclusters; ++lcn) {
+        uint8_t* di = node.zmap.data() + ZMAP_HEADER_SIZE + lcn * LCLUSTER_INDEX_SIZE;
+        if (lcn == last) {
+            put16(di, LCLUSTER_PLAIN);
+            put16(di + 2, static_cast<uint16_t>(node.size % BLK_SIZE));
+            break;
+        }
+        if (e + 1 < extents.size() && extents[e + 1].start / BLK_SIZE == lcn) {
+            ++e;
+        }
+        const Extent& ext = extents[e];
+        const uint64_t head = ext.start / BLK_SIZE;
+
+        if (lcn == head) {
+            put16(di, ext.plain ? LCLUSTER_PLAIN : LCLUSTER_HEAD);
+            put16(di + 2, static_cast<uint16_t>(ext.start % BLK_SIZE));
+            put32(di + 4, base + ext.rel_blk);
+        } else {
+            const uint64_t next = e + 1 < extents.size() ? extents[e + 1].start / BLK_SIZE : last;
+            uint16_t delta0 = static_cast<uint16_t>(lcn - head);
+            // First NONHEAD of a big pcluster carries its compressed block count
+            if (big && delta0 == 1 && !ext.plain) {
+                delta0 = static_cast<uint16_t>(D0_CBLKCNT | ext.blocks);
+            }
+            put16(di, LCLUSTER_NONHEAD);
+            put16(di + 4, delta0);
+            put16(di + 6, static_cast<uint16_t>(next - lcn));
+        }
+    }
+
+    node.layout = COMPRESSED_FULL;
+    node.blocks = static_cast<uint32_t>(total_blocks);
+    stats_.compressed_files++;
+    return true;
+}
+
+void ErofsBuilder::write_file(ErofsNode& node) {
+    node.size = static_cast<uint64_t>(node.st.st_size);
+    if (node.size == 0) {
+        return;
+    }
+
+    int fd = open(node.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw fs::filesystem_error("erofs: open", node.path,
+                                   std::error_code(errno, std::generic_category()));
+    }
+    void* map = mmap(nullptr, node.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw fs::filesystem_error("erofs: mmap", node.path,
+                                   std::error_code(err, std::generic_category()));
+    }
+    madvise(map, node.size, MADV_SEQUENTIAL);
+
+    const auto* data = static_cast<const uint8_t*>(map);
+    try {
+        if (!options_.compress || node.size <= BLK_SIZE || !write_compressed(node, data)) {
+            write_flat(node, data);
+        }
+    } catch (...) {
+        munmap(map, node.size);
+        throw;
+    }
+    munmap(map, node.size);
+    stats_.file_bytes += node.size;
+}
+
+std::vector<DirEntry> ErofsBuilder::dir_entries(size_t index) const {
+    const ErofsNode& dir = nodes_[index];
+    std::vector<DirEntry> entries;
+    entries.push_back({".", index});
+    entries.push_back({"..", dir.parent});
+    for (size_t child : dir.children) {
+        entries.push_back({nodes_[child].name, child});
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const DirEntry& a, const DirEntry& b) { return a.name < b.name; });
+    return entries;
+}
+
+// Pack dirents into blocks: each block is an array of dirents followed by their names
+static std::vector<size_t> pack_dir_blocks(const std::vector<DirEntry>& entries,
+                                           uint64_t& size) {
+    std::vector<size_t> starts;
+    size_t used = BLK_SIZE;
+    size = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const size_t need = DIRENT_SIZE + entries[i].name.size();
+        if (used + need > BLK_SIZE) {
+            if (!starts.empty()) {
+                size += BLK_SIZE;
+            }
+            starts.push_back(i);
+            used = 0;
+        }
+        used += need;
+    }
+    size += used;
+    return starts;
+}
+
+void ErofsBuilder::write_dir(size_t index) {
+    ErofsNode& dir = nodes_[index];
+    const auto entries = dir_entries(index);
+    uint64_t size = 0;
+    const auto starts = pack_dir_blocks(entries, size);
+
+    std::vector<uint8_t> data(round_up(size, BLK_SIZE), 0);
+    for (size_t b = 0; b < starts.size(); ++b) {
+        const size_t first = starts[b];
+        const size_t last = b + 1 < starts.size() ? starts[b + 1] : entries.size();
+        uint8_t* block = data.data() + b * BLK_SIZE;
+        size_t nameoff = (last - first) * DIRENT_SIZE;
+        for (size_t i = first; i < last; ++i) {
+            const ErofsNode& target = nodes_[entries[i].node];
+            uint8_t* de = block + (i - first) * DIRENT_SIZE;
+            put64(de, target.meta_offset / ISLOT_SIZE);
+            put16(de + 8, static_cast<uint16_t>(nameoff));
+            de[10] = erofs_file_type(target.st.st_mode);
+            memcpy(block + nameoff, entries[i].name.data(), entries[i].name.size());
+            nameoff += entries[i].name.size();
+        }
+    }
+
+    const uint64_t full = dir.layout == FLAT_INLINE ? dir.blocks : round_up(size, BLK_SIZE) /
+                                                                     BLK_SIZE;
+    if (full > 0) {
+        write_at(static_cast<uint64_t>(dir.blkaddr) * BLK_SIZE, data.data(), full * BLK_SIZE);
+    }
+    if (dir.layout == FLAT_INLINE) {
+        dir.tail.assign(reinterpret_cast<const char*>(data.data() + full * BLK_SIZE),
+                        size % BLK_SIZE);
+    }
+}
+
+void ErofsBuilder::write_inode(const ErofsNode& node, uint32_t ino,
+                               std::vector<uint8_t>& meta) const {
+    uint8_t* p = meta.data() + node.meta_offset;
+    const mode_t mode = node.st.st_mode;
+
+    uint32_t nlink = 1;
+    if (S_ISDIR(mode)) {
+        nlink = 2;
+        for (size_t child : node.children) {
+            if (S_ISDIR(nodes_[child].st.st_mode)) {
+                nlink++;
+            }
+        }
+    }
+
+    uint32_t i_u = 0;
+    if (S_ISCHR(mode) || S_ISBLK(mode)) {
+        i_u = encode_dev(node.st.st_rdev);
+    } else if (node.layout == COMPRESSED_FULL) {
+        i_u = node.blocks;
+    } else {
+        i_u = node.blkaddr;
+    }
+
+    put16(p, static_cast<uint16_t>(1 | (node.layout << 1)));  // Extended inode
+    put16(p + 2, node.xattr_size ? static_cast<uint16_t>(
+                                       (node.xattr_size - XATTR_HEADER_SIZE) / 4 + 1)
+                                 : 0);
+    put16(p + 4, static_cast<uint16_t>(mode));
+    put64(p + 8, node.size);
+    put32(p + 16, i_u);
+    put32(p + 20, ino);
+    put32(p + 24, node.st.st_uid);
+    put32(p + 28, node.st.st_gid);
+    put64(p + 32, static_cast<uint64_t>(node.st.st_mtim.tv_sec));
+    put32(p + 40, static_cast<uint32_t>(node.st.st_mtim.tv_nsec));
+    put32(p + 44, nlink);
+
+    // Inline xattrs: ibody header (no shared xattrs) then 4-byte aligned entries
+    uint8_t* x = p + INODE_SIZE + XATTR_HEADER_SIZE;
+    for (const auto& xattr : node.xattrs) {
+        x[0] = static_cast<uint8_t>(xattr.name.size());
+        x[1] = xattr.index;
+        put16(x + 2, static_cast<uint16_t>(xattr.value.size()));
+        memcpy(x + 4, xattr.name.data(), xattr.name.size());
+        memcpy(x + 4 + xattr.name.size(), xattr.value.data(), xattr.value.size());
+        x += round_up(4 + xattr.name.size() + xattr.value.size(), 4);
+    }
+
+    const uint64_t body = node.meta_offset + INODE_SIZE + node.xattr_size;
+    if (node.layout == FLAT_INLINE) {
+        memcpy(meta.data() + body, node.tail.data(), node.tail.size());
+    } else if (node.layout == COMPRESSED_FULL) {
+        memcpy(meta.data() + round_up(body, 8), node.zmap.data(), node.zmap.size());
+    }
+}
+
+void ErofsBuilder::write_super(uint32_t meta_blkaddr, uint32_t total_blocks) {
+    std::vector<uint8_t> block(BLK_SIZE, 0);
+    uint8_t* sb = block.data() + SUPER_OFFSET;
+    const bool big = options_.compress && options_.cluster_size > BLK_SIZE;
+
+    put32(sb, SUPER_MAGIC);
+    sb[12] = BLK_BITS;
+    put16(sb + 14, 0);  // root_nid
+    put64(sb + 16, nodes_.size());
+    put32(sb + 36, total_blocks);
+    put32(sb + 40, meta_blkaddr);
+    put32(sb + 80, FEATURE_INCOMPAT_ZERO_PADDING | (big ? FEATURE_INCOMPAT_BIG_PCLUSTER : 0));
+
+    if (big) {
+        // available_compr_algs = LZ4, followed by its length-prefixed z_erofs_lz4_cfgs
+        put16(sb + 84, 1);
+        uint8_t* cfg = sb + SUPER_SIZE;
+        put16(cfg, 14);
+        put16(cfg + 2, 0);  // max_distance: default window
+        put16(cfg + 4, static_cast<uint16_t>(options_.cluster_size / BLK_SIZE));
+    }
+    write_at(0, block.data(), block.size());
+}
+
+void ErofsBuilder::build(const fs::path& src_dir, ErofsWriterStats& stats) {
+    ErofsNode root;
+    root.path = src_dir;
+    if (stat(src_dir.c_str(), &root.st) != 0 || !S_ISDIR(root.st.st_mode)) {
+        throw fs::filesystem_error("erofs: not a directory", src_dir,
+                                   std::error_code(ENOTDIR, std::generic_category()));
+    }
+    read_xattrs(root);
+    nodes_.push_back(std::move(root));
+    scan(0);
+
+    // File data first, in tree order
+    for (auto& node : nodes_) {
+        if (S_ISREG(node.st.st_mode)) {
+            write_file(node);
+        } else if (S_ISLNK(node.st.st_mode)) {
+            const std::string target = fs::read_symlink(node.path).string();
+            node.size = target.size();
+            write_flat(node, reinterpret_cast<const uint8_t*>(target.data()));
+        }
+    }
+
+    // Directory sizes only depend on names, so their layout is known before any nid
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        ErofsNode& dir = nodes_[i];
+        if (!S_ISDIR(dir.st.st_mode)) {
+            continue;
+        }
+        pack_dir_blocks(dir_entries(i), dir.size);
+        const size_t tail = dir.size % BLK_SIZE;
+        if (tail > 0 && INODE_SIZE + dir.xattr_size + tail <= BLK_SIZE) {
+            dir.layout = FLAT_INLINE;
+            dir.blocks = static_cast<uint32_t>(dir.size / BLK_SIZE);
+        } else {
+            dir.layout = FLAT_PLAIN;
+            dir.blocks = static_cast<uint32_t>(round_up(dir.size, BLK_SIZE) / BLK_SIZE);
+        }
+    }
+
+    // Metadata area: breadth-first so the root gets nid 0
+    std::vector<size_t> order{0};
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (size_t child : nodes_[order[i]].children) {
+            order.push_back(child);
+        }
+    }
+
+    uint64_t off = 0;
+    for (size_t index : order) {
+        ErofsNode& node = nodes_[index];
+        const uint64_t base = INODE_SIZE + node.xattr_size;
+        uint64_t extra = 0;
+        if (node.layout == FLAT_INLINE) {
+            extra = node.size % BLK_SIZE;
+        } else if (node.layout == COMPRESSED_FULL) {
+            extra = round_up(base, 8) - base + node.zmap.size();
+        }
+
+        off = round_up(off, ISLOT_SIZE);
+        // Inline tails must not cross a block; keep inode + xattrs together where possible
+        const uint64_t keep = node.layout == FLAT_INLINE ? base + extra : base;
+        if (keep <= BLK_SIZE && off % BLK_SIZE + keep > BLK_SIZE) {
+            off = round_up(off, BLK_SIZE);
+        }
+        node.meta_offset = off;
+        off += base + extra;
+    }
+
+    const uint32_t meta_blkaddr = next_blk_;
+    const uint32_t meta_blocks = static_cast<uint32_t>(round_up(off, BLK_SIZE) / BLK_SIZE);
+    alloc_blocks(meta_blocks);
+
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        ErofsNode& dir = nodes_[i];
+        if (S_ISDIR(dir.st.st_mode)) {
+            dir.blkaddr = dir.blocks ? alloc_blocks(dir.blocks) : 0;
+            write_dir(i);
+        }
+    }
+
+    std::vector<uint8_t> meta(static_cast<size_t>(meta_blocks) * BLK_SIZE, 0);
+    for (size_t i = 0; i < order.size(); ++i) {
+        write_inode(nodes_[order[i]], static_cast<uint32_t>(i + 1), meta);
+    }
+    write_at(static_cast<uint64_t>(meta_blkaddr) * BLK_SIZE, meta.data(), meta.size());
+
+    write_super(meta_blkaddr, next_blk_);
+    const uint64_t image_bytes = static_cast<uint64_t>(next_blk_) * BLK_SIZE;
+    if (ftruncate(fd_, static_cast<off_t>(image_bytes)) != 0) {
+        throw std::system_error(errno, std::generic_category(), "erofs: ftruncate failed");
+    }
+
+    stats_.inodes = nodes_.size();
+    stats_.image_bytes = image_bytes;
+    stats = stats_;
+}
+
+bool build_erofs_image(const fs::path& src_dir, const fs::path& image_path,
+                       const ErofsWriterOptions& options, ErofsWriterStats* stats) {
+    const uint32_t cluster = options.cluster_size;
+    if (cluster < BLK_SIZE || cluster > MAX_PCLUSTER_SIZE || (cluster & (cluster - 1)) != 0) {
+        LOG_ERROR("erofs: invalid cluster size " + std::to_string(cluster));
+        return false;
+    }
+
+    int fd = open(image_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("erofs: cannot create " + image_path.string() + ": " + strerror(errno));
+        return false;
+    }
+
+    ErofsWriterStats result;
+    try {
+        ErofsBuilder builder(fd, options);
+        builder.build(src_dir, result);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Failed to build EROFS image: " + std::string(e.what()));
+        close(fd);
+        unlink(image_path.c_str());
+        return false;
+    }
+
+    if (fsync(fd) != 0 || close(fd) != 0) {
+        LOG_ERROR("erofs: failed to flush " + image_path.string());
+        unlink(image_path.c_str());
+        return false;
+    }
+
+    LOG_INFO("EROFS image written: " + std::to_string(result.inodes) + " inodes, " +
+             std::to_string(result.compressed_files) + " compressed files, " +
+             std::to_string(result.file_bytes) + " -> " + std::to_string(result.image_bytes) +
+             " bytes");
+    if (stats) {
+        *stats = result;
+    }
+    return true;
+}
+
+}  // namespace hymo
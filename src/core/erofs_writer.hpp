@@ -0,0 +1,31 @@
+// core/erofs_writer.hpp - Native EROFS image builder
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace hymo {
+
+struct ErofsWriterOptions {
+    bool compress = true;          // LZ4-compress regular files that shrink by a block or more
+    uint32_t cluster_size = 4096;  // Max physical cluster (bytes, power of two, 4 KiB..1 MiB);
+                                   // > 4096 needs big pcluster support (Linux 5.13+)
+};
+
+struct ErofsWriterStats {
+    uint64_t inodes = 0;
+    uint64_t compressed_files = 0;
+    uint64_t file_bytes = 0;   // Regular file bytes read from the source tree
+    uint64_t image_bytes = 0;  // Size of the written image
+};
+
+// Build a read-only EROFS image of `src_dir` at `image_path` without mkfs.erofs. The tree
+// is walked with lstat (symlinks are stored as symlinks); modes, owners, mtimes, device
+// nodes (overlay whiteouts) and user./trusted./security. xattrs, security.selinux
+// included, are preserved. Plain Linux is enough to run it, e.g. for benchmarking.
+bool build_erofs_image(const fs::path& src_dir, const fs::path& image_path,
+                       const ErofsWriterOptions& options, ErofsWriterStats* stats = nullptr);
+
+}  // namespace hymo
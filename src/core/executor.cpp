@@ -116,8 +116,11 @@ ExecutionResult execute_plan(const MountPlan& plan, const Config& config, bool h
             LOG_ERROR("Magic Mount aborted: temp dir prepare failed");
             final_magic_ids.clear();
         } else {
+            MagicMountOptions magic_options;
+            magic_options.disable_umount = config.disable_umount;
+            magic_options.bind_subtrees = config.magic_bind_subtrees;
             if (!mount_partitions(tempdir, magic_queue, config.mountsource, config.partitions,
-                                  config.disable_umount)) {
+                                  magic_options)) {
                 LOG_ERROR("Magic Mount critical failure");
                 final_magic_ids.clear();
             }
@@ -5,6 +5,7 @@
 #include <sstream>
 #include "../defs.hpp"
 #include "../utils.hpp"
+#include "module_index.hpp"
 
 #include <set>
 
@@ -67,6 +68,14 @@ static void parse_module_rules(const fs::path& module_path, Module& module) {
     }
 }
 
+std::shared_ptr<const RuleTrie> compile_rules(const std::vector<ModuleRule>& rules) {
+    auto trie = std::make_shared<RuleTrie>();
+    for (const auto& rule : rules) {
+        trie->add(rule.path, rule.mode);
+    }
+    return trie;
+}
+
 std::vector<Module> scan_modules(const fs::path& source_dir, const Config& config) {
     std::vector<Module> modules;
 
@@ -75,22 +84,28 @@ std::vector<Module> scan_modules(const fs::path& source_dir, const Config& confi
     }
 
     try {
-        for (const auto& entry : fs::directory_iterator(source_dir)) {
-            if (!entry.is_directory()) {
+        const auto index = module_tree_index(source_dir);
+        if (index->empty()) {
+            return modules;
+        }
+        const ModuleTreeEntry& root = index->entry(ModuleTreeIndex::root_index);
+        for (uint32_t i = root.first_child; i < root.first_child + root.child_count; ++i) {
+            if (!index->is_dir(i)) {
                 continue;
             }
 
-            std::string id = entry.path().filename().string();
+            std::string id(index->name(i));
 
             if (id == "hymo" || id == "lost+found" || id == ".git") {
                 continue;
             }
 
-            if (fs::exists(entry.path() / DISABLE_FILE_NAME) ||
-                fs::exists(entry.path() / REMOVE_FILE_NAME) ||
-                fs::exists(entry.path() / SKIP_MOUNT_FILE_NAME)) {
+            if (index->child(i, DISABLE_FILE_NAME) != ModuleTreeIndex::npos ||
+                index->child(i, REMOVE_FILE_NAME) != ModuleTreeIndex::npos ||
+                index->child(i, SKIP_MOUNT_FILE_NAME) != ModuleTreeIndex::npos) {
                 continue;
             }
+            const fs::path module_path = source_dir / id;
 
             std::string global_mode = "";
             auto it = config.module_modes.find(id);
@@ -100,7 +115,7 @@ std::vector<Module> scan_modules(const fs::path& source_dir, const Config& confi
 
             Module mod;
             mod.id = id;
-            mod.source_path = entry.path();
+            mod.source_path = module_path;
             mod.mode = "auto";
 
             auto rules_it = config.module_rules.find(id);
@@ -110,9 +125,10 @@ std::vector<Module> scan_modules(const fs::path& source_dir, const Config& confi
                 }
             }
 
-            parse_module_rules(entry.path(), mod);
+            parse_module_rules(module_path, mod);
 
-            parse_module_prop(entry.path(), mod);
+            parse_module_prop(module_path, mod);
+            mod.rule_trie = compile_rules(mod.rules);
 
             if (!global_mode.empty()) {
                 mod.mode = global_mode;
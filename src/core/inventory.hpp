@@ -2,9 +2,11 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
 #include <string>
 #include <vector>
 #include "../conf/config.hpp"
+#include "rule_trie.hpp"
 
 namespace fs = std::filesystem;
 
@@ -24,8 +26,11 @@ struct Module {
     std::string author = "";
     std::string description = "";
     std::vector<ModuleRule> rules;
+    std::shared_ptr<const RuleTrie> rule_trie;  // `rules` compiled by scan_modules
 };
 
+std::shared_ptr<const RuleTrie> compile_rules(const std::vector<ModuleRule>& rules);
+
 std::vector<Module> scan_modules(const fs::path& source_dir, const Config& config);
 std::vector<std::string> scan_partition_candidates(const fs::path& source_dir);
 
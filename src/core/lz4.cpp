@@ -0,0 +1,146 @@
+// core/lz4.cpp - Minimal LZ4 block compressor
+#include "lz4.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace hymo {
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t LAST_LITERALS = 5;  // Last 5 bytes of a block are always literals
+static constexpr size_t MF_LIMIT = 12;      // Last match must start 12 bytes before the end
+static constexpr size_t MAX_DISTANCE = 65535;
+static constexpr int HASH_LOG = 14;
+static constexpr uint32_t NO_POS = UINT32_MAX;
+
+// Room kept free while matching: a final literal run covering MF_LIMIT bytes
+static constexpr size_t END_RESERVE = 1 + MF_LIMIT;
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+// Extra bytes needed to encode a 4-bit length field holding `len`
+static inline size_t length_bytes(size_t len) {
+    return len < 15 ? 0 : (len - 15) / 255 + 1;
+}
+
+static inline uint8_t* write_length(uint8_t* op, size_t len) {
+    len -= 15;
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+static inline uint8_t* write_literals(uint8_t* op, uint8_t* token, const uint8_t* lit,
+                                      size_t len) {
+    if (len >= 15) {
+        *token = 15 << 4;
+        op = write_length(op, len);
+    } else {
+        *token = static_cast<uint8_t>(len << 4);
+    }
+    memcpy(op, lit, len);
+    return op + len;
+}
+
+size_t lz4_compress_dest_size(const uint8_t* src, size_t src_size, uint8_t* dst,
+                              size_t dst_capacity, size_t& consumed) {
+    thread_local uint32_t table[1 << HASH_LOG];
+    std::fill(table, table + (1 << HASH_LOG), NO_POS);
+
+    // Positions are stored as uint32_t
+    src_size = std::min<size_t>(src_size, UINT32_MAX - 1);
+
+    uint8_t* const ostart = dst;
+    uint8_t* op = dst;
+    size_t ip = 0;
+    size_t anchor = 0;
+
+    if (src_size > MF_LIMIT && dst_capacity > END_RESERVE) {
+        const size_t match_start_limit = src_size - MF_LIMIT;
+        const size_t match_end_limit = src_size - LAST_LITERALS;
+        size_t misses = 0;
+
+        while (ip < match_start_limit) {
+            const uint32_t seq = read32(src + ip);
+            const uint32_t h = hash4(seq);
+            const uint32_t ref = table[h];
+            table[h] = static_cast<uint32_t>(ip);
+
+            if (ref == NO_POS || ip - ref > MAX_DISTANCE || read32(src + ref) != seq) {
+                // Skip faster through incompressible data
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            size_t start = ip;
+            size_t mref = ref;
+            while (start > anchor && mref > 0 && src[start - 1] == src[mref - 1]) {
+                --start;
+                --mref;
+            }
+            size_t end = ip + MIN_MATCH;
+            size_t rpos = ref + MIN_MATCH;
+            while (end < match_end_limit && src[end] == src[rpos]) {
+                ++end;
+                ++rpos;
+            }
+
+            const size_t lit_len = start - anchor;
+            const size_t match_len = end - start;
+            const size_t cost = 1 + length_bytes(lit_len) + lit_len + 2 +
+                                length_bytes(match_len - MIN_MATCH);
+            if (static_cast<size_t>(op - ostart) + cost + END_RESERVE > dst_capacity) {
+                break;
+            }
+
+            uint8_t* token = op++;
+            op = write_literals(op, token, src + anchor, lit_len);
+            const uint16_t offset = static_cast<uint16_t>(start - mref);
+            *op++ = static_cast<uint8_t>(offset);
+            *op++ = static_cast<uint8_t>(offset >> 8);
+            if (match_len - MIN_MATCH >= 15) {
+                *token |= 15;
+                op = write_length(op, match_len - MIN_MATCH);
+            } else {
+                *token |= static_cast<uint8_t>(match_len - MIN_MATCH);
+            }
+
+            anchor = ip = end;
+            if (end - 2 < match_start_limit) {
+                table[hash4(read32(src + end - 2))] = static_cast<uint32_t>(end - 2);
+            }
+        }
+    }
+
+    // Final literal run, truncated to whatever still fits
+    const size_t room = dst_capacity - static_cast<size_t>(op - ostart);
+    size_t lit_len = src_size - anchor;
+    if (room == 0) {
+        lit_len = 0;
+    } else {
+        lit_len = std::min(lit_len, room - 1);
+        while (lit_len > 0 && 1 + length_bytes(lit_len) + lit_len > room) {
+            --lit_len;
+        }
+    }
+    if (room > 0) {
+        uint8_t* token = op++;
+        op = write_literals(op, token, src + anchor, lit_len);
+    }
+
+    consumed = anchor + lit_len;
+    return static_cast<size_t>(op - ostart);
+}
+
+}  // namespace hymo
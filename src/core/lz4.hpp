@@ -0,0 +1,17 @@
+// core/lz4.hpp - Minimal LZ4 block compressor
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hymo {
+
+// Compress as much of src[0, src_size) as fits in `dst_capacity` bytes into a single LZ4
+// block (the "destSize" mode EROFS needs for fixed-size physical clusters). Returns the
+// compressed size; `consumed` receives how many input bytes that block decodes to.
+// The output follows the LZ4 end-of-block rules for the consumed prefix, so it can be
+// decoded by any conforming decoder (including the kernel's).
+size_t lz4_compress_dest_size(const uint8_t* src, size_t src_size, uint8_t* dst,
+                              size_t dst_capacity, size_t& consumed);
+
+}  // namespace hymo
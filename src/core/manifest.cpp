@@ -0,0 +1,245 @@
+// core/manifest.cpp - Per-module sync manifest implementation
+#include "manifest.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include "../utils.hpp"
+#include "module_index.hpp"
+
+namespace hymo {
+
+static constexpr const char* MANIFEST_HEADER = "hymo-manifest 1";
+
+fs::path manifest_dir(const fs::path& storage_root) {
+    // "hymo" is reserved in the storage root (never a module id, never pruned)
+    return storage_root / "hymo" / "manifest";
+}
+
+fs::path manifest_path(const fs::path& storage_root, const std::string& module_id) {
+    return manifest_dir(storage_root) / module_id;
+}
+
+static ManifestEntry make_entry(ManifestType type, uint64_t size, int64_t mtime_ns,
+                                uint32_t mode, uint64_t ino) {
+    ManifestEntry e;
+    e.type = type;
+    e.size = size;
+    e.mtime_ns = mtime_ns;
+    e.mode = mode;
+    e.ino = ino;
+    return e;
+}
+
+static ManifestEntry stat_entry(const struct stat& st, bool is_dir) {
+    ManifestType type = ManifestType::File;
+    if (is_dir) {
+        type = ManifestType::Directory;
+    } else if (S_ISLNK(st.st_mode)) {
+        type = ManifestType::Symlink;
+    }
+    return make_entry(type, static_cast<uint64_t>(st.st_size),
+                      static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec,
+                      st.st_mode & 07777, static_cast<uint64_t>(st.st_ino));
+}
+
+static void scan_dir(const fs::path& dir, const std::string& rel, Manifest& out) {
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        const std::string name = entry.path().filename().string();
+        const std::string child_rel = rel.empty() ? name : rel + "/" + name;
+
+        // Directory symlinks are followed, matching copy_tree
+        const bool is_dir = fs::is_directory(entry);
+        struct stat st;
+        int ret = is_dir ? stat(entry.path().c_str(), &st) : lstat(entry.path().c_str(), &st);
+        if (ret != 0) {
+            continue;
+        }
+        out[child_rel] = stat_entry(st, is_dir);
+
+        if (is_dir) {
+            scan_dir(entry.path(), child_rel, out);
+        }
+    }
+}
+
+Manifest scan_manifest(const fs::path& src_root) {
+    Manifest manifest;
+    scan_dir(src_root, "", manifest);
+    return manifest;
+}
+
+// Children of the indexed directory `dir`, open as `dir_fd`. Names, directories and
+// symlinks come from the index; regular files are stat'ed again, since a file rewritten in
+// place leaves its directory (all the index revalidates) untouched.
+static void scan_index_dir(const ModuleTreeIndex& index, uint32_t dir, int dir_fd,
+                           const fs::path& path, const std::string& rel, Manifest& out) {
+    const ModuleTreeEntry& d = index.entry(dir);
+    for (uint32_t i = d.first_child; i < d.first_child + d.child_count; ++i) {
+        const ModuleTreeEntry& e = index.entry(i);
+        const std::string name(index.name(i));
+        const std::string child_rel = rel.empty() ? name : rel + "/" + name;
+        struct stat st;
+
+        if (e.type == DT_LNK && index.is_dir(i) && e.child_count == 0) {
+            // Recorded but not followed by the index; copy_tree follows it
+            if (fstatat(dir_fd, name.c_str(), &st, 0) == 0) {
+                out[child_rel] = stat_entry(st, true);
+                scan_dir(path / name, child_rel, out);
+            }
+        } else if (index.is_dir(i)) {
+            out[child_rel] = make_entry(ManifestType::Directory, e.size, e.mtime_ns, e.mode, e.ino);
+            const int fd = openat(dir_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0) {
+                throw fs::filesystem_error("scan_manifest", path / name,
+                                           std::error_code(errno, std::generic_category()));
+            }
+            try {
+                scan_index_dir(index, i, fd, path / name, child_rel, out);
+            } catch (...) {
+                close(fd);
+                throw;
+            }
+            close(fd);
+        } else if (e.type == DT_REG) {
+            if (fstatat(dir_fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                out[child_rel] = stat_entry(st, S_ISDIR(st.st_mode));
+            }
+        } else {
+            out[child_rel] = make_entry(e.type == DT_LNK ? ManifestType::Symlink
+                                                         : ManifestType::File,
+                                        e.size, e.mtime_ns, e.mode, e.ino);
+        }
+    }
+}
+
+Manifest scan_manifest(const ModuleTreeIndex& index, uint32_t dir) {
+    Manifest manifest;
+    const fs::path base = index.root() / index.path(dir);
+    const int fd = open(base.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw fs::filesystem_error("scan_manifest", base,
+                                   std::error_code(errno, std::generic_category()));
+    }
+    try {
+        scan_index_dir(index, dir, fd, base, "", manifest);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return manifest;
+}
+
+bool load_manifest(const fs::path& path, Manifest& out) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != MANIFEST_HEADER) {
+        LOG_DEBUG("Ignoring manifest with unknown header: " + path.string());
+        return false;
+    }
+
+    out.clear();
+    while (std::getline(file, line)) {
+        // <type> <size> <mtime_ns> <mode> <ino> <hash|-> <path>
+        char type = 0;
+        uint64_t size = 0;
+        int64_t mtime_ns = 0;
+        unsigned int mode = 0;
+        uint64_t ino = 0;
+        char hash_buf[16] = {};
+        int consumed = 0;
+        if (sscanf(line.c_str(), "%c %" SCNu64 " %" SCNd64 " %o %" SCNu64 " %15s %n", &type, &size,
+                   &mtime_ns, &mode, &ino, hash_buf, &consumed) != 6 ||
+            consumed <= 0 || static_cast<size_t>(consumed) >= line.size()) {
+            LOG_WARN("Corrupt manifest line in " + path.string());
+            return false;
+        }
+
+        ManifestEntry e;
+        if (type != 'f' && type != 'd' && type != 'l') {
+            return false;
+        }
+        e.type = static_cast<ManifestType>(type);
+        e.size = size;
+        e.mtime_ns = mtime_ns;
+        e.mode = mode;
+        e.ino = ino;
+        if (hash_buf[0] != '-') {
+            e.has_hash = true;
+            e.hash = static_cast<uint32_t>(std::stoul(hash_buf, nullptr, 16));
+        }
+        out[line.substr(consumed)] = e;
+    }
+    return true;
+}
+
+bool save_manifest(const fs::path& path, const Manifest& manifest) {
+    if (!ensure_dir_exists(path.parent_path())) {
+        return false;
+    }
+
+    const fs::path tmp = path.string() + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file << MANIFEST_HEADER << "\n";
+
+        char buf[128];
+        for (const auto& [rel, e] : manifest) {
+            if (rel.find('\n') != std::string::npos) {
+                LOG_WARN("Cannot record path with newline in manifest: " + rel);
+                file.close();
+                fs::remove(tmp);
+                return false;
+            }
+            char hash_buf[16] = "-";
+            if (e.has_hash) {
+                snprintf(hash_buf, sizeof(hash_buf), "%08x", e.hash);
+            }
+            snprintf(buf, sizeof(buf), "%c %" PRIu64 " %" PRId64 " %o %" PRIu64 " %s ",
+                     static_cast<char>(e.type), e.size, e.mtime_ns, e.mode, e.ino, hash_buf);
+            file << buf << rel << "\n";
+        }
+        if (!file.good()) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
+
+bool hash_file(const fs::path& path, uint32_t& out) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::vector<unsigned char> buf(64 * 1024);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    ssize_t n;
+    while ((n = read(fd, buf.data(), buf.size())) > 0) {
+        crc = crc32(crc, buf.data(), static_cast<uInt>(n));
+    }
+    close(fd);
+    if (n < 0) {
+        return false;
+    }
+
+    out = static_cast<uint32_t>(crc);
+    return true;
+}
+
+}  // namespace hymo
@@ -0,0 +1,60 @@
+// core/manifest.hpp - Per-module sync manifest
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace hymo {
+
+class ModuleTreeIndex;
+
+enum class ManifestType : char { File = 'f', Directory = 'd', Symlink = 'l' };
+
+// Source-side metadata of one synced path, relative to the module root
+struct ManifestEntry {
+    ManifestType type = ManifestType::File;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    uint32_t mode = 0;
+    uint64_t ino = 0;
+    bool has_hash = false;
+    uint32_t hash = 0;  // crc32 of file content (only when has_hash)
+};
+
+using Manifest = std::map<std::string, ManifestEntry>;
+
+// Directory holding all module manifests of a storage root
+fs::path manifest_dir(const fs::path& storage_root);
+// Manifest location for `module_id` inside a storage root
+fs::path manifest_path(const fs::path& storage_root, const std::string& module_id);
+
+// Walk `src_root` the same way copy_tree copies it (directory symlinks are followed).
+// Throws fs::filesystem_error on unreadable directories.
+Manifest scan_manifest(const fs::path& src_root);
+// Same, from the indexed directory `dir`: the tree is not listed again, only regular files
+// are stat'ed (the index does not revalidate them) and directory symlinks the index does
+// not follow are walked
+Manifest scan_manifest(const ModuleTreeIndex& index, uint32_t dir);
+
+bool load_manifest(const fs::path& path, Manifest& out);
+bool save_manifest(const fs::path& path, const Manifest& manifest);
+
+// crc32 of a regular file; false on read error
+bool hash_file(const fs::path& path, uint32_t& out);
+
+// True when the source entry differs from what was synced last time
+inline bool manifest_entry_changed(const ManifestEntry& prev, const ManifestEntry& cur) {
+    if (prev.type != cur.type || prev.mode != cur.mode) {
+        return true;
+    }
+    if (cur.type == ManifestType::Directory) {
+        return false;
+    }
+    return prev.size != cur.size || prev.mtime_ns != cur.mtime_ns || prev.ino != cur.ino;
+}
+
+}  // namespace hymo
@@ -0,0 +1,585 @@
+// core/module_index.cpp - Single-pass index of module trees
+#include "module_index.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include "../defs.hpp"
+#include "../utils.hpp"
+
+namespace hymo {
+
+// Kernel layout of a getdents64 record
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Index file: header, root path (padded to 8 bytes), entries, name pool
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t entry_count;
+    uint64_t names_size;
+    uint64_t root_dev;
+    uint32_t root_len;
+    uint32_t reserved;
+};
+
+static constexpr char INDEX_MAGIC[8] = {'H', 'Y', 'M', 'O', 'I', 'D', 'X', '\0'};
+static constexpr uint32_t INDEX_VERSION = 2;
+
+// Directory symlinks below this depth are recorded but not followed
+static constexpr int FOLLOW_LINK_DEPTH = 2;
+
+static uint8_t dt_from_mode(mode_t mode) {
+    if (S_ISDIR(mode))
+        return DT_DIR;
+    if (S_ISREG(mode))
+        return DT_REG;
+    if (S_ISLNK(mode))
+        return DT_LNK;
+    if (S_ISCHR(mode))
+        return DT_CHR;
+    if (S_ISBLK(mode))
+        return DT_BLK;
+    if (S_ISFIFO(mode))
+        return DT_FIFO;
+    if (S_ISSOCK(mode))
+        return DT_SOCK;
+    return DT_UNKNOWN;
+}
+
+static void fill_stat(ModuleTreeEntry& e, const struct stat& st) {
+    e.size = static_cast<uint64_t>(st.st_size);
+    e.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    e.ctime_ns = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000LL + st.st_ctim.tv_nsec;
+    e.ino = static_cast<uint64_t>(st.st_ino);
+    e.mode = st.st_mode & 07777;
+}
+
+// Symlink target type; a followed directory link also takes the target's stat
+static void fill_link_target(int dir_fd, const char* name, bool follow, ModuleTreeEntry& e) {
+    e.flags &= ~(MTI_LINK_DIR | MTI_LINK_REG);
+    struct stat target;
+    if (fstatat(dir_fd, name, &target, 0) != 0) {
+        return;
+    }
+    if (S_ISDIR(target.st_mode)) {
+        e.flags |= MTI_LINK_DIR;
+        if (follow) {
+            fill_stat(e, target);
+        }
+    } else if (S_ISREG(target.st_mode)) {
+        e.flags |= MTI_LINK_REG;
+    }
+}
+
+// Target type flags of a symlink, as fill_link_target sets them
+static uint8_t link_target_flags(int dir_fd, const char* name) {
+    ModuleTreeEntry e{};
+    fill_link_target(dir_fd, name, false, e);
+    return e.flags;
+}
+
+// Same directory with the same entries (any create/unlink/rename inside bumps mtime/ctime)
+static bool same_dir_state(const ModuleTreeEntry& a, const ModuleTreeEntry& b) {
+    return a.type == b.type && a.ino == b.ino && a.mtime_ns == b.mtime_ns &&
+           a.ctime_ns == b.ctime_ns;
+}
+
+static bool read_names(int fd, std::vector<std::string>& out) {
+    alignas(8) char buf[32 * 1024];
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n < 0) {
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        for (long off = 0; off < n;) {
+            const auto* d = reinterpret_cast<const LinuxDirent64*>(buf + off);
+            off += d->d_reclen;
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                continue;
+            }
+            out.emplace_back(d->d_name);
+        }
+    }
+}
+
+ModuleTreeIndex::~ModuleTreeIndex() {
+    reset();
+}
+
+void ModuleTreeIndex::reset() {
+    if (map_) {
+        munmap(map_, map_size_);
+        map_ = nullptr;
+        map_size_ = 0;
+    }
+    entries_.clear();
+    names_.clear();
+    entry_data_ = nullptr;
+    entry_count_ = 0;
+    name_data_ = nullptr;
+    root_dev_ = 0;
+    scanned_dirs_ = 0;
+    reused_dirs_ = 0;
+}
+
+bool ModuleTreeIndex::build(const fs::path& root, const ModuleTreeIndex* previous) {
+    reset();
+    root_ = root;
+
+    int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    root_dev_ = static_cast<uint64_t>(st.st_dev);
+    if (previous && (previous->empty() || previous->root_dev_ != root_dev_)) {
+        previous = nullptr;
+    }
+
+    ModuleTreeEntry e{};
+    e.type = DT_DIR;
+    e.parent = npos;
+    fill_stat(e, st);
+    entries_.push_back(e);
+
+    scan_dir(fd, "", root_index, 0, previous, previous ? root_index : npos);
+    close(fd);
+
+    entry_data_ = entries_.data();
+    entry_count_ = entries_.size();
+    name_data_ = names_.data();
+
+    LOG_DEBUG("Indexed " + root.string() + ": " + std::to_string(entry_count_) + " entries, " +
+              std::to_string(scanned_dirs_) + " dirs listed, " + std::to_string(reused_dirs_) +
+              " reused");
+    return true;
+}
+
+// entries_[dir] already holds the current stat of the directory at `rel`
+void ModuleTreeIndex::scan_dir(int root_fd, const std::string& rel, uint32_t dir, int depth,
+                               const ModuleTreeIndex* prev, uint32_t prev_dir) {
+    const uint32_t first = static_cast<uint32_t>(entries_.size());
+    const bool reuse =
+        prev && prev_dir != npos && same_dir_state(entries_[dir], prev->entry(prev_dir));
+
+    if (reuse) {
+        // Unchanged listing: copy the children, their subtrees are checked below. Files are
+        // not stat'ed again (the sync manifest does that for itself); only a symlink's target
+        // can change type without touching this directory.
+        const ModuleTreeEntry& pd = prev->entry(prev_dir);
+        for (uint32_t c = pd.first_child; c < pd.first_child + pd.child_count; ++c) {
+            ModuleTreeEntry e = prev->entry(c);
+            const std::string_view name = prev->name(c);
+            e.name_offset = static_cast<uint32_t>(names_.size());
+            e.parent = dir;
+            e.first_child = 0;
+            e.child_count = 0;
+            e.flags &= ~MTI_HAS_FILES;
+            if (e.type == DT_LNK) {
+                std::string link_rel = rel.empty() ? "" : rel + "/";
+                link_rel.append(name.data(), name.size());
+                fill_link_target(root_fd, link_rel.c_str(), depth < FOLLOW_LINK_DEPTH, e);
+            }
+            names_.append(name.data(), name.size());
+            entries_.push_back(e);
+        }
+        reused_dirs_++;
+    } else {
+        int fd = openat(root_fd, rel.empty() ? "." : rel.c_str(),
+                        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        std::vector<std::string> names;
+        if (fd < 0 || !read_names(fd, names)) {
+            LOG_WARN("Failed to list " + (root_ / rel).string() + ": " + strerror(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+            return;
+        }
+        std::sort(names.begin(), names.end());
+
+        for (const auto& name : names) {
+            struct stat st;
+            if (fstatat(fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+                name.size() > UINT16_MAX) {
+                continue;
+            }
+
+            ModuleTreeEntry e{};
+            e.name_offset = static_cast<uint32_t>(names_.size());
+            e.name_len = static_cast<uint16_t>(name.size());
+            e.type = dt_from_mode(st.st_mode);
+            e.parent = dir;
+            e.rdev = static_cast<uint64_t>(st.st_rdev);
+            fill_stat(e, st);
+
+            if (e.type == DT_CHR && st.st_rdev == 0) {
+                e.flags |= MTI_WHITEOUT;
+            } else if (e.type == DT_LNK) {
+                fill_link_target(fd, name.c_str(), depth < FOLLOW_LINK_DEPTH, e);
+            }
+
+            names_ += name;
+            entries_.push_back(e);
+        }
+        close(fd);
+        scanned_dirs_++;
+    }
+
+    const uint32_t count = static_cast<uint32_t>(entries_.size()) - first;
+    entries_[dir].first_child = first;
+    entries_[dir].child_count = count;
+
+    // entries_ grows while descending: index it, never hold references across the calls
+    bool has_files = false;
+    for (uint32_t i = first; i < first + count; ++i) {
+        const uint8_t type = entries_[i].type;
+        if (type == DT_REG || type == DT_LNK) {
+            has_files = true;
+        }
+        const bool follow =
+            type == DT_LNK && (entries_[i].flags & MTI_LINK_DIR) && depth < FOLLOW_LINK_DEPTH;
+        if (type != DT_DIR && !follow) {
+            continue;
+        }
+
+        const std::string name(names_, entries_[i].name_offset, entries_[i].name_len);
+        const std::string child_rel = rel.empty() ? name : rel + "/" + name;
+        if (reuse && type == DT_DIR) {
+            // The copied stat is from the previous run, the subdirectory may have changed
+            struct stat st;
+            if (fstatat(root_fd, child_rel.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+                !S_ISDIR(st.st_mode)) {
+                continue;
+            }
+            fill_stat(entries_[i], st);
+        }
+
+        const uint32_t prev_child = prev ? prev->child(prev_dir, name) : npos;
+        if (prev_child != npos && same_dir_state(entries_[i], prev->entry(prev_child))) {
+            // Setting an xattr bumps ctime
+            entries_[i].flags = (entries_[i].flags & ~MTI_OPAQUE) |
+                                (prev->entry(prev_child).flags & MTI_OPAQUE);
+        } else {
+            const fs::path full = root_ / child_rel;
+            char buf[4];
+            ssize_t len = follow ? getxattr(full.c_str(), REPLACE_DIR_XATTR, buf, sizeof(buf))
+                                 : lgetxattr(full.c_str(), REPLACE_DIR_XATTR, buf, sizeof(buf));
+            if (len > 0 && buf[0] == 'y') {
+                entries_[i].flags |= MTI_OPAQUE;
+            } else {
+                entries_[i].flags &= ~MTI_OPAQUE;
+            }
+        }
+
+        scan_dir(root_fd, child_rel, i, depth + 1, prev, prev_child);
+        if (entries_[i].flags & MTI_HAS_FILES) {
+            has_files = true;
+        }
+    }
+
+    if (has_files) {
+        entries_[dir].flags |= MTI_HAS_FILES;
+    }
+}
+
+bool ModuleTreeIndex::is_followed_link(uint32_t i) const {
+    const ModuleTreeEntry& e = entry_data_[i];
+    if (e.type != DT_LNK || !(e.flags & MTI_LINK_DIR)) {
+        return false;
+    }
+    int depth = 0;
+    for (uint32_t p = e.parent; p != root_index && p < entry_count_; p = entry_data_[p].parent) {
+        depth++;
+    }
+    return depth < FOLLOW_LINK_DEPTH;
+}
+
+bool ModuleTreeIndex::is_current() const {
+    if (empty()) {
+        return false;
+    }
+    int root_fd = open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) {
+        return false;
+    }
+
+    // Directories only (unchanged ones still have the same entries), plus the target type
+    // of symlinks, which can change without touching their directory. File contents are
+    // not checked here: the sync manifest stats files itself.
+    const uint8_t link_flags = MTI_LINK_DIR | MTI_LINK_REG;
+    struct stat st;
+    bool current = fstat(root_fd, &st) == 0 && static_cast<uint64_t>(st.st_dev) == root_dev_;
+    for (uint32_t i = 0; current && i < entry_count_; ++i) {
+        const ModuleTreeEntry& e = entry_data_[i];
+        const bool follow = is_followed_link(i);
+        if (i != root_index) {
+            if (e.type == DT_LNK && !follow) {
+                current = link_target_flags(root_fd, path(i).c_str()) == (e.flags & link_flags);
+                continue;
+            }
+            if (e.type != DT_DIR && !follow) {
+                continue;
+            }
+            if (fstatat(root_fd, path(i).c_str(), &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+                current = false;
+                break;
+            }
+        }
+        ModuleTreeEntry now{};
+        now.type = e.type;
+        fill_stat(now, st);
+        current = same_dir_state(now, e);
+    }
+    close(root_fd);
+    return current;
+}
+
+bool ModuleTreeIndex::save(const fs::path& file) const {
+    if (empty()) {
+        return false;
+    }
+
+    IndexFileHeader h{};
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.version = INDEX_VERSION;
+    h.entry_size = sizeof(ModuleTreeEntry);
+    h.entry_count = entry_count_;
+    h.names_size = names_.size();
+    h.root_dev = root_dev_;
+    const std::string root = root_.string();
+    h.root_len = static_cast<uint32_t>(root.size());
+
+    std::string head(reinterpret_cast<const char*>(&h), sizeof(h));
+    head += root;
+    head.resize((head.size() + 7) & ~size_t(7), '\0');
+
+    const fs::path tmp = file.string() + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    const std::pair<const void*, size_t> parts[] = {
+        {head.data(), head.size()},
+        {entry_data_, entry_count_ * sizeof(ModuleTreeEntry)},
+        {names_.data(), names_.size()},
+    };
+    bool ok = true;
+    for (const auto& [data, len] : parts) {
+        const char* p = static_cast<const char*>(data);
+        for (size_t done = 0; ok && done < len;) {
+            ssize_t n = write(fd, p + done, len - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = n > 0;
+            done += ok ? static_cast<size_t>(n) : 0;
+        }
+    }
+    close(fd);
+
+    if (!ok || rename(tmp.c_str(), file.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ModuleTreeIndex::load(const fs::path& file, const fs::path& root) {
+    reset();
+    root_ = root;
+
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(IndexFileHeader)) {
+        close(fd);
+        return false;
+    }
+    const size_t file_size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    map_ = map;
+    map_size_ = file_size;
+
+    const auto* base = static_cast<const char*>(map);
+    IndexFileHeader h;
+    memcpy(&h, base, sizeof(h));
+    const std::string want = root.string();
+    const size_t entries_off = (sizeof(h) + h.root_len + 7) & ~size_t(7);
+    if (memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) != 0 || h.version != INDEX_VERSION ||
+        h.entry_size != sizeof(ModuleTreeEntry) || h.root_len != want.size() ||
+        entries_off > file_size || memcmp(base + sizeof(h), want.data(), want.size()) != 0 ||
+        h.entry_count == 0 ||
+        h.entry_count >= npos || h.names_size > file_size ||
+        h.entry_count > (file_size - entries_off) / sizeof(ModuleTreeEntry) ||
+        entries_off + h.entry_count * sizeof(ModuleTreeEntry) + h.names_size != file_size) {
+        reset();
+        return false;
+    }
+
+    const auto* entries = reinterpret_cast<const ModuleTreeEntry*>(base + entries_off);
+    // Children always follow their parent, so a valid file cannot make walks loop
+    for (uint64_t i = 0; i < h.entry_count; ++i) {
+        const ModuleTreeEntry& e = entries[i];
+        if (uint64_t(e.name_offset) + e.name_len > h.names_size ||
+            (i > 0 && e.parent >= i) ||
+            (e.child_count > 0 &&
+             (e.first_child <= i || uint64_t(e.first_child) + e.child_count > h.entry_count))) {
+            reset();
+            return false;
+        }
+    }
+
+    root_dev_ = h.root_dev;
+    entry_data_ = entries;
+    entry_count_ = h.entry_count;
+    name_data_ = base + entries_off + h.entry_count * sizeof(ModuleTreeEntry);
+    return true;
+}
+
+uint32_t ModuleTreeIndex::child(uint32_t dir, std::string_view name) const {
+    if (dir == npos || dir >= entry_count_) {
+        return npos;
+    }
+    const ModuleTreeEntry& d = entry_data_[dir];
+    uint32_t lo = d.first_child;
+    uint32_t hi = d.first_child + d.child_count;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        const int cmp = this->name(mid).compare(name);
+        if (cmp == 0) {
+            return mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return npos;
+}
+
+std::string ModuleTreeIndex::path(uint32_t i) const {
+    std::string rel;
+    for (; i != root_index && i < entry_count_; i = entry_data_[i].parent) {
+        rel.insert(0, rel.empty() ? std::string(name(i)) : std::string(name(i)) + "/");
+    }
+    return rel;
+}
+
+uint32_t ModuleTreeIndex::find(std::string_view rel) const {
+    if (empty()) {
+        return npos;
+    }
+    uint32_t cur = root_index;
+    while (!rel.empty() && cur != npos) {
+        const size_t slash = rel.find('/');
+        const std::string_view part = rel.substr(0, slash);
+        if (!part.empty() && part != ".") {
+            cur = child(cur, part);
+        }
+        rel = slash == std::string_view::npos ? std::string_view() : rel.substr(slash + 1);
+    }
+    return cur;
+}
+
+struct CachedIndex {
+    dev_t dev;
+    ino_t ino;
+    std::shared_ptr<const ModuleTreeIndex> index;
+};
+
+static std::string index_key(const fs::path& root) {
+    std::string key = root.lexically_normal().string();
+    while (key.size() > 1 && key.back() == '/') {
+        key.pop_back();
+    }
+    return key;
+}
+
+// /data/adb/modules -> <MODULE_INDEX_DIR>/_data_adb_modules.idx
+static fs::path index_file(const std::string& key) {
+    std::string name = key;
+    std::replace(name.begin(), name.end(), '/', '_');
+    return fs::path(MODULE_INDEX_DIR) / (name + ".idx");
+}
+
+static std::mutex g_index_mutex;
+static std::map<std::string, CachedIndex> g_indexes;
+
+std::shared_ptr<const ModuleTreeIndex> module_tree_index(const fs::path& root) {
+    const std::string key = index_key(root);
+    struct stat st;
+    if (stat(key.c_str(), &st) != 0) {
+        return std::make_shared<const ModuleTreeIndex>();
+    }
+
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    auto it = g_indexes.find(key);
+    if (it != g_indexes.end() && it->second.dev == st.st_dev && it->second.ino == st.st_ino) {
+        return it->second.index;
+    }
+
+    // Start from the saved index: unchanged directories are neither listed nor stat'ed per file
+    const fs::path file = index_file(key);
+    auto index = std::make_shared<ModuleTreeIndex>();
+    if (index->load(file, key) && index->is_current()) {
+        LOG_DEBUG("Reusing saved index of " + key + " (" + std::to_string(index->size()) +
+                  " entries)");
+    } else {
+        auto built = std::make_shared<ModuleTreeIndex>();
+        built->build(key, index.get());
+        if (!built->empty() && ensure_dir_exists(MODULE_INDEX_DIR) && !built->save(file)) {
+            LOG_DEBUG("Failed to save index of " + key + " to " + file.string());
+        }
+        index = built;
+    }
+
+    g_indexes[key] = {st.st_dev, st.st_ino, index};
+    return index;
+}
+
+void invalidate_module_tree_index(const fs::path& root) {
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    g_indexes.erase(index_key(root));
+}
+
+bool module_has_content(const fs::path& module_path, const std::vector<std::string>& partitions) {
+    const auto index = module_tree_index(module_path.parent_path());
+    const uint32_t module = index->child(ModuleTreeIndex::root_index,
+                                         module_path.filename().string());
+    for (const auto& partition : partitions) {
+        if (index->has_files(index->child(module, partition))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace hymo
@@ -0,0 +1,167 @@
+// core/module_index.hpp - Single-pass index of module trees
+#pragma once
+
+#include <dirent.h>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace hymo {
+
+enum ModuleTreeFlags : uint8_t {
+    MTI_WHITEOUT = 1 << 0,   // Character device 0:0 (overlay whiteout)
+    MTI_OPAQUE = 1 << 1,     // Directory with trusted.overlay.opaque=y
+    MTI_LINK_DIR = 1 << 2,   // Symlink whose target is a directory
+    MTI_LINK_REG = 1 << 3,   // Symlink whose target is a regular file
+    MTI_HAS_FILES = 1 << 4,  // Directory with a regular file or symlink somewhere below it
+};
+
+// One lstat'ed path. Children of a directory are stored contiguously, sorted by name.
+// The layout is also the on-disk format of the persisted index, keep it fixed-size.
+struct ModuleTreeEntry {
+    uint32_t name_offset;  // Into the name pool
+    uint16_t name_len;
+    uint8_t type;   // DT_* of the entry itself (not following symlinks)
+    uint8_t flags;  // ModuleTreeFlags
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t child_count;
+    uint32_t mode;  // Permission bits (st_mode & 07777)
+    uint64_t size;
+    int64_t mtime_ns;  // For followed directory symlinks: stat of the target directory
+    int64_t ctime_ns;
+    uint64_t rdev;
+    uint64_t ino;
+};
+static_assert(sizeof(ModuleTreeEntry) == 64, "ModuleTreeEntry is part of the index file format");
+
+// Flat, read-only snapshot of a modules root (<root>/<module id>/<partition>/...), built
+// with one getdents64 walk. Directory symlinks are followed for the module and partition
+// levels only, which is where the old path-based lookups followed them too.
+//
+// The snapshot can be saved and mmap'd back on the next boot. A directory whose inode,
+// mtime and ctime are unchanged still has the same entries (creating, removing or renaming
+// a child bumps them), so only directories that changed are listed and stat'ed again. Only
+// symlink targets are looked up in unchanged directories. Sizes and mtimes of files in
+// them can be stale (rewritten in place): callers that need them, like the sync manifest,
+// stat the files themselves.
+class ModuleTreeIndex {
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+    static constexpr uint32_t root_index = 0;
+
+    ModuleTreeIndex() = default;
+    ~ModuleTreeIndex();
+    ModuleTreeIndex(const ModuleTreeIndex&) = delete;
+    ModuleTreeIndex& operator=(const ModuleTreeIndex&) = delete;
+
+    // Walk `root`; false (and an empty index) if it cannot be opened. With `previous` (an
+    // older index of the same root), directories that did not change are not listed again.
+    bool build(const fs::path& root, const ModuleTreeIndex* previous = nullptr);
+
+    // mmap an index saved by save(); false if missing, corrupt or not an index of `root`
+    bool load(const fs::path& file, const fs::path& root);
+    bool save(const fs::path& file) const;
+    // True when no indexed directory or symlink target changed since the index was built
+    // (stat only)
+    bool is_current() const;
+
+    const fs::path& root() const { return root_; }
+    size_t size() const { return entry_count_; }
+    bool empty() const { return entry_count_ == 0; }
+    const ModuleTreeEntry& entry(uint32_t i) const { return entry_data_[i]; }
+    std::string_view name(uint32_t i) const {
+        return std::string_view(name_data_ + entry_data_[i].name_offset, entry_data_[i].name_len);
+    }
+    // Directories listed by the last build(); the rest were reused from `previous`
+    size_t scanned_dirs() const { return scanned_dirs_; }
+    size_t reused_dirs() const { return reused_dirs_; }
+
+    // Child `name` of directory `dir`, or npos
+    uint32_t child(uint32_t dir, std::string_view name) const;
+    // Path of `i` relative to the root
+    std::string path(uint32_t i) const;
+    // Entry at `rel` ("id/system/bin/sh", "" is the root), or npos
+    uint32_t find(std::string_view rel) const;
+
+    // fs::is_directory / fs::is_regular_file / fs::is_symlink equivalents
+    bool is_dir(uint32_t i) const {
+        return entry_data_[i].type == DT_DIR || (entry_data_[i].flags & MTI_LINK_DIR);
+    }
+    bool is_regular(uint32_t i) const {
+        return entry_data_[i].type == DT_REG || (entry_data_[i].flags & MTI_LINK_REG);
+    }
+    bool is_symlink(uint32_t i) const { return entry_data_[i].type == DT_LNK; }
+    bool is_whiteout(uint32_t i) const { return entry_data_[i].flags & MTI_WHITEOUT; }
+
+    // A regular file or symlink somewhere below `i`
+    bool has_files(uint32_t i) const {
+        return i != npos && (entry_data_[i].flags & MTI_HAS_FILES);
+    }
+
+    // Pre-order walk below `dir` (excluding it). `visit(index, rel)` gets the path relative
+    // to `dir` and returns false to skip a directory's children.
+    template <typename Visit>
+    void walk(uint32_t dir, Visit&& visit) const {
+        std::string rel;
+        walk_children(dir, rel, visit);
+    }
+
+private:
+    template <typename Visit>
+    void walk_children(uint32_t dir, std::string& rel, Visit& visit) const {
+        const ModuleTreeEntry& d = entry_data_[dir];
+        const size_t base = rel.size();
+        for (uint32_t i = d.first_child; i < d.first_child + d.child_count; ++i) {
+            if (base > 0) {
+                rel += '/';
+            }
+            rel += name(i);
+            if (visit(i, static_cast<const std::string&>(rel)) &&
+                entry_data_[i].child_count > 0) {
+                walk_children(i, rel, visit);
+            }
+            rel.resize(base);
+        }
+    }
+
+    void scan_dir(int root_fd, const std::string& rel, uint32_t dir, int depth,
+                  const ModuleTreeIndex* prev, uint32_t prev_dir);
+    bool is_followed_link(uint32_t i) const;
+    void reset();
+
+    fs::path root_;
+    uint64_t root_dev_ = 0;
+
+    // Built indexes own their storage, loaded ones point into the mapping
+    std::vector<ModuleTreeEntry> entries_;
+    std::string names_;
+    void* map_ = nullptr;
+    size_t map_size_ = 0;
+
+    const ModuleTreeEntry* entry_data_ = nullptr;
+    size_t entry_count_ = 0;
+    const char* name_data_ = nullptr;
+
+    size_t scanned_dirs_ = 0;
+    size_t reused_dirs_ = 0;
+};
+
+// Index of `root`, shared for the rest of the run. The first use in a run loads the index
+// persisted under MODULE_INDEX_DIR and rescans only what changed since it was saved.
+// Rebuilt when a different filesystem is mounted over `root` or after
+// invalidate_module_tree_index().
+std::shared_ptr<const ModuleTreeIndex> module_tree_index(const fs::path& root);
+
+// Drop the cached index of `root` after changing files below it
+void invalidate_module_tree_index(const fs::path& root);
+
+// True when `module_path` (<root>/<id>) has files in any of `partitions`
+bool module_has_content(const fs::path& module_path, const std::vector<std::string>& partitions);
+
+}  // namespace hymo
@@ -8,20 +8,10 @@
 #include "../utils.hpp"
 #include "inventory.hpp"
 #include "json.hpp"  // Changed include
+#include "module_index.hpp"
 
 namespace hymo {
 
-static bool has_content(const fs::path& module_path,
-                        const std::vector<std::string>& all_partitions) {
-    for (const auto& partition : all_partitions) {
-        fs::path part_path = module_path / partition;
-        if (has_files_recursive(part_path)) {
-            return true;
-        }
-    }
-    return false;
-}
-
 void update_module_description(bool success, const std::string& storage_mode, bool nuke_active,
                                size_t overlay_count, size_t magic_count, size_t hymofs_count,
                                const std::string& warning_msg, bool hymofs_active) {
@@ -93,7 +83,7 @@ void print_module_list(const Config& config) {
     // Filter modules with actual content (including extra partitions)
     std::vector<Module> filtered_modules;
     for (const auto& module : modules) {
-        if (has_content(module.source_path, all_partitions)) {
+        if (module_has_content(module.source_path, all_partitions)) {
             filtered_modules.push_back(module);
         }
     }
@@ -2,94 +2,146 @@
 #include "planner.hpp"
 #include <dirent.h>
 #include <sys/stat.h>
-#include <sys/sysmacros.h>
 #include <algorithm>
+#include <cstdlib>
+#include <iterator>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include "../defs.hpp"
 #include "../mount/hymofs.hpp"
 #include "../utils.hpp"
+#include "module_index.hpp"
 #include "user_rules.hpp"
 
 namespace hymo {
 
-bool MountPlan::is_covered_by_overlay(const std::string& path) const {
-    for (const auto& op : overlay_ops) {
-        std::string p_str = path;
-        std::string t_str = op.target;
-
-        if (p_str == t_str)
-            return true;
-
-        if (p_str.size() > t_str.size() && p_str.compare(0, t_str.size(), t_str) == 0 &&
-            p_str[t_str.size()] == '/') {
-            return true;
+void MountPlan::index_overlay_ops() {
+    overlay_targets_.clear();
+    overlay_layers_.assign(overlay_ops.size(), {});
+    for (size_t i = 0; i < overlay_ops.size(); ++i) {
+        // Keep the first op for a target, as the linear scan did
+        overlay_targets_.emplace(overlay_ops[i].target, i);
+        for (const auto& layer : overlay_ops[i].lowerdirs) {
+            overlay_layers_[i].insert(layer.string());
         }
     }
-    return false;
 }
 
-static bool has_files(const fs::path& path) {
-    if (!fs::exists(path) || !fs::is_directory(path)) {
-        return false;
+size_t MountPlan::find_overlay_op(const std::string& path) const {
+    if (overlay_targets_.empty() || overlay_layers_.size() != overlay_ops.size()) {
+        return npos;  // Not indexed (or overlay_ops changed since)
     }
-    try {
-        for (const auto& entry : fs::directory_iterator(path)) {
-            (void)entry;
-            return true;
+    // Shortest prefix first: an op on /system covers everything an op on /system/app would
+    for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+        auto it = overlay_targets_.find(path.substr(0, pos));
+        if (it != overlay_targets_.end()) {
+            return it->second;
         }
-    } catch (...) {
+    }
+    auto it = overlay_targets_.find(path);
+    return it != overlay_targets_.end() ? it->second : npos;
+}
+
+bool MountPlan::is_covered_by_overlay(const std::string& path) const {
+    return find_overlay_op(path) != npos;
+}
+
+bool MountPlan::add_overlay_layer(size_t op, const fs::path& layer) {
+    if (overlay_layers_.size() != overlay_ops.size()) {
+        index_overlay_ops();
+    }
+    if (!overlay_layers_[op].insert(layer.string()).second) {
         return false;
     }
-    return false;
+    overlay_ops[op].lowerdirs.push_back(layer);
+    return true;
 }
 
-static bool has_meaningful_content(const fs::path& base,
+// Any entry directly inside a partition directory of `module` (even an empty subdir)
+static bool has_meaningful_content(const ModuleTreeIndex& index, uint32_t module,
                                    const std::vector<std::string>& partitions) {
     for (const auto& part : partitions) {
-        fs::path p = base / part;
-        if (fs::exists(p) && has_files(p)) {
+        const uint32_t p = index.child(module, part);
+        if (p != ModuleTreeIndex::npos && index.is_dir(p) && index.entry(p).child_count > 0) {
             return true;
         }
     }
     return false;
 }
 
-// Helper: Resolve symlinks in directory symlinks but preserve filename logic
-static std::string resolve_path_for_hymofs(const std::string& path_str) {
-    try {
-        fs::path p(path_str);
-        if (!p.has_parent_path())
-            return path_str;
+namespace {
+
+// Resolves directory symlinks in a virtual path (/system/vendor/lib/x -> /vendor/lib/x) up to
+// the last existing directory, like fs::canonical on the existing part, and keeps the final
+// component as is. Directories are cached for the planning pass: each one costs a single
+// lstat the first time, every later path below it one hash lookup.
+class VirtualPathResolver {
+public:
+    struct Dir {
+        std::string path;  // Resolved
+        bool is_dir;       // Exists and is a directory (following symlinks)
+    };
+
+    std::string resolve(const std::string& path) {
+        const size_t slash = path.rfind('/');
+        if (slash == std::string::npos || slash == 0) {
+            return path;
+        }
+        return join(dir(path.substr(0, slash)).path, path, slash);
+    }
 
-        fs::path parent = p.parent_path();
-        fs::path filename = p.filename();
+    // `path` itself resolved; entries stay valid while the resolver lives
+    const Dir& dir(const std::string& path) {
+        auto it = cache_.find(path);
+        if (it != cache_.end()) {
+            hits_++;
+            return it->second;
+        }
+        misses_++;
+        Dir resolved = lookup(path);
+        return cache_.emplace(path, std::move(resolved)).first->second;
+    }
 
-        fs::path curr = parent;
-        std::vector<fs::path> suffix;
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
 
-        // Walk up until we find an existing path
-        while (!curr.empty() && curr != "/" && !fs::exists(curr)) {
-            suffix.push_back(curr.filename());
-            curr = curr.parent_path();
-        }
+private:
+    static std::string join(const std::string& base, const std::string& path, size_t slash) {
+        return (base == "/" ? std::string() : base) + path.substr(slash);
+    }
 
-        // Resolve the existing base
-        if (fs::exists(curr)) {
-            curr = fs::canonical(curr);
+    Dir lookup(const std::string& path) {
+        const size_t slash = path.rfind('/');
+        if (slash == std::string::npos || path == "/") {
+            return {path, true};
         }
-
-        // Re-append the non-existing suffix
-        for (auto it = suffix.rbegin(); it != suffix.rend(); ++it) {
-            curr /= *it;
+        const Dir& parent = slash == 0 ? root_ : dir(path.substr(0, slash));
+        std::string candidate = join(parent.path, path, slash);
+        struct stat st;
+        // Nothing exists below a missing directory, the rest is appended unresolved
+        if (!parent.is_dir || lstat(candidate.c_str(), &st) != 0) {
+            return {std::move(candidate), false};
         }
-
-        curr /= filename;
-        return curr.string();
-    } catch (...) {
-        return path_str;
+        if (!S_ISLNK(st.st_mode)) {
+            return {std::move(candidate), S_ISDIR(st.st_mode)};
+        }
+        char* real = realpath(candidate.c_str(), nullptr);
+        if (!real) {
+            return {std::move(candidate), false};  // Dangling
+        }
+        Dir resolved{real, stat(real, &st) == 0 && S_ISDIR(st.st_mode)};
+        free(real);
+        return resolved;
     }
-}
+
+    const Dir root_{"/", true};
+    std::unordered_map<std::string, Dir> cache_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+}  // namespace
 
 MountPlan generate_plan(const Config& config, const std::vector<Module>& modules,
                         const fs::path& storage_root) {
@@ -110,12 +162,15 @@ MountPlan generate_plan(const Config& config, const std::vector<Module>& modules
                       (config.ignore_protocol_mismatch && (status == HymoFSStatus::KernelTooOld ||
                                                            status == HymoFSStatus::ModuleTooOld));
 
+    const auto index = module_tree_index(storage_root);
+
     for (const auto& module : modules) {
         fs::path content_path = storage_root / module.id;
 
-        if (!fs::exists(content_path))
+        const uint32_t module_entry = index->child(ModuleTreeIndex::root_index, module.id);
+        if (module_entry == ModuleTreeIndex::npos)
             continue;
-        if (!has_meaningful_content(content_path, target_partitions))
+        if (!has_meaningful_content(*index, module_entry, target_partitions))
             continue;
 
         // Determine default mode
@@ -145,7 +200,9 @@ MountPlan generate_plan(const Config& config, const std::vector<Module>& modules
                 bool participates_in_overlay = false;
                 for (const auto& part : target_partitions) {
                     fs::path part_path = content_path / part;
-                    if (fs::is_directory(part_path) && has_files(part_path)) {
+                    const uint32_t p = index->child(module_entry, part);
+                    if (p != ModuleTreeIndex::npos && index->is_dir(p) &&
+                        index->entry(p).child_count > 0) {
                         std::string part_root = "/" + part;
                         overlay_layers[part_root].push_back(part_path);
                         participates_in_overlay = true;
@@ -160,65 +217,39 @@ MountPlan generate_plan(const Config& config, const std::vector<Module>& modules
             bool hymofs_active = false;
             bool overlay_active = false;
             bool magic_active = false;
+            const auto rules = module.rule_trie ? module.rule_trie : compile_rules(module.rules);
 
             for (const auto& part : target_partitions) {
-                fs::path part_root = content_path / part;
-                if (!fs::exists(part_root))
+                const uint32_t part_entry = index->child(module_entry, part);
+                if (part_entry == ModuleTreeIndex::npos)
                     continue;
 
-                for (const auto& entry : fs::recursive_directory_iterator(part_root)) {
-                    fs::path rel = fs::relative(entry.path(), content_path);
-                    std::string path_str = "/" + rel.string();
-
-                    std::string mode = default_mode;
-                    size_t max_len = 0;
-                    bool rule_found = false;
-
-                    for (const auto& rule : module.rules) {
-                        if (path_str == rule.path ||
-                            (path_str.size() > rule.path.size() &&
-                             path_str.compare(0, rule.path.size(), rule.path) == 0 &&
-                             path_str[rule.path.size()] == '/')) {
-                            if (rule.path.size() > max_len) {
-                                max_len = rule.path.size();
-                                mode = rule.mode;
-                                rule_found = true;
-                            }
-                        }
-                    }
+                index->walk(part_entry, [&](uint32_t i, const std::string& rel) {
+                    std::string path_str = "/" + part + "/" + rel;
+                    const fs::path entry_path = content_path / part / rel;
 
+                    const RuleTrie::Match match = rules->match(path_str);
+                    const std::string& mode = match.mode ? *match.mode : default_mode;
+                    const bool rule_found = match.mode != nullptr;
+
+                    // Everything below inherits "none" unless a deeper rule overrides it
                     if (mode == "none")
-                        continue;
+                        return match.rules_below;
 
-                    if (entry.is_directory()) {
+                    if (index->is_dir(i)) {
                         if (mode == "overlay") {
-                            bool is_exact_rule = false;
-                            for (const auto& rule : module.rules) {
-                                if (rule.path == path_str && rule.mode == "overlay") {
-                                    is_exact_rule = true;
-                                    break;
-                                }
-                            }
-
-                            if (is_exact_rule) {
-                                overlay_layers[path_str].push_back(entry.path());
+                            if (match.exact) {
+                                overlay_layers[path_str].push_back(entry_path);
                                 overlay_active = true;
                             } else if (!rule_found && default_mode == "overlay") {
-                                if (entry.path() == part_root) {
-                                    overlay_layers["/" + part].push_back(entry.path());
+                                if (entry_path == content_path / part) {
+                                    overlay_layers["/" + part].push_back(entry_path);
                                     overlay_active = true;
                                 }
                             }
                         } else if (mode == "magic") {
-                            bool is_exact_rule = false;
-                            for (const auto& rule : module.rules) {
-                                if (rule.path == path_str && rule.mode == "magic") {
-                                    is_exact_rule = true;
-                                    break;
-                                }
-                            }
-                            if (is_exact_rule) {
-                                magic_paths.insert(entry.path());
+                            if (match.exact) {
+                                magic_paths.insert(entry_path);
                                 magic_active = true;
                             }
                         } else if (mode == "hymofs") {
@@ -229,7 +260,8 @@ MountPlan generate_plan(const Config& config, const std::vector<Module>& modules
                     if (mode == "hymofs") {
                         hymofs_active = true;
                     }
-                }
+                    return true;
+                });
             }
 
             if (default_mode == "magic" && !magic_active && module.rules.empty()) {
@@ -273,6 +305,7 @@ MountPlan generate_plan(const Config& config, const std::vector<Module>& modules
         plan.overlay_ops.push_back(OverlayOperation{target_path.string(), layers});
     }
 
+    plan.index_overlay_ops();
     plan.magic_module_paths.assign(magic_paths.begin(), magic_paths.end());
     plan.overlay_module_ids.assign(overlay_ids.begin(), overlay_ids.end());
     plan.magic_module_ids.assign(magic_ids.begin(), magic_ids.end());
@@ -280,28 +313,22 @@ MountPlan generate_plan(const Config& config, const std::vector<Module>& modules
     return plan;
 }
 
-struct AddRule {
-    std::string src;
-    std::string target;
-    int type;
-};
-
-void update_hymofs_mappings(const Config& config, const std::vector<Module>& modules,
-                            const fs::path& storage_root, MountPlan& plan) {
-    if (!HymoFS::is_available())
-        return;
-
-    // Clear existing mappings
-    HymoFS::clear_rules();
-
+std::vector<HymoFSRule> generate_hymofs_rules(const Config& config,
+                                              const std::vector<Module>& modules,
+                                              const fs::path& storage_root, MountPlan& plan) {
     std::vector<std::string> target_partitions = BUILTIN_PARTITIONS;
     for (const auto& part : config.partitions) {
         target_partitions.push_back(part);
     }
 
-    std::vector<AddRule> add_rules;
-    std::vector<AddRule> merge_rules;
-    std::vector<std::string> hide_rules;
+    const auto index = module_tree_index(storage_root);
+    // Lowerdirs may have been moved since generate_plan (segregate_custom_rules)
+    plan.index_overlay_ops();
+    VirtualPathResolver resolver;
+
+    std::vector<HymoFSRule> add_rules;
+    std::vector<HymoFSRule> merge_rules;
+    std::vector<HymoFSRule> hide_rules;
 
     // Process explicit hide rules from module configuration
     for (const auto& module : modules) {
@@ -317,7 +344,8 @@ void update_hymofs_mappings(const Config& config, const std::vector<Module>& mod
 
         for (const auto& rule : module.rules) {
             if (rule.mode == "hide") {
-                hide_rules.push_back(resolve_path_for_hymofs(rule.path));
+                hide_rules.push_back(
+                    {HymoFSRuleOp::Hide, resolver.resolve(rule.path), "", 0});
             }
         }
     }
@@ -345,146 +373,92 @@ void update_hymofs_mappings(const Config& config, const std::vector<Module>& mod
             default_mode = "hymofs";  // If it's in hymofs_module_ids, default is
                                       // effectively hymofs unless overridden
 
+        const uint32_t module_entry = index->child(ModuleTreeIndex::root_index, module.id);
+        const auto rules = module.rule_trie ? module.rule_trie : compile_rules(module.rules);
+
         for (const auto& part : target_partitions) {
-            fs::path part_root = mod_path / part;
-            if (!fs::exists(part_root))
+            const uint32_t part_entry = index->child(module_entry, part);
+            if (part_entry == ModuleTreeIndex::npos)
                 continue;
 
-            try {
-                for (auto dir_it = fs::recursive_directory_iterator(part_root);
-                     dir_it != fs::recursive_directory_iterator(); ++dir_it) {
-                    const auto& entry = *dir_it;
-                    fs::path rel = fs::relative(entry.path(), mod_path);
-                    fs::path virtual_path = fs::path("/") / rel;
-                    std::string path_str = virtual_path.string();
-
-                    // Check rules
-                    std::string mode = default_mode;
-                    size_t max_len = 0;
-                    for (const auto& rule : module.rules) {
-                        if (path_str == rule.path ||
-                            (path_str.size() > rule.path.size() &&
-                             path_str.compare(0, rule.path.size(), rule.path) == 0 &&
-                             path_str[rule.path.size()] == '/')) {
-                            if (rule.path.size() > max_len) {
-                                max_len = rule.path.size();
-                                mode = rule.mode;
-                            }
-                        }
-                    }
+            index->walk(part_entry, [&](uint32_t i, const std::string& rel) {
+                const std::string path_str = "/" + part + "/" + rel;
+                const fs::path entry_path = mod_path / part / rel;
 
-                    // If mode is NOT hymofs, skip this file
-                    if (mode != "hymofs" && mode != "auto") {
-                        continue;
-                    }
+                // Check rules
+                const RuleTrie::Match match = rules->match(path_str);
+                const std::string& mode = match.mode ? *match.mode : default_mode;
 
-                    // Check if covered by overlay
-                    bool covered = false;
-                    // Use reference to allow modification of lowerdirs
-                    for (auto& op : plan.overlay_ops) {
-                        std::string p_str = virtual_path.string();
-                        std::string t_str = op.target;
-
-                        bool match =
-                            (p_str == t_str) || (p_str.size() > t_str.size() &&
-                                                 p_str.compare(0, t_str.size(), t_str) == 0 &&
-                                                 p_str[t_str.size()] == '/');
-
-                        if (match) {
-                            covered = true;
-                            // Add layer if not present
-                            if (t_str.size() > 1) {
-                                fs::path layer_path = mod_path / t_str.substr(1);
-                                bool exists = false;
-                                for (const auto& l : op.lowerdirs) {
-                                    if (l == layer_path) {
-                                        exists = true;
-                                        break;
-                                    }
-                                }
-                                if (!exists && fs::exists(layer_path)) {
-                                    op.lowerdirs.push_back(layer_path);
-                                }
-                            }
-                            break;
-                        }
-                    }
+                // If mode is NOT hymofs, skip this file (and its subtree when no deeper rule
+                // can switch it back)
+                if (mode != "hymofs" && mode != "auto") {
+                    return match.rules_below;
+                }
 
-                    if (covered) {
-                        continue;
+                // Check if covered by overlay
+                const size_t op = plan.find_overlay_op(path_str);
+                if (op != MountPlan::npos) {
+                    // Add this module as a layer of the covering overlay
+                    const std::string& target = plan.overlay_ops[op].target;
+                    if (target.size() > 1 &&
+                        index->find(module.id + target) != ModuleTreeIndex::npos) {
+                        plan.add_overlay_layer(op, mod_path / target.substr(1));
                     }
+                    return true;
+                }
 
-                    if (entry.is_directory()) {
-                        std::string final_virtual_path =
-                            resolve_path_for_hymofs(virtual_path.string());
-                        if (fs::exists(final_virtual_path) &&
-                            fs::is_directory(final_virtual_path)) {
-                            merge_rules.push_back(
-                                {final_virtual_path, entry.path().string(), DT_DIR});
-                            dir_it.disable_recursion_pending();  // Kernel handles children via
-                                                                 // merge
-                            continue;
-                        }
+                if (index->is_dir(i)) {
+                    if (resolver.dir(path_str).is_dir) {
+                        merge_rules.push_back({HymoFSRuleOp::Merge, resolver.resolve(path_str),
+                                               entry_path.string(), DT_DIR});
+                        return false;  // Kernel handles children via merge
                     }
+                }
 
-                    if (entry.is_regular_file() || entry.is_symlink()) {
-                        // Safety Check: Do not replace existing directories with symlinks
-                        if (entry.is_symlink()) {
-                            if (fs::exists(virtual_path) && fs::is_directory(virtual_path)) {
-                                LOG_WARN("Safety: Skipping symlink replacement for directory: " +
-                                         virtual_path.string());
-                                continue;
-                            }
-                        }
-                        int type = DT_UNKNOWN;
-                        if (entry.is_regular_file())
-                            type = DT_REG;
-                        else if (entry.is_symlink())
-                            type = DT_LNK;
-                        else if (entry.is_directory())
-                            type = DT_DIR;
-                        else if (entry.is_block_file())
-                            type = DT_BLK;
-                        else if (entry.is_character_file())
-                            type = DT_CHR;
-                        else if (entry.is_fifo())
-                            type = DT_FIFO;
-                        else if (entry.is_socket())
-                            type = DT_SOCK;
-
-                        std::string final_virtual_path =
-                            resolve_path_for_hymofs(virtual_path.string());
-                        add_rules.push_back({final_virtual_path, entry.path().string(), type});
-                    } else if (entry.is_character_file()) {
-                        // Check for whiteout (0:0)
-                        struct stat st;
-                        if (stat(entry.path().c_str(), &st) == 0) {
-                            if (major(st.st_rdev) == 0 && minor(st.st_rdev) == 0) {
-                                hide_rules.push_back(
-                                    resolve_path_for_hymofs(virtual_path.string()));
-                            }
+                if (index->is_regular(i) || index->is_symlink(i)) {
+                    // Safety Check: Do not replace existing directories with symlinks
+                    if (index->is_symlink(i)) {
+                        if (resolver.dir(path_str).is_dir) {
+                            LOG_WARN("Safety: Skipping symlink replacement for directory: " +
+                                     path_str);
+                            return true;
                         }
                     }
+                    int type = index->is_regular(i) ? DT_REG : DT_LNK;
+
+                    add_rules.push_back(
+                        {HymoFSRuleOp::Add, resolver.resolve(path_str), entry_path.string(), type});
+                } else if (index->is_whiteout(i)) {
+                    hide_rules.push_back(
+                        {HymoFSRuleOp::Hide, resolver.resolve(path_str), "", 0});
                 }
-            } catch (const std::exception& e) {
-                LOG_WARN("Error scanning module " + module.id + ": " + std::string(e.what()));
-            }
+                return true;
+            });
         }
     }
 
-    // Apply rules: Add files first (auto-injects parents), then hide
-    for (const auto& rule : add_rules) {
-        HymoFS::add_rule(rule.src, rule.target, rule.type);
-    }
-    for (const auto& rule : merge_rules) {
-        HymoFS::add_merge_rule(rule.src, rule.target);
-    }
-    for (const auto& path : hide_rules) {
-        HymoFS::hide_path(path);
-    }
+    LOG_DEBUG("Path resolver: " + std::to_string(resolver.hits()) + " cached, " +
+              std::to_string(resolver.misses()) + " looked up");
+
+    // Add files first (auto-injects parents), then hide
+    std::vector<HymoFSRule> rules = std::move(add_rules);
+    rules.reserve(rules.size() + merge_rules.size() + hide_rules.size());
+    std::move(merge_rules.begin(), merge_rules.end(), std::back_inserter(rules));
+    std::move(hide_rules.begin(), hide_rules.end(), std::back_inserter(rules));
+    return rules;
+}
+
+void update_hymofs_mappings(const Config& config, const std::vector<Module>& modules,
+                            const fs::path& storage_root, MountPlan& plan) {
+    if (!HymoFS::is_available())
+        return;
+
+    std::vector<HymoFSRule> rules = generate_hymofs_rules(config, modules, storage_root, plan);
+    append_user_hide_rules(rules);
 
-    // Apply user-defined hide rules
-    apply_user_hide_rules();
+    // Only rules that differ from the active set are sent (all of them at boot), and the
+    // result is published as one generation
+    HymoFS::reconcile_rules(rules);
 
     // Activate rules: we just added them, kernel must have hymofs_enabled=true for
     // redirect/hide to take effect. Do not use config.hymofs_enabled here — if we
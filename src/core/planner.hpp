@@ -3,8 +3,12 @@
 
 #include <filesystem>
 #include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "../conf/config.hpp"
+#include "../mount/hymofs.hpp"
 #include "inventory.hpp"
 
 namespace fs = std::filesystem;
@@ -17,18 +21,36 @@ struct OverlayOperation {
 };
 
 struct MountPlan {
+    static constexpr size_t npos = SIZE_MAX;
+
     std::vector<OverlayOperation> overlay_ops;
     std::vector<fs::path> magic_module_paths;
     std::vector<std::string> overlay_module_ids;
     std::vector<std::string> magic_module_ids;
     std::vector<std::string> hymofs_module_ids;
 
+    // Rebuild the target/lowerdir lookup tables; call after changing overlay_ops directly
+    void index_overlay_ops();
+    // Outermost overlay op whose target is `path` or one of its parents, npos if none.
+    // One hash lookup per path component.
+    size_t find_overlay_op(const std::string& path) const;
     bool is_covered_by_overlay(const std::string& path) const;
+    // Append `layer` (lowest priority) to op `op` unless it is already one of its lowerdirs
+    bool add_overlay_layer(size_t op, const fs::path& layer);
+
+private:
+    std::unordered_map<std::string, size_t> overlay_targets_;
+    std::vector<std::unordered_set<std::string>> overlay_layers_;
 };
 
 MountPlan generate_plan(const Config& config, const std::vector<Module>& modules,
                         const fs::path& storage_root);
 
+// Rules update_hymofs_mappings installs for `plan` (user hide rules not included)
+std::vector<HymoFSRule> generate_hymofs_rules(const Config& config,
+                                              const std::vector<Module>& modules,
+                                              const fs::path& storage_root, MountPlan& plan);
+
 void update_hymofs_mappings(const Config& config, const std::vector<Module>& modules,
                             const fs::path& storage_root, MountPlan& plan);
 
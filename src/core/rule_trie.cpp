@@ -0,0 +1,76 @@
+// core/rule_trie.cpp - Path-component trie for per-module mount rules
+#include "rule_trie.hpp"
+#include <algorithm>
+
+namespace hymo {
+
+static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+// Next non-empty component of `path` starting at `pos`; empty when exhausted
+static std::string_view next_component(std::string_view path, size_t& pos) {
+    while (pos < path.size() && path[pos] == '/') {
+        ++pos;
+    }
+    const size_t start = pos;
+    while (pos < path.size() && path[pos] != '/') {
+        ++pos;
+    }
+    return path.substr(start, pos - start);
+}
+
+RuleTrie::RuleTrie() : nodes_(1) {}
+
+uint32_t RuleTrie::find_child(uint32_t node, std::string_view name) const {
+    const auto& children = nodes_[node].children;
+    auto it = std::lower_bound(
+        children.begin(), children.end(), name,
+        [](const std::pair<std::string, uint32_t>& c, std::string_view n) { return c.first < n; });
+    return (it != children.end() && it->first == name) ? it->second : NO_NODE;
+}
+
+void RuleTrie::add(std::string_view path, const std::string& mode) {
+    uint32_t node = 0;
+    size_t pos = 0;
+    for (std::string_view comp = next_component(path, pos); !comp.empty();
+         comp = next_component(path, pos)) {
+        uint32_t next = find_child(node, comp);
+        if (next == NO_NODE) {
+            next = static_cast<uint32_t>(nodes_.size());
+            nodes_.emplace_back();
+            auto& children = nodes_[node].children;
+            auto it = std::lower_bound(children.begin(), children.end(), comp,
+                                       [](const std::pair<std::string, uint32_t>& c,
+                                          std::string_view n) { return c.first < n; });
+            children.insert(it, {std::string(comp), next});
+        }
+        node = next;
+    }
+    if (node == 0 || nodes_[node].has_rule) {
+        return;
+    }
+    nodes_[node].has_rule = true;
+    nodes_[node].mode = mode;
+}
+
+RuleTrie::Match RuleTrie::match(std::string_view path) const {
+    Match m;
+    uint32_t node = 0;
+    size_t pos = 0;
+    for (std::string_view comp = next_component(path, pos); !comp.empty();
+         comp = next_component(path, pos)) {
+        node = find_child(node, comp);
+        if (node == NO_NODE) {
+            // Deeper than any rule: only the longest match so far applies
+            m.exact = false;
+            return m;
+        }
+        m.exact = nodes_[node].has_rule;
+        if (m.exact) {
+            m.mode = &nodes_[node].mode;
+        }
+    }
+    m.rules_below = !nodes_[node].children.empty();
+    return m;
+}
+
+}  // namespace hymo
@@ -0,0 +1,42 @@
+// core/rule_trie.hpp - Path-component trie for per-module mount rules
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace hymo {
+
+// Rules ("/system/app/Foo" = magic) keyed by path component, so the longest rule covering a
+// path is found in O(depth) instead of by scanning every rule for every file.
+class RuleTrie {
+public:
+    struct Match {
+        const std::string* mode = nullptr;  // Longest rule covering the path, nullptr if none
+        bool exact = false;                 // That rule is for the path itself
+        bool rules_below = false;           // Some rule targets a path strictly below it
+    };
+
+    RuleTrie();
+
+    // Empty components are ignored ("/a//b/" is "/a/b"). A rule that names no component
+    // (e.g. "/") never matches, as before. The first rule added for a path wins.
+    void add(std::string_view path, const std::string& mode);
+    Match match(std::string_view path) const;
+    bool empty() const { return nodes_.size() == 1; }
+
+private:
+    struct Node {
+        std::vector<std::pair<std::string, uint32_t>> children;  // Sorted by name
+        std::string mode;
+        bool has_rule = false;
+    };
+
+    uint32_t find_child(uint32_t node, std::string_view name) const;
+
+    std::vector<Node> nodes_;
+};
+
+}  // namespace hymo
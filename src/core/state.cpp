@@ -19,6 +19,7 @@ bool RuntimeState::save() const {
     file << "{\n";
     file << "  \"storage_mode\": \"" << storage_mode << "\",\n";
     file << "  \"mount_point\": \"" << mount_point << "\",\n";
+    file << "  \"erofs_image\": \"" << erofs_image << "\",\n";
     file << "  \"nuke_active\": " << (nuke_active ? "true" : "false") << ",\n";
     file << "  \"hymofs_mismatch\": " << (hymofs_mismatch ? "true" : "false") << ",\n";
     file << "  \"mismatch_message\": \"" << mismatch_message << "\",\n";
@@ -111,6 +112,12 @@ RuntimeState load_runtime_state() {
             if (end != std::string::npos) {
                 state.mount_point = line.substr(start, end - start);
             }
+        } else if (line.find("\"erofs_image\"") != std::string::npos) {
+            auto start = line.find(": \"") + 3;
+            auto end = line.find("\"", start);
+            if (end != std::string::npos) {
+                state.erofs_image = line.substr(start, end - start);
+            }
         } else if (line.find("\"nuke_active\"") != std::string::npos) {
             state.nuke_active = line.find("true") != std::string::npos;
         } else if (line.find("\"hymofs_mismatch\"") != std::string::npos) {
@@ -9,6 +9,7 @@ namespace hymo {
 struct RuntimeState {
     std::string storage_mode;
     std::string mount_point;
+    std::string erofs_image;  // "reused" or "rebuilt" when storage_mode is erofs
     std::vector<std::string> overlay_module_ids;
     std::vector<std::string> magic_module_ids;
     std::vector<std::string> hymofs_module_ids;
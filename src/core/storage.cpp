@@ -1,25 +1,42 @@
 // core/storage.cpp - Storage backend (Tmpfs/Ext4/EROFS)
 #include "storage.hpp"
 #include <fcntl.h>
+#include <linux/loop.h>
 #include <sched.h>
+#include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/vfs.h>
 #include <sys/wait.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 #include <algorithm>
 #include <cinttypes>
 #include <cstdio>
 #include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <vector>
 #include "../defs.hpp"
 #include "../utils.hpp"
+#include "erofs_writer.hpp"
 #include "json.hpp"
+#include "module_index.hpp"
 #include "state.hpp"
 
+#ifndef EXT4_SUPER_MAGIC
+#define EXT4_SUPER_MAGIC 0xEF53
+#endif
+#ifndef EXT4_IOC_RESIZE_FS
+#define EXT4_IOC_RESIZE_FS _IOW('f', 16, uint64_t)
+#endif
+
 namespace hymo {
 
+static constexpr uint64_t IMAGE_MIN_SIZE = 64ULL * 1024 * 1024;
+
 static bool try_setup_tmpfs(const fs::path& target) {
     LOG_DEBUG("Attempting Tmpfs...");
 
@@ -59,24 +76,26 @@ static void repair_storage_root_permissions(const fs::path& target) {
     }
 }
 
-// Calculate directory size (bytes)
-static uint64_t dir_size(const fs::path& path) {
-    uint64_t total = 0;
-    try {
-        if (!fs::exists(path) || !fs::is_directory(path))
-            return 0;
-        for (const auto& e : fs::recursive_directory_iterator(path)) {
-            if (e.is_regular_file())
-                total += e.file_size();
-        }
-    } catch (...) {
-        /* ignore */
+static std::string format_size(uint64_t bytes) {
+    const uint64_t KB = 1024;
+    const uint64_t MB = KB * 1024;
+    const uint64_t GB = MB * 1024;
+
+    char buf[64];
+    if (bytes >= GB) {
+        snprintf(buf, sizeof(buf), "%.1fG", (double)bytes / GB);
+    } else if (bytes >= MB) {
+        snprintf(buf, sizeof(buf), "%.0fM", (double)bytes / MB);
+    } else if (bytes >= KB) {
+        snprintf(buf, sizeof(buf), "%.0fK", (double)bytes / KB);
+    } else {
+        snprintf(buf, sizeof(buf), "%" PRIu64 "B", bytes);
     }
-    return total;
+    return std::string(buf);
 }
 
-// Run mkfs.ext4 via execve (no shell)
-static bool run_mkfs_ext4(const fs::path& img_path) {
+// Run mkfs.ext4 via execve (no shell); `options` go before the image path
+static bool run_mkfs_ext4(const fs::path& img_path, const std::vector<std::string>& options = {}) {
     const char* mkfs_paths[] = {"/system/bin/mkfs.ext4", "/system/bin/mke2fs", "/sbin/mkfs.ext4",
                                 "/sbin/mke2fs"};
     const char* mkfs_bin = nullptr;
@@ -92,8 +111,12 @@ static bool run_mkfs_ext4(const fs::path& img_path) {
     }
 
     std::string path_str = img_path.string();
-    std::vector<const char*> argv = {mkfs_bin,         "-t",   "ext4", "-b", "1024",
-                                     path_str.c_str(), nullptr};
+    std::vector<const char*> argv = {mkfs_bin, "-t", "ext4"};
+    for (const auto& opt : options) {
+        argv.push_back(opt.c_str());
+    }
+    argv.push_back(path_str.c_str());
+    argv.push_back(nullptr);
 
     pid_t pid = fork();
     if (pid < 0) {
@@ -120,6 +143,21 @@ static bool run_mkfs_ext4(const fs::path& img_path) {
     return true;
 }
 
+// Bytes of the regular files below a modules dir, from its tree index
+static uint64_t modules_content_size(const fs::path& modules_dir) {
+    const auto index = module_tree_index(modules_dir);
+    uint64_t total = 0;
+    if (!index->empty()) {
+        index->walk(ModuleTreeIndex::root_index, [&](uint32_t i, const std::string&) {
+            if (index->entry(i).type == DT_REG) {
+                total += index->entry(i).size;
+            }
+            return true;
+        });
+    }
+    return total;
+}
+
 bool create_image(const fs::path& base_dir) {
     LOG_INFO("Creating modules.img...");
     fs::path img_file = base_dir / "modules.img";
@@ -133,10 +171,10 @@ bool create_image(const fs::path& base_dir) {
         fs::remove(img_file);
     }
 
-    // Dynamic size: max(moduledir_size * 1.2, 64MB) - align with mhm
-    const uint64_t min_size = 64ULL * 1024 * 1024;
-    uint64_t total = dir_size(modules_dir);
-    uint64_t grow_size = std::max(static_cast<uint64_t>(total * 1.2), min_size);
+    // Dynamic size: max(moduledir_size * 1.2, 64MB) - align with mhm. Sync still grows the
+    // image in place if modules get bigger later (ensure_storage_capacity).
+    const uint64_t total = modules_content_size(modules_dir);
+    const uint64_t grow_size = std::max(total * 6 / 5, IMAGE_MIN_SIZE);
 
     int fd = open(img_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
     if (fd < 0) {
@@ -151,7 +189,7 @@ bool create_image(const fs::path& base_dir) {
     }
     close(fd);
 
-    if (!run_mkfs_ext4(img_file)) {
+    if (!run_mkfs_ext4(img_file, {"-b", "1024"})) {
         fs::remove(img_file);
         return false;
     }
@@ -160,12 +198,230 @@ bool create_image(const fs::path& base_dir) {
     return true;
 }
 
+// Loop device (/dev node) and its backing file for the filesystem holding `path`
+static bool find_loop_backing(const fs::path& path, fs::path& loop_dev, fs::path& backing) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    const fs::path sys_dir = "/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":" +
+                             std::to_string(minor(st.st_dev));
+    std::ifstream backing_file(sys_dir / "loop" / "backing_file");
+    std::string backing_str;
+    if (!backing_file || !std::getline(backing_file, backing_str) || backing_str.empty()) {
+        return false;
+    }
+    backing = backing_str;
+
+    std::error_code ec;
+    const std::string name = fs::read_symlink(sys_dir, ec).filename().string();
+    if (ec || name.empty()) {
+        return false;
+    }
+    for (const auto& dev : {fs::path("/dev/block") / name, fs::path("/dev") / name}) {
+        if (fs::exists(dev, ec)) {
+            loop_dev = dev;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Grow the loop-mounted ext4 at `mount_point` to `new_size` bytes while it stays mounted
+static bool grow_image_online(const fs::path& mount_point, const fs::path& loop_dev,
+                              const fs::path& backing, uint64_t new_size, uint64_t block_size) {
+    int fd = open(backing.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("Failed to open " + backing.string() + ": " + strerror(errno));
+        return false;
+    }
+    // Reserve real blocks so the image cannot hit ENOSPC on /data later; fall back to a
+    // sparse extension where fallocate is unsupported
+    bool sized = fallocate(fd, 0, 0, static_cast<off_t>(new_size)) == 0;
+    if (!sized && (errno == EOPNOTSUPP || errno == ENOSYS)) {
+        sized = ftruncate(fd, static_cast<off_t>(new_size)) == 0;
+    }
+    const int err = errno;
+    close(fd);
+    if (!sized) {
+        LOG_ERROR("Failed to extend " + backing.string() + ": " + strerror(err));
+        return false;
+    }
+
+    fd = open(loop_dev.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || ioctl(fd, LOOP_SET_CAPACITY, 0) != 0) {
+        LOG_ERROR("LOOP_SET_CAPACITY failed on " + loop_dev.string() + ": " + strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    close(fd);
+
+    fd = open(mount_point.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    uint64_t blocks = new_size / block_size;
+    if (fd < 0 || ioctl(fd, EXT4_IOC_RESIZE_FS, &blocks) != 0) {
+        LOG_ERROR("Online ext4 resize failed: " + std::string(strerror(errno)));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+bool ensure_storage_capacity(const fs::path& storage_root, uint64_t bytes_needed,
+                             uint64_t inodes_needed) {
+    struct statfs stats;
+    if (statfs(storage_root.c_str(), &stats) != 0 || stats.f_blocks == 0) {
+        return true;
+    }
+    const uint64_t bsize = stats.f_bsize;
+    const uint64_t total = stats.f_blocks * bsize;
+    const uint64_t free_bytes = stats.f_bfree * bsize;
+    const uint64_t used = total - free_bytes;
+    const uint64_t inodes_used = stats.f_files - stats.f_ffree;
+
+    // Keep 10% of the image free after the sync for metadata and directory growth
+    const bool bytes_ok = free_bytes >= bytes_needed + total / 10;
+    const bool inodes_ok =
+        stats.f_files == 0 || stats.f_ffree >= inodes_needed + stats.f_files / 10;
+    if (bytes_ok && inodes_ok) {
+        return true;
+    }
+    // Without the headroom the sync can still go ahead; only a real shortfall fails it
+    const bool fits = free_bytes >= bytes_needed &&
+                      (stats.f_files == 0 || stats.f_ffree >= inodes_needed);
+
+    fs::path loop_dev;
+    fs::path backing;
+    if (stats.f_type != EXT4_SUPER_MAGIC ||
+        !find_loop_backing(storage_root, loop_dev, backing)) {
+        LOG_WARN("Storage may be too small: " + std::to_string(bytes_needed) +
+                 " bytes needed, " + std::to_string(free_bytes) + " free");
+        return fits;
+    }
+
+    // Same headroom as a fresh image: 1.2x of what will be used, in whole MiB
+    uint64_t target = (used + bytes_needed) * 6 / 5;
+    if (stats.f_files > 0) {
+        // ext4 adds inodes in proportion to the blocks a resize adds
+        const uint64_t bytes_per_inode = total / stats.f_files;
+        target = std::max(target, (inodes_used + inodes_needed) * 6 / 5 * bytes_per_inode);
+    }
+    target = std::max<uint64_t>((target + (1 << 20) - 1) & ~((1ULL << 20) - 1), total);
+    if (target <= total) {
+        return true;
+    }
+
+    LOG_INFO("Growing " + backing.string() + ": used " + format_size(used) + ", needs +" +
+             format_size(bytes_needed) + ", " + format_size(total) + " -> " + format_size(target));
+    return grow_image_online(storage_root, loop_dev, backing, target, bsize) || fits;
+}
+
 static bool is_erofs_available() {
     return access("/system/bin/mkfs.erofs", X_OK) == 0 ||
            access("/vendor/bin/mkfs.erofs", X_OK) == 0 || access("/sbin/mkfs.erofs", X_OK) == 0;
 }
 
-static bool create_erofs_image(const fs::path& modules_dir, const fs::path& image_path) {
+// Compression passed to mkfs.erofs; part of the image fingerprint
+static constexpr const char* EROFS_COMPRESSION = "-zlz4hc,9";
+
+static ErofsWriterOptions native_erofs_options(const Config& config) {
+    ErofsWriterOptions options;
+    options.cluster_size = static_cast<uint32_t>(config.erofs_cluster_size);
+    return options;
+}
+
+static void fnv1a(uint64_t& hash, const void* data, size_t len) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+static void fnv1a(uint64_t& hash, const std::string& s) {
+    fnv1a(hash, s.data(), s.size() + 1);  // Include the NUL as a field separator
+}
+
+// Hash everything mkfs.erofs puts into the image: paths, types, modes, owners, sizes,
+// mtimes, symlink targets and SELinux contexts. File content is represented by size and
+// mtime (staging hardlinks/copies keep the module's mtime), so no data is read.
+static void fingerprint_dir(uint64_t& hash, const fs::path& dir, const std::string& rel) {
+    std::vector<std::string> names;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        std::string name = entry.path().filename().string();
+        // Reserved storage metadata (sync manifests) changes on every sync
+        if (rel.empty() && name == "hymo") {
+            continue;
+        }
+        names.push_back(std::move(name));
+    }
+    std::sort(names.begin(), names.end());
+
+    for (const auto& name : names) {
+        const fs::path path = dir / name;
+        const std::string child_rel = rel + "/" + name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) {
+            throw fs::filesystem_error("lstat", path,
+                                       std::error_code(errno, std::generic_category()));
+        }
+
+        const int64_t mtime_ns =
+            static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        const uint64_t fields[] = {static_cast<uint64_t>(st.st_mode),
+                                   static_cast<uint64_t>(st.st_uid),
+                                   static_cast<uint64_t>(st.st_gid),
+                                   S_ISDIR(st.st_mode) ? 0 : static_cast<uint64_t>(st.st_size),
+                                   S_ISREG(st.st_mode) ? static_cast<uint64_t>(mtime_ns) : 0,
+                                   static_cast<uint64_t>(st.st_rdev)};
+        fnv1a(hash, child_rel);
+        fnv1a(hash, fields, sizeof(fields));
+
+        char ctx[256];
+        ssize_t len = lgetxattr(path.c_str(), SELINUX_XATTR, ctx, sizeof(ctx));
+        fnv1a(hash, len > 0 ? std::string(ctx, len) : std::string());
+
+        if (S_ISLNK(st.st_mode)) {
+            fnv1a(hash, fs::read_symlink(path).string());
+        } else if (S_ISDIR(st.st_mode)) {
+            fingerprint_dir(hash, path, child_rel);
+        }
+    }
+}
+
+// `builder` names the image format and builder options
+static std::string image_fingerprint(const fs::path& source_dir, const std::string& builder,
+                                     const std::vector<std::string>& partitions) {
+    uint64_t hash = 14695981039346656037ULL;
+    fnv1a(hash, "hymo-image-v1");
+    fnv1a(hash, builder);
+    for (const auto& part : partitions) {
+        fnv1a(hash, part);
+    }
+    fnv1a(hash, "");
+    fingerprint_dir(hash, source_dir, "");
+
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016" PRIx64, hash);
+    return buf;
+}
+
+static fs::path fingerprint_path(const fs::path& image_path) {
+    return image_path.string() + ".fingerprint";
+}
+
+// `modules_dir` is the staging tree, also for the native builder. The module sources can't
+// be packed in place: the staging tree holds only the active modules, each staged path has
+// the SELinux context of the system path it overlays (files whose source label differs are
+// copied there, see link_regular_file) and the fingerprint covers exactly that tree. It is
+// built from hardlinks, so it costs directory entries rather than file data, and the
+// mkfs.erofs fallback needs it anyway.
+static bool create_erofs_image(const fs::path& modules_dir, const fs::path& image_path,
+                               const Config& config) {
     LOG_INFO("Creating EROFS image from " + modules_dir.string());
 
     if (!fs::exists(modules_dir)) {
@@ -177,6 +433,16 @@ static bool create_erofs_image(const fs::path& modules_dir, const fs::path& imag
         fs::remove(image_path);
     }
 
+    if (config.erofs_native) {
+        if (build_erofs_image(modules_dir, image_path, native_erofs_options(config))) {
+            return true;
+        }
+        if (!is_erofs_available()) {
+            return false;
+        }
+        LOG_WARN("Native EROFS build failed, retrying with mkfs.erofs");
+    }
+
     const char* mkfs_paths[] = {"/system/bin/mkfs.erofs", "/vendor/bin/mkfs.erofs",
                                 "/sbin/mkfs.erofs"};
     const char* mkfs_bin = nullptr;
@@ -193,8 +459,8 @@ static bool create_erofs_image(const fs::path& modules_dir, const fs::path& imag
 
     std::string img_str = image_path.string();
     std::string mod_str = modules_dir.string();
-    std::vector<const char*> argv = {mkfs_bin, "-zlz4hc,9", img_str.c_str(), mod_str.c_str(),
-                                     nullptr};
+    std::vector<const char*> argv = {mkfs_bin, EROFS_COMPRESSION, img_str.c_str(),
+                                     mod_str.c_str(), nullptr};
 
     pid_t pid = fork();
     if (pid < 0) {
@@ -223,34 +489,83 @@ static bool create_erofs_image(const fs::path& modules_dir, const fs::path& imag
     return true;
 }
 
-static bool try_setup_erofs(const fs::path& target, const fs::path& modules_dir,
-                            const fs::path& image_path) {
-    LOG_DEBUG("Attempting EROFS...");
+// Reuse `image_path` when its recorded fingerprint matches `source_dir` and `builder`, else
+// rebuild it with `build`. Sets `reused` accordingly.
+static bool prepare_image(const fs::path& source_dir, const fs::path& image_path,
+                          const std::string& builder, const std::vector<std::string>& partitions,
+                          const std::function<bool()>& build, bool& reused) {
+    reused = false;
+    const fs::path fp_path = fingerprint_path(image_path);
 
-    if (!is_erofs_available()) {
-        LOG_WARN("mkfs.erofs not found.");
-        return false;
+    std::string fingerprint;
+    try {
+        fingerprint = image_fingerprint(source_dir, builder, partitions);
+    } catch (const std::exception& e) {
+        LOG_WARN("Image fingerprint failed, rebuilding: " + std::string(e.what()));
     }
 
-    if (!create_erofs_image(modules_dir, image_path)) {
-        LOG_WARN("Failed to create EROFS image.");
-        return false;
+    if (!fingerprint.empty() && fs::exists(image_path)) {
+        std::ifstream fp_file(fp_path);
+        std::string stored;
+        if (fp_file && std::getline(fp_file, stored) && stored == fingerprint) {
+            LOG_INFO(image_path.filename().string() + " up-to-date (" + fingerprint +
+                     "), reusing");
+            reused = true;
+            return true;
+        }
     }
 
-    if (!mount_image(image_path, target, "erofs", "loop,ro,noatime")) {
-        LOG_WARN("Failed to mount EROFS image.");
+    // Drop the old fingerprint first so an interrupted build is never reused
+    std::error_code ec;
+    fs::remove(fp_path, ec);
+
+    if (!build()) {
         return false;
     }
 
-    // Register unmountable path for proper cleanup
-    send_unmountable(target);
+    if (!fingerprint.empty()) {
+        std::ofstream fp_file(fp_path, std::ios::trunc);
+        fp_file << fingerprint << "\n";
+        if (!fp_file) {
+            LOG_WARN("Failed to record image fingerprint");
+        }
+    }
+    return true;
+}
 
-    LOG_INFO("EROFS active (read-only, compressed)");
+static bool prepare_erofs_image(const fs::path& modules_dir, const fs::path& image_path,
+                                const Config& config, bool& reused) {
+    const std::string builder =
+        config.erofs_native ? "erofs:native-lz4:" + std::to_string(config.erofs_cluster_size)
+                            : std::string("erofs:") + EROFS_COMPRESSION;
+    return prepare_image(modules_dir, image_path, builder, config.partitions, [&]() {
+        if (!config.erofs_native && !is_erofs_available()) {
+            LOG_WARN("mkfs.erofs not found.");
+            return false;
+        }
+        return create_erofs_image(modules_dir, image_path, config);
+    }, reused);
+}
+
+// Only checks that an EROFS image can be built and mounted. The image itself is built from
+// the staged tree by setup_erofs_storage: building one here as well would write the same
+// modules.erofs and fingerprint twice per boot and never reuse either.
+static bool try_setup_erofs(const Config& config) {
+    LOG_DEBUG("Attempting EROFS...");
+
+    if (!is_erofs_supported()) {
+        LOG_WARN("Kernel has no EROFS support.");
+        return false;
+    }
+    if (!config.erofs_native && !is_erofs_available()) {
+        LOG_WARN("mkfs.erofs not found.");
+        return false;
+    }
     return true;
 }
 
 StorageHandle setup_erofs_storage(const fs::path& mnt_dir, const fs::path& source_dir,
-                                  const fs::path& image_path) {
+                                  const fs::path& image_path, const Config& config) {
     LOG_DEBUG("Setting up EROFS storage at " + mnt_dir.string() + " from " + source_dir.string());
 
     if (fs::exists(mnt_dir)) {
@@ -258,11 +573,8 @@ StorageHandle setup_erofs_storage(const fs::path& mnt_dir, const fs::path& sourc
     }
     ensure_dir_exists(mnt_dir);
 
-    if (!is_erofs_available()) {
-        throw std::runtime_error("mkfs.erofs not found");
-    }
-
-    if (!create_erofs_image(source_dir, image_path)) {
+    bool reused = false;
+    if (!prepare_erofs_image(source_dir, image_path, config, reused)) {
         throw std::runtime_error("Failed to create EROFS image");
     }
 
@@ -274,7 +586,126 @@ StorageHandle setup_erofs_storage(const fs::path& mnt_dir, const fs::path& sourc
     send_unmountable(mnt_dir);
 
     LOG_INFO("EROFS active (read-only, compressed)");
-    return StorageHandle{mnt_dir, "erofs"};
+    return StorageHandle{mnt_dir, "erofs", reused ? "reused" : "rebuilt"};
+}
+
+struct Ext4Usage {
+    uint64_t blocks = 0;  // 4 KiB blocks for file, symlink and directory data
+    uint64_t inodes = 0;
+};
+
+// Space `mke2fs -d` needs for the tree (extended attributes live in the 256-byte inodes).
+// mke2fs picks the block size itself; counting in 4 KiB blocks covers every choice.
+static void ext4_usage(const fs::path& dir, Ext4Usage& usage) {
+    uint64_t dirent_bytes = 24;  // "." and ".."
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        struct stat st;
+        if (lstat(entry.path().c_str(), &st) != 0) {
+            continue;
+        }
+        const std::string name = entry.path().filename().string();
+        dirent_bytes += 8 + (name.size() + 3) / 4 * 4;
+        usage.inodes++;
+
+        if (S_ISREG(st.st_mode)) {
+            const uint64_t size = static_cast<uint64_t>(st.st_size);
+            // Data plus one extent tree block per 64 MiB
+            usage.blocks += (size + 4095) / 4096 + size / (64ULL << 20);
+        } else if (S_ISLNK(st.st_mode) && st.st_size >= 60) {
+            usage.blocks++;
+        } else if (S_ISDIR(st.st_mode)) {
+            ext4_usage(entry.path(), usage);
+        }
+    }
+    // Leaf blocks are never full once a directory is indexed
+    usage.blocks += (dirent_bytes + 4095) / 4096 * 5 / 4 + 1;
+}
+
+// Build `image_path` populated with `source_dir` in one mke2fs pass, sized from the content.
+// The image is written next to the target and renamed into place.
+static bool build_ext4_image(const fs::path& source_dir, const fs::path& image_path) {
+    LOG_INFO("Building ext4 image from " + source_dir.string());
+
+    Ext4Usage usage;
+    try {
+        ext4_usage(source_dir, usage);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Failed to scan " + source_dir.string() + ": " + e.what());
+        return false;
+    }
+
+    // Inode tables (256-byte inodes), bitmaps, lost+found and slack for mke2fs's own
+    // allocation
+    const uint64_t inodes = usage.inodes + usage.inodes / 8 + 64;
+    uint64_t blocks = usage.blocks + usage.blocks / 16 + inodes / 16 + 512;
+
+    const fs::path tmp = image_path.string() + ".tmp";
+    for (int attempt = 0; attempt < 4; ++attempt, blocks += blocks / 2) {
+        std::error_code ec;
+        fs::remove(tmp, ec);
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            LOG_ERROR("Failed to create image file: " + std::string(strerror(errno)));
+            return false;
+        }
+        const bool sized = ftruncate(fd, static_cast<off_t>(blocks * 4096)) == 0;
+        close(fd);
+        if (!sized) {
+            LOG_ERROR("ftruncate failed: " + std::string(strerror(errno)));
+            fs::remove(tmp, ec);
+            return false;
+        }
+
+        // Read-only image: no journal, no reserved blocks
+        if (run_mkfs_ext4(tmp, {"-O", "^has_journal", "-m", "0", "-N", std::to_string(inodes),
+                                "-d", source_dir.string()})) {
+            fs::rename(tmp, image_path, ec);
+            if (ec) {
+                LOG_ERROR("Failed to install ext4 image: " + ec.message());
+                fs::remove(tmp, ec);
+                return false;
+            }
+            LOG_INFO("Ext4 image built: " + std::to_string(usage.inodes) + " inodes, " +
+                     std::to_string(blocks / 256) + " MiB");
+            return true;
+        }
+        LOG_WARN("mke2fs -d failed with " + std::to_string(blocks / 256) +
+                 " MiB, retrying larger");
+    }
+
+    std::error_code ec;
+    fs::remove(tmp, ec);
+    return false;
+}
+
+StorageHandle setup_ext4_prebuilt_storage(const fs::path& mnt_dir, const fs::path& source_dir,
+                                          const fs::path& image_path, const Config& config) {
+    LOG_DEBUG("Setting up prebuilt ext4 storage at " + mnt_dir.string() + " from " +
+              source_dir.string());
+
+    if (fs::exists(mnt_dir)) {
+        umount2(mnt_dir.c_str(), MNT_DETACH);
+    }
+    ensure_dir_exists(mnt_dir);
+
+    // The image root is read-only once mounted: label it in the source instead
+    repair_storage_root_permissions(source_dir);
+
+    bool reused = false;
+    if (!prepare_image(source_dir, image_path, "ext4:mke2fs-d", config.partitions,
+                       [&]() { return build_ext4_image(source_dir, image_path); }, reused)) {
+        throw std::runtime_error("Failed to build ext4 image");
+    }
+
+    if (!mount_image(image_path, mnt_dir, "ext4", "loop,ro,noatime")) {
+        throw std::runtime_error("Failed to mount ext4 image");
+    }
+
+    // Register unmountable path for proper cleanup
+    send_unmountable(mnt_dir);
+
+    LOG_INFO("Ext4 active (read-only, prebuilt)");
+    return StorageHandle{mnt_dir, "ext4", ""};
 }
 
 static std::string setup_ext4_image(const fs::path& target, const fs::path& image_path) {
@@ -307,7 +738,7 @@ static std::string setup_ext4_image(const fs::path& target, const fs::path& imag
 }
 
 StorageHandle setup_storage(const fs::path& mnt_dir, const fs::path& image_path,
-                            FilesystemType fs_type) {
+                            FilesystemType fs_type, const Config& config) {
     LOG_DEBUG("Setting up storage at " + mnt_dir.string());
 
     if (fs::exists(mnt_dir)) {
@@ -316,8 +747,6 @@ StorageHandle setup_storage(const fs::path& mnt_dir, const fs::path& image_path,
     ensure_dir_exists(mnt_dir);
 
     std::string mode;
-    fs::path erofs_image = image_path.parent_path() / "modules.erofs";
-    fs::path modules_dir = image_path.parent_path() / "modules";
 
     // Helper functions for readability
     auto do_tmpfs = [&]() {
@@ -329,7 +758,7 @@ StorageHandle setup_storage(const fs::path& mnt_dir, const fs::path& image_path,
     };
 
     auto do_erofs = [&]() {
-        if (try_setup_erofs(mnt_dir, modules_dir, erofs_image)) {
+        if (try_setup_erofs(config)) {
             mode = "erofs";
             return true;
         }
@@ -337,7 +766,8 @@ StorageHandle setup_storage(const fs::path& mnt_dir, const fs::path& image_path,
     };
 
     auto do_ext4 = [&]() {
-        mode = setup_ext4_image(mnt_dir, image_path);
+        // The prebuilt image is built from staging and mounted later
+        mode = config.ext4_prebuilt ? "ext4" : setup_ext4_image(mnt_dir, image_path);
         return true;
     };
 
@@ -372,31 +802,14 @@ StorageHandle setup_storage(const fs::path& mnt_dir, const fs::path& image_path,
         break;
     }
 
-    return StorageHandle{mnt_dir, mode};
+    // erofs_image is only known once setup_erofs_storage has built or reused the image
+    return StorageHandle{mnt_dir, mode, ""};
 }
 
 void finalize_storage_permissions(const fs::path& storage_root) {
     repair_storage_root_permissions(storage_root);
 }
 
-static std::string format_size(uint64_t bytes) {
-    const uint64_t KB = 1024;
-    const uint64_t MB = KB * 1024;
-    const uint64_t GB = MB * 1024;
-
-    char buf[64];
-    if (bytes >= GB) {
-        snprintf(buf, sizeof(buf), "%.1fG", (double)bytes / GB);
-    } else if (bytes >= MB) {
-        snprintf(buf, sizeof(buf), "%.0fM", (double)bytes / MB);
-    } else if (bytes >= KB) {
-        snprintf(buf, sizeof(buf), "%.0fK", (double)bytes / KB);
-    } else {
-        snprintf(buf, sizeof(buf), "%" PRIu64 "B", bytes);
-    }
-    return std::string(buf);
-}
-
 static uint64_t calculate_dir_size(const fs::path& path) {
     uint64_t total = 0;
     try {
@@ -482,6 +895,9 @@ void print_storage_status() {
     root["avail"] = json::Value(format_size(free_bytes));
     root["percent"] = json::Value(percent);
     root["mode"] = json::Value(fs_type);
+    if (!state.erofs_image.empty()) {
+        root["erofs_image"] = json::Value(state.erofs_image);
+    }
 
     std::cerr << json::dump(root) << "\n";
 }
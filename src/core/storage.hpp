@@ -3,6 +3,7 @@
 
 #include <filesystem>
 #include <string>
+#include <vector>
 #include "../conf/config.hpp"
 
 namespace fs = std::filesystem;
@@ -11,21 +12,42 @@ namespace hymo {
 
 struct StorageHandle {
     fs::path mount_point;
-    std::string mode;  // tmpfs, ext4, erofs
+    std::string mode;         // tmpfs, ext4, erofs
+    std::string erofs_image;  // erofs only: "reused" (fingerprint matched) or "rebuilt"
 };
 
+// Choosing EROFS, or ext4 with `config.ext4_prebuilt`, only reserves `mnt_dir`: those images
+// are built from a staged tree and mounted by setup_erofs_storage /
+// setup_ext4_prebuilt_storage, so nothing is built or mounted read-write here first.
 StorageHandle setup_storage(const fs::path& mnt_dir, const fs::path& image_path,
-                            FilesystemType fs_type);
+                            FilesystemType fs_type, const Config& config);
 
 // Build an EROFS image from `source_dir` and mount it read-only at `mnt_dir`.
 // This is intended for mirror flows where content must be synced to a writable
 // staging directory before creating the compressed EROFS image.
+// The image is built in-process unless `config.erofs_native` is off (mkfs.erofs is the
+// fallback either way). The existing image is reused when its fingerprint (staged tree,
+// partitions and builder options, stored next to the image) still matches.
 StorageHandle setup_erofs_storage(const fs::path& mnt_dir, const fs::path& source_dir,
-                                  const fs::path& image_path);
+                                  const fs::path& image_path, const Config& config);
+
+// Build a fully populated ext4 image of `source_dir` in one pass (`mke2fs -d`, sized from
+// the content, SELinux contexts and other xattrs copied from the source) and mount it
+// read-only at `mnt_dir`. Reuses the image on a fingerprint match like the EROFS path.
+StorageHandle setup_ext4_prebuilt_storage(const fs::path& mnt_dir, const fs::path& source_dir,
+                                          const fs::path& image_path, const Config& config);
 
 // Exposed for CLI tools
 bool create_image(const fs::path& base_dir);
 
+// Make sure the filesystem holding `storage_root` can take `bytes_needed` more data and
+// `inodes_needed` more files, keeping some headroom. A loop-mounted ext4 image (modules.img)
+// is grown in place while mounted (fallocate, LOOP_SET_CAPACITY, online resize); other
+// filesystems are only checked. Returns false if the data would not fit even without the
+// headroom; callers must not start copying then.
+bool ensure_storage_capacity(const fs::path& storage_root, uint64_t bytes_needed,
+                             uint64_t inodes_needed);
+
 void finalize_storage_permissions(const fs::path& storage_root);
 
 void print_storage_status();
@@ -1,52 +1,21 @@
 // core/sync.cpp - Module content sync
 #include "sync.hpp"
-#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <map>
 #include <set>
+#include <stdexcept>
+#include <thread>
 #include "../defs.hpp"
 #include "../utils.hpp"
+#include "manifest.hpp"
+#include "module_index.hpp"
+#include "storage.hpp"
 
 namespace hymo {
 
-// Check if module has content for any partition
-static bool has_content(const fs::path& module_path,
-                        const std::vector<std::string>& all_partitions) {
-    for (const auto& partition : all_partitions) {
-        fs::path part_path = module_path / partition;
-        if (has_files_recursive(part_path)) {
-            return true;
-        }
-    }
-    return false;
-}
-
-// Check if module needs sync by comparing module.prop
-static bool should_sync(const fs::path& src, const fs::path& dst) {
-    if (!fs::exists(dst)) {
-        return true;  // New module
-    }
-
-    fs::path src_prop = src / "module.prop";
-    fs::path dst_prop = dst / "module.prop";
-
-    if (!fs::exists(src_prop) || !fs::exists(dst_prop)) {
-        return true;  // Force sync if prop missing
-    }
-
-    try {
-        std::ifstream src_file(src_prop, std::ios::binary);
-        std::ifstream dst_file(dst_prop, std::ios::binary);
-
-        std::string src_content((std::istreambuf_iterator<char>(src_file)),
-                                std::istreambuf_iterator<char>());
-        std::string dst_content((std::istreambuf_iterator<char>(dst_file)),
-                                std::istreambuf_iterator<char>());
-
-        return src_content != dst_content;
-    } catch (...) {
-        return true;
-    }
-}
-
 // Remove orphaned module directories
 static void prune_orphaned_modules(const std::vector<Module>& modules,
                                    const fs::path& storage_root) {
@@ -79,14 +48,35 @@ static void prune_orphaned_modules(const std::vector<Module>& modules,
     } catch (...) {
         LOG_WARN("Failed to prune orphans.");
     }
-}
 
-// Map SELinux context from system if possible
-static void recursive_context_repair(const fs::path& base, const fs::path& current) {
-    if (!fs::exists(current)) {
+    // Manifests of removed modules would otherwise describe content that no longer exists
+    const fs::path manifests = manifest_dir(storage_root);
+    if (!fs::exists(manifests)) {
         return;
     }
+    try {
+        for (const auto& entry : fs::directory_iterator(manifests)) {
+            if (active_ids.find(entry.path().filename().string()) == active_ids.end()) {
+                fs::remove(entry.path());
+            }
+        }
+    } catch (...) {
+        LOG_WARN("Failed to prune orphaned manifests.");
+    }
+}
+
+// Give a hardlinked staged file its own inode, so relabelling it leaves the module file alone
+static bool unshare_hardlink(const fs::path& path) {
+    const fs::path tmp = path.string() + ".hymo_tmp";
+    if (!copy_node(path, tmp) || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
 
+// Map SELinux context of one synced path from the system if possible
+static void repair_path_context(const fs::path& base, const fs::path& current) {
     try {
         std::string file_name = current.filename().string();
 
@@ -105,78 +95,537 @@ static void recursive_context_repair(const fs::path& base, const fs::path& curre
             fs::path system_path = fs::path("/") / relative;
 
             if (fs::exists(system_path)) {
+                struct stat st;
+                if (lstat(current.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1 &&
+                    lgetfilecon(current) != lgetfilecon(system_path) &&
+                    !unshare_hardlink(current)) {
+                    LOG_DEBUG("Keeping context of hardlinked file: " + current.string());
+                    return;
+                }
                 copy_path_context(system_path, current);
             }
         }
-
-        if (fs::is_directory(current)) {
-            for (const auto& entry : fs::directory_iterator(current)) {
-                recursive_context_repair(base, entry.path());
-            }
-        }
     } catch (const std::exception& e) {
         LOG_DEBUG("Context repair failed: " + current.string());
     }
 }
 
+// Repair contexts of the paths written by this sync that live under a partition
 static void repair_module_contexts(const fs::path& module_root, const std::string& module_id,
-                                   const std::vector<std::string>& all_partitions) {
-    LOG_DEBUG("Repairing SELinux contexts for: " + module_id);
+                                   const std::vector<std::string>& touched,
+                                   const std::set<std::string>& partitions) {
+    LOG_DEBUG("Repairing SELinux contexts for: " + module_id + " (" +
+              std::to_string(touched.size()) + " paths)");
+
+    for (const auto& rel : touched) {
+        if (partitions.count(rel.substr(0, rel.find('/'))) == 0) {
+            continue;
+        }
+        repair_path_context(module_root, module_root / rel);
+    }
+}
+
+static size_t resolve_sync_jobs(const Config& config) {
+    if (config.sync_jobs > 0) {
+        return static_cast<size_t>(config.sync_jobs);
+    }
+    const unsigned int cpus = std::thread::hardware_concurrency();
+    return cpus > 0 ? cpus : 1;
+}
+
+// A subtree (or the loose files of one directory) of one module
+struct SyncUnit {
+    size_t job;
+    fs::path src;
+    fs::path dst;
+    bool files_only;
+};
+
+// Entries in the subtree of every index entry, the entry included
+static uint32_t count_subtree(const ModuleTreeIndex& index, uint32_t i,
+                              std::vector<uint32_t>& counts) {
+    const ModuleTreeEntry& e = index.entry(i);
+    uint32_t n = 1;
+    for (uint32_t c = e.first_child; c < e.first_child + e.child_count; ++c) {
+        n += count_subtree(index, c, counts);
+    }
+    counts[i] = n;
+    return n;
+}
 
-    for (const auto& partition : all_partitions) {
-        fs::path part_root = module_root / partition;
+// Split directory `dir` of the index into units of about `budget` entries: its own files
+// are one unit, subdirectories within budget are copied whole and bigger ones are split the
+// same way. Directories that get split are created here, like copy_tree would.
+static void split_units(const ModuleTreeIndex& index, const std::vector<uint32_t>& counts,
+                        uint32_t dir, size_t job, const fs::path& src, const fs::path& dst,
+                        uint32_t budget, std::vector<SyncUnit>& units) {
+    units.push_back({job, src, dst, true});
+    const ModuleTreeEntry& d = index.entry(dir);
+    for (uint32_t c = d.first_child; c < d.first_child + d.child_count; ++c) {
+        if (!index.is_dir(c)) {
+            continue;
+        }
+        const std::string name(index.name(c));
+        if (counts[c] <= budget || index.entry(c).child_count == 0) {
+            units.push_back({job, src / name, dst / name, false});
+            continue;
+        }
+        if (!fs::exists(dst / name)) {
+            fs::create_directory(dst / name);
+            fs::permissions(dst / name, fs::status(src / name).permissions());
+            lsetfilecon(dst / name, get_context_for_path(dst / name));
+        }
+        split_units(index, counts, c, job, src / name, dst / name, budget, units);
+    }
+}
 
-        if (fs::exists(part_root) && fs::is_directory(part_root)) {
-            try {
-                recursive_context_repair(module_root, part_root);
-            } catch (const std::exception& e) {
-                LOG_WARN("Context repair failed for " + module_id + "/" + partition);
+// Data blocks and inodes taken by a copy of module `name`, from an index of its parent
+static void indexed_usage(const ModuleTreeIndex& index, const std::string& name,
+                          uint64_t& bytes, uint64_t& inodes) {
+    const uint32_t dir = index.child(ModuleTreeIndex::root_index, name);
+    if (dir == ModuleTreeIndex::npos || !index.is_dir(dir)) {
+        return;
+    }
+    inodes++;
+    bytes += 4096;
+    index.walk(dir, [&](uint32_t i, const std::string&) {
+        const ModuleTreeEntry& e = index.entry(i);
+        inodes++;
+        if (e.type == DT_REG) {
+            bytes += (e.size + 4095) / 4096 * 4096;
+        } else if (e.type == DT_DIR) {
+            bytes += 4096;
+        }
+        return true;
+    });
+}
+
+SyncReport sync_modules(const std::vector<SyncJob>& jobs, const Config& config) {
+    SyncReport report;
+    report.modules.resize(jobs.size());
+
+    auto fail = [&report](size_t job, const std::string& error) {
+        auto& result = report.modules[job];
+        if (result.ok) {
+            result.ok = false;
+            result.error = error;
+        }
+    };
+
+    // Copies may need the storage grown first; links take no data blocks. Files already in
+    // the storage are overwritten in place, so only the growth over the current copy counts.
+    // The storage trees are rewritten right here: they are indexed for this estimate only,
+    // never through the persisted module_tree_index() cache.
+    std::map<fs::path, std::pair<uint64_t, uint64_t>> needed;
+    std::map<fs::path, ModuleTreeIndex> dst_indexes;
+    for (const auto& job : jobs) {
+        if (job.hardlink || !fs::exists(job.src)) {
+            continue;
+        }
+        const fs::path dst_root = job.dst.parent_path();
+        uint64_t src_bytes = 0, src_inodes = 0, dst_bytes = 0, dst_inodes = 0;
+        indexed_usage(*module_tree_index(job.src.parent_path()), job.src.filename().string(),
+                      src_bytes, src_inodes);
+        if (fs::exists(job.dst)) {
+            ModuleTreeIndex& dst_index = dst_indexes[dst_root];
+            if (dst_index.empty()) {
+                dst_index.build(dst_root);
             }
+            indexed_usage(dst_index, job.dst.filename().string(), dst_bytes, dst_inodes);
         }
+        auto& [bytes, inodes] = needed[job.dst.parent_path()];
+        bytes += src_bytes > dst_bytes ? src_bytes - dst_bytes : 0;
+        inodes += src_inodes > dst_inodes ? src_inodes - dst_inodes : 0;
     }
+    for (const auto& [root, need] : needed) {
+        if (ensure_storage_capacity(root, need.first, need.second)) {
+            continue;
+        }
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            report.modules[i].id = jobs[i].id;
+            if (!jobs[i].hardlink && jobs[i].dst.parent_path() == root) {
+                fail(i, "not enough space in " + root.string());
+            }
+        }
+    }
+
+    // Sources are indexed for this run already (module_has_content); subtree sizes decide
+    // how far each module is split. Almost all content sits below one partition directory
+    // (system/), so splitting only at the top level would leave one unit per module.
+    const size_t workers = resolve_sync_jobs(config);
+    std::map<fs::path, std::pair<std::shared_ptr<const ModuleTreeIndex>, std::vector<uint32_t>>>
+        indexes;
+    uint64_t total_entries = 0;
+    for (const auto& job : jobs) {
+        auto& [index, counts] = indexes[job.src.parent_path()];
+        if (!index) {
+            index = module_tree_index(job.src.parent_path());
+            counts.resize(index->size());
+            if (!index->empty()) {
+                count_subtree(*index, ModuleTreeIndex::root_index, counts);
+            }
+        }
+        const uint32_t dir =
+            index->child(ModuleTreeIndex::root_index, job.src.filename().string());
+        if (dir != ModuleTreeIndex::npos) {
+            total_entries += counts[dir];
+        }
+    }
+    // A few units per worker keeps them busy when unit sizes are uneven
+    const uint32_t budget =
+        static_cast<uint32_t>(std::max<uint64_t>(64, total_entries / (workers * 4)));
+
+    // Split modules into units on the calling thread so workers never race on creating a
+    // directory.
+    std::vector<SyncUnit> units;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const auto& job = jobs[i];
+        report.modules[i].id = job.id;
+
+        if (!report.modules[i].ok) {
+            continue;
+        }
+        if (!fs::exists(job.src)) {
+            LOG_WARN("sync: source does not exist: " + job.src.string());
+            continue;
+        }
+        if (!ensure_dir_exists(job.dst)) {
+            fail(i, "failed to create " + job.dst.string());
+            continue;
+        }
+
+        const auto& [index, counts] = indexes[job.src.parent_path()];
+        const uint32_t dir =
+            index->child(ModuleTreeIndex::root_index, job.src.filename().string());
+        if (dir == ModuleTreeIndex::npos || !index->is_dir(dir)) {
+            units.push_back({i, job.src, job.dst, false});
+            continue;
+        }
+        try {
+            split_units(*index, counts, dir, i, job.src, job.dst, budget, units);
+        } catch (const std::exception& e) {
+            fail(i, "failed to prepare " + job.dst.string() + ": " + e.what());
+        }
+    }
+
+    LOG_DEBUG("sync: " + std::to_string(units.size()) + " units from " +
+              std::to_string(jobs.size()) + " modules on " + std::to_string(workers) +
+              " workers");
+
+    std::vector<char> unit_ok(units.size(), 1);
+    parallel_for(units.size(), workers, [&](size_t u) {
+        const auto& unit = units[u];
+        const bool hardlink = jobs[unit.job].hardlink;
+        unit_ok[u] = unit.files_only ? copy_dir_files(unit.src, unit.dst, hardlink)
+                                     : copy_tree(unit.src, unit.dst, hardlink);
+    });
+
+    for (size_t u = 0; u < units.size(); ++u) {
+        if (!unit_ok[u]) {
+            fail(units[u].job, "failed to copy " + units[u].src.string());
+        }
+    }
+    for (const auto& job : jobs) {
+        invalidate_module_tree_index(job.dst.parent_path());
+    }
+
+    for (const auto& result : report.modules) {
+        if (!result.ok) {
+            report.failed++;
+            LOG_ERROR("Failed to sync module " + result.id + ": " + result.error);
+        }
+    }
+
+    return report;
 }
 
-void perform_sync(const std::vector<Module>& modules, const fs::path& storage_root,
-                  const Config& config) {
+// A file or symlink that differs from the last synced state
+struct CopyOp {
+    std::string rel;
+    ManifestEntry* entry;  // Into ModulePlan::manifest
+    bool added;
+    bool ok = true;
+};
+
+// Incremental sync work for one module
+struct ModulePlan {
+    Manifest manifest;                 // Current source state, recorded after a clean sync
+    std::vector<CopyOp> copies;
+    std::vector<std::pair<std::string, uint32_t>> new_dirs;  // Created after the space check
+    std::vector<std::string> touched;  // Paths written by this sync
+    uint64_t bytes_needed = 0;         // Data blocks the copies will write
+    uint64_t bytes_freed = 0;          // Data blocks of the files they replace
+    uint64_t inodes_needed = 0;
+};
+
+// Diff the module source against its manifest, then apply removals and mode changes. New
+// directories and file copies are left in the plan so nothing is created before the space
+// check, and copies can be spread over all workers.
+static void plan_module(const SyncJob& job, const fs::path& storage_root, const Config& config,
+                        bool keep_manifest, ModulePlan& plan, ModuleSyncResult& result) {
+    Manifest prev;
+    if (!keep_manifest || !load_manifest(manifest_path(storage_root, job.id), prev)) {
+        prev.clear();
+        if (keep_manifest && fs::exists(job.dst)) {
+            // Unknown previous state: start over from an empty copy
+            LOG_DEBUG("No usable manifest for " + job.id + ", doing full resync");
+            fs::remove_all(job.dst);
+        }
+    }
+
+    // The source tree is already indexed for this run (module_has_content)
+    const auto index = module_tree_index(job.src.parent_path());
+    const uint32_t dir =
+        index->child(ModuleTreeIndex::root_index, job.src.filename().string());
+    plan.manifest = dir != ModuleTreeIndex::npos && index->is_dir(dir)
+                        ? scan_manifest(*index, dir)
+                        : scan_manifest(job.src);
+    if (!fs::exists(job.dst)) {
+        plan.inodes_needed++;
+    }
+    if (!ensure_dir_exists(job.dst)) {
+        throw std::runtime_error("failed to create " + job.dst.string());
+    }
+
+    // Drop paths that vanished from the source or changed type
+    for (const auto& [rel, old] : prev) {
+        auto it = plan.manifest.find(rel);
+        if (it != plan.manifest.end() && it->second.type == old.type) {
+            continue;
+        }
+        fs::remove_all(job.dst / rel);  // May already be gone with its parent
+        if (old.type != ManifestType::Directory) {
+            result.files_removed++;
+        }
+    }
+
+    // Manifest keys are sorted, so parents always come before their children
+    for (auto& [rel, cur] : plan.manifest) {
+        const fs::path dst = job.dst / rel;
+        auto it = prev.find(rel);
+        const ManifestEntry* old =
+            (it != prev.end() && it->second.type == cur.type) ? &it->second : nullptr;
+        struct stat st;
+        const bool present = lstat(dst.c_str(), &st) == 0;
+
+        if (cur.type == ManifestType::Directory) {
+            if (!present) {
+                plan.new_dirs.emplace_back(rel, cur.mode);
+                plan.bytes_needed += 4096;
+                plan.inodes_needed++;
+                plan.touched.push_back(rel);
+            } else if (!old || old->mode != cur.mode) {
+                fs::permissions(dst, static_cast<fs::perms>(cur.mode));
+            }
+            continue;
+        }
+
+        if (old && present && !manifest_entry_changed(*old, cur)) {
+            cur.has_hash = old->has_hash;
+            cur.hash = old->hash;
+            continue;
+        }
+
+        // Touched but identical content (e.g. module reinstalled from the same zip)
+        if (old && present && config.sync_hash && cur.type == ManifestType::File &&
+            old->has_hash && old->size == cur.size && old->mode == cur.mode) {
+            uint32_t hash = 0;
+            if (hash_file(job.src / rel, hash) && hash == old->hash) {
+                cur.has_hash = true;
+                cur.hash = hash;
+                continue;
+            }
+        }
+
+        // Capacity estimate from the manifest sizes and the lstat above, no extra walk
+        if (cur.type == ManifestType::File) {
+            plan.bytes_needed += (cur.size + 4095) / 4096 * 4096;
+        }
+        if (present) {
+            plan.bytes_freed += static_cast<uint64_t>(st.st_blocks) * 512;
+        } else {
+            plan.inodes_needed++;
+        }
+        plan.copies.push_back({rel, &cur, old == nullptr});
+    }
+}
+
+SyncReport perform_sync(const std::vector<Module>& modules, const fs::path& storage_root,
+                        const Config& config, bool hardlink) {
     LOG_INFO("Syncing modules to " + storage_root.string());
 
     std::vector<std::string> all_partitions = BUILTIN_PARTITIONS;
     for (const auto& part : config.partitions) {
         all_partitions.push_back(part);
     }
+    const std::set<std::string> partition_set(all_partitions.begin(), all_partitions.end());
+    // A hardlinked staging tree is emptied before every sync and packed into an image: a
+    // manifest there would never be reused and would only end up inside the image
+    const bool keep_manifests = !hardlink;
 
     prune_orphaned_modules(modules, storage_root);
 
+    std::vector<SyncJob> jobs;
     for (const auto& module : modules) {
-        fs::path dst = storage_root / module.id;
-
-        if (!has_content(module.source_path, all_partitions)) {
+        if (!module_has_content(module.source_path, all_partitions)) {
             LOG_DEBUG("Skipping empty module: " + module.id);
             continue;
         }
+        jobs.push_back({module.id, module.source_path, storage_root / module.id, hardlink});
+    }
 
-        if (should_sync(module.source_path, dst)) {
-            LOG_DEBUG("Syncing: " + module.id);
+    SyncReport report;
+    report.modules.resize(jobs.size());
+    std::vector<ModulePlan> plans(jobs.size());
+    const size_t workers = resolve_sync_jobs(config);
 
-            if (fs::exists(dst)) {
-                try {
-                    fs::remove_all(dst);
-                } catch (const std::exception& e) {
-                    LOG_WARN("Failed to clean " + module.id);
-                }
+    parallel_for(jobs.size(), workers, [&](size_t i) {
+        auto& result = report.modules[i];
+        result.id = jobs[i].id;
+        try {
+            plan_module(jobs[i], storage_root, config, keep_manifests, plans[i], result);
+        } catch (const std::exception& e) {
+            result.ok = false;
+            result.error = e.what();
+        }
+    });
+
+    uint64_t bytes_needed = 0;
+    uint64_t bytes_freed = 0;
+    uint64_t inodes_needed = 0;
+    for (size_t i = 0; i < plans.size(); ++i) {
+        if (report.modules[i].ok) {
+            bytes_needed += plans[i].bytes_needed;
+            bytes_freed += plans[i].bytes_freed;
+            inodes_needed += plans[i].inodes_needed;
+        }
+    }
+
+    // Links take no data blocks; copies may need the image grown first
+    if (!hardlink && (bytes_needed > 0 || inodes_needed > 0) &&
+        !ensure_storage_capacity(storage_root,
+                                 bytes_needed > bytes_freed ? bytes_needed - bytes_freed : 0,
+                                 inodes_needed)) {
+        for (size_t i = 0; i < plans.size(); ++i) {
+            auto& result = report.modules[i];
+            if (result.ok && (!plans[i].copies.empty() || !plans[i].new_dirs.empty())) {
+                result.ok = false;
+                result.error = "not enough space in " + storage_root.string();
+            }
+        }
+    }
+
+    parallel_for(jobs.size(), workers, [&](size_t i) {
+        auto& result = report.modules[i];
+        for (const auto& [rel, mode] : plans[i].new_dirs) {
+            if (!result.ok) {
+                return;
+            }
+            const fs::path dst = jobs[i].dst / rel;
+            std::error_code ec;
+            fs::create_directory(dst, ec);
+            if (!ec) {
+                fs::permissions(dst, static_cast<fs::perms>(mode), ec);
+            }
+            if (ec) {
+                result.ok = false;
+                result.error = "failed to create " + dst.string() + ": " + ec.message();
+                return;
             }
+            lsetfilecon(dst, get_context_for_path(dst));
+        }
+    });
+
+    // Copy changed files of all modules on one pool
+    std::vector<std::pair<size_t, size_t>> ops;
+    for (size_t i = 0; i < plans.size(); ++i) {
+        if (!report.modules[i].ok) {
+            continue;
+        }
+        for (size_t c = 0; c < plans[i].copies.size(); ++c) {
+            ops.emplace_back(i, c);
+        }
+    }
+    LOG_DEBUG("sync: " + std::to_string(ops.size()) + " changed files in " +
+              std::to_string(jobs.size()) + " modules on " + std::to_string(workers) +
+              " workers");
+
+    parallel_for(ops.size(), workers, [&](size_t n) {
+        const auto& job = jobs[ops[n].first];
+        auto& op = plans[ops[n].first].copies[ops[n].second];
+        const fs::path src = job.src / op.rel;
+        op.ok = copy_node(src, job.dst / op.rel, job.hardlink);
+        if (op.ok && config.sync_hash && op.entry->type == ManifestType::File) {
+            op.entry->has_hash = hash_file(src, op.entry->hash);
+        }
+    });
 
-            if (!sync_dir(module.source_path, dst)) {
-                LOG_ERROR("Failed to sync: " + module.id);
-            } else {
-                repair_module_contexts(dst, module.id, all_partitions);
+    for (const auto& [i, c] : ops) {
+        const auto& op = plans[i].copies[c];
+        auto& result = report.modules[i];
+        if (!op.ok) {
+            if (result.ok) {
+                result.ok = false;
+                result.error = "failed to copy " + (jobs[i].src / op.rel).string();
             }
+            continue;
+        }
+        if (op.added) {
+            result.files_added++;
+        } else {
+            result.files_updated++;
+        }
+        if (op.entry->type == ManifestType::File) {
+            result.bytes_copied += op.entry->size;
+        }
+        plans[i].touched.push_back(op.rel);
+    }
+
+    parallel_for(jobs.size(), workers, [&](size_t i) {
+        const fs::path mpath = manifest_path(storage_root, jobs[i].id);
+        if (!report.modules[i].ok) {
+            // Force a full resync next time rather than trusting a half-applied state
+            std::error_code ec;
+            fs::remove(mpath, ec);
+            return;
+        }
+        if (keep_manifests && !save_manifest(mpath, plans[i].manifest)) {
+            LOG_WARN("Failed to save sync manifest for " + jobs[i].id);
+        }
+        if (!plans[i].touched.empty()) {
+            repair_module_contexts(jobs[i].dst, jobs[i].id, plans[i].touched, partition_set);
+        }
+    });
+
+    size_t changed = 0;
+    for (const auto& result : report.modules) {
+        if (!result.ok) {
+            report.failed++;
+            LOG_ERROR("Failed to sync module " + result.id + ": " + result.error);
+            continue;
+        }
+        if (result.files_added || result.files_updated || result.files_removed) {
+            changed++;
+            LOG_DEBUG("Synced " + result.id + ": +" + std::to_string(result.files_added) +
+                      " ~" + std::to_string(result.files_updated) + " -" +
+                      std::to_string(result.files_removed));
         } else {
-            LOG_DEBUG("Up-to-date: " + module.id);
+            LOG_DEBUG("Up-to-date: " + result.id);
         }
+        report.files_added += result.files_added;
+        report.files_updated += result.files_updated;
+        report.files_removed += result.files_removed;
+        report.bytes_copied += result.bytes_copied;
     }
 
-    LOG_INFO("Sync completed.");
+    invalidate_module_tree_index(storage_root);
+
+    LOG_INFO("Sync completed (" + std::to_string(changed) + " changed, " +
+             std::to_string(report.failed) + " failed; " + std::to_string(report.files_added) +
+             " added, " + std::to_string(report.files_updated) + " updated, " +
+             std::to_string(report.files_removed) + " removed, " +
+             std::to_string(report.bytes_copied) + " bytes copied).");
+    return report;
 }
 
-}  // namespace hymo
\ No newline at end of file
+}  // namespace hymo
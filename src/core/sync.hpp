@@ -1,6 +1,7 @@
 // core/sync.hpp - Module content synchronization
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include "../conf/config.hpp"
 #include "inventory.hpp"
@@ -9,7 +10,47 @@ namespace fs = std::filesystem;
 
 namespace hymo {
 
-void perform_sync(const std::vector<Module>& modules, const fs::path& storage_root,
-                  const Config& config);
+// One module directory to mirror from `src` into `dst`
+struct SyncJob {
+    std::string id;
+    fs::path src;
+    fs::path dst;
+    bool hardlink = false;  // Link regular files instead of copying (staging on the same fs)
+};
+
+struct ModuleSyncResult {
+    std::string id;
+    bool ok = true;
+    std::string error;  // First failure seen for this module
+    size_t files_added = 0;
+    size_t files_updated = 0;
+    size_t files_removed = 0;
+    uint64_t bytes_copied = 0;
+};
+
+struct SyncReport {
+    std::vector<ModuleSyncResult> modules;
+    size_t failed = 0;
+    size_t files_added = 0;
+    size_t files_updated = 0;
+    size_t files_removed = 0;
+    uint64_t bytes_copied = 0;
+
+    bool ok() const { return failed == 0; }
+};
+
+// Copy modules on a bounded worker pool (Config::sync_jobs). Modules are split into subtrees
+// of a bounded entry count (down to system/app/<name> and below where needed), so one large
+// module does not serialize the whole sync.
+// Copying jobs first make room in their storage (ensure_storage_capacity) and fail without
+// copying anything if there is not enough.
+SyncReport sync_modules(const std::vector<SyncJob>& jobs, const Config& config);
+
+// Incrementally sync modules into `storage_root`. Each module keeps a manifest of what was
+// copied (core/manifest.hpp), so only added/changed files are copied and deleted ones removed.
+// With `hardlink` the target is a staging tree emptied before each sync: no manifests are
+// kept there.
+SyncReport perform_sync(const std::vector<Module>& modules, const fs::path& storage_root,
+                        const Config& config, bool hardlink = false);
 
 }  // namespace hymo
@@ -152,33 +152,12 @@ void list_user_hide_rules() {
     std::cout << json::dump(root, 2) << "\n";
 }
 
-void apply_user_hide_rules() {
-    auto rules = load_user_hide_rules();
-
-    if (rules.empty()) {
-        LOG_INFO("No user hide rules to apply");
-        return;
-    }
-
-    int success = 0;
-    int failed = 0;
-
-    if (!HymoFS::is_available()) {
-        LOG_WARN("HymoFS not available, cannot apply user hide rules");
-        return;
+void append_user_hide_rules(std::vector<HymoFSRule>& rules) {
+    const auto user_rules = load_user_hide_rules();
+    for (const auto& rule : user_rules) {
+        rules.push_back({HymoFSRuleOp::Hide, rule.path, "", 0});
     }
-
-    for (const auto& rule : rules) {
-        if (HymoFS::hide_path(rule.path)) {
-            success++;
-        } else {
-            failed++;
-            LOG_WARN("Failed to apply user hide rule: " + rule.path);
-        }
-    }
-
-    LOG_INFO("Applied user hide rules: " + std::to_string(success) + " success, " +
-             std::to_string(failed) + " failed");
+    LOG_INFO("User hide rules: " + std::to_string(user_rules.size()));
 }
 
 }  // namespace hymo
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include "../mount/hymofs.hpp"
 
 namespace hymo {
 
@@ -26,7 +27,7 @@ bool remove_user_hide_rule(const std::string& path);
 // List all user-defined hide rules
 void list_user_hide_rules();
 
-// Apply all user hide rules to kernel (called during mount)
-void apply_user_hide_rules();
+// Add all user hide rules to a rule set about to be installed (called during mount)
+void append_user_hide_rules(std::vector<HymoFSRule>& rules);
 
 }  // namespace hymo
@@ -57,6 +57,12 @@ static std::vector<std::string> get_hymofs_feature_names(int features) {
         names.emplace_back("merge_dir");
     if (features & HYMO_FEATURE_SELINUX_BYPASS)
         names.emplace_back("selinux_bypass");
+    if (features & HYMO_FEATURE_RULE_BATCH)
+        names.emplace_back("rule_batch");
+    if (features & HYMO_FEATURE_RULE_TXN)
+        names.emplace_back("rule_txn");
+    if (features & HYMO_FEATURE_RULE_PAGES)
+        names.emplace_back("rule_pages");
     return names;
 }
 
@@ -73,6 +79,11 @@ std::string export_mount_stats_json() {
          << "\"dirs_mounted\":" << stats.dirs_mounted << ","
          << "\"symlinks_created\":" << stats.symlinks_created << ","
          << "\"overlayfs_mounts\":" << stats.overlayfs_mounts << ","
+         << "\"subtree_binds\":" << stats.subtree_binds << ","
+         << "\"mounts_saved\":" << stats.mounts_saved << ","
+         << "\"planned_mounts\":" << stats.planned_mounts << ","
+         << "\"actual_mounts\":" << stats.actual_mounts << ","
+         << "\"file_syscalls\":" << stats.file_syscalls << ","
          << "\"success_rate\":" << std::fixed << std::setprecision(2) << stats.get_success_rate()
          << "}";
 
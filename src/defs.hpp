@@ -14,6 +14,7 @@ namespace hymo {
 constexpr const char* FALLBACK_CONTENT_DIR = HYMO_DATA_DIR "/img_mnt/";
 constexpr const char* BASE_DIR = HYMO_DATA_DIR "/";
 constexpr const char* RUN_DIR = HYMO_DATA_DIR "/run/";
+constexpr const char* MODULE_INDEX_DIR = HYMO_DATA_DIR "/run/index";
 constexpr const char* STATE_FILE = HYMO_DATA_DIR "/run/daemon_state.json";
 constexpr const char* MOUNT_STATS_FILE = HYMO_DATA_DIR "/run/mount_stats.json";
 constexpr const char* DAEMON_LOG_FILE = HYMO_DATA_DIR "/daemon.log";
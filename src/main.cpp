@@ -10,15 +10,19 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <set>
 #include <sstream>
+#include <string_view>
 #include <thread>
 #include "conf/config.hpp"
+#include "core/erofs_writer.hpp"
 #include "core/executor.hpp"
 #include "core/inventory.hpp"
 #include "core/json.hpp"
 #include "core/lkm.hpp"
+#include "core/module_index.hpp"
 #include "core/modules.hpp"
 #include "core/planner.hpp"
 #include "core/state.hpp"
@@ -28,6 +32,7 @@
 #include "core/webui.hpp"
 #include "defs.hpp"
 #include "mount/hymofs.hpp"
+#include "mount/hymofs_sim.hpp"
 #include "utils.hpp"
 
 namespace fs = std::filesystem;
@@ -42,6 +47,10 @@ struct CliOptions {
     bool verbose = false;
     std::vector<std::string> partitions;
     std::string output;
+    bool dry_run = false;
+    size_t offset = 0;  // hymofs list paging
+    size_t limit = 0;   // 0 = all
+    std::string filter;
     std::vector<std::string> args;
 };
 
@@ -88,7 +97,8 @@ void print_help() {
     std::cout << "  config gen         Generate default config file\n";
     std::cout << "  config show        Show current configuration\n";
     std::cout << "  config sync-partitions  Scan and auto-add partitions\n";
-    std::cout << "  config create-image [dir]  Create modules.img\n\n";
+    std::cout << "  config create-image [dir]  Create modules.img\n";
+    std::cout << "  config build-erofs <src> <img> [cluster]  Build EROFS image in-process\n\n";
 
     std::cout << "Module Commands (module <subcommand>):\n";
     std::cout << "  module list        List all modules\n";
@@ -104,7 +114,8 @@ void print_help() {
     std::cout << "HymoFS Commands (hymofs <subcommand>):\n";
     std::cout << "  hymofs enable      Enable HymoFS (Protocol 11+)\n";
     std::cout << "  hymofs disable     Disable HymoFS\n";
-    std::cout << "  hymofs list        List all active HymoFS rules\n";
+    std::cout << "  hymofs list        List active HymoFS rules (--offset/--limit/--filter)\n";
+    std::cout << "  hymofs reconcile [--dry-run]  Sync kernel rules, sending only changes\n";
     std::cout << "  hymofs version     Show HymoFS protocol version\n";
     std::cout
         << "  hymofs features    Show HymoFS feature bitmask (mount_hide, maps_spoof, etc.)\n";
@@ -145,7 +156,9 @@ void print_help() {
     std::cout << "  debug stealth on|off    Enable/disable stealth mode\n";
     std::cout << "  debug set-uname <release> <version>  Set kernel version spoofing\n";
     std::cout << "  debug set-cmdline <cmdline>  Set /proc/cmdline spoofing\n";
-    std::cout << "  debug clear-cmdline          Clear /proc/cmdline spoofing\n\n";
+    std::cout << "  debug clear-cmdline          Clear /proc/cmdline spoofing\n";
+    std::cout << "  debug bench-hymofs           Time planning and rule application against\n"
+                 "                               the in-process HymoFS simulator\n\n";
 
     std::cout << "Options:\n";
     std::cout << "  -c, --config FILE       Config file path\n";
@@ -156,6 +169,10 @@ void print_help() {
     std::cout << "  -p, --partition NAME    Add partition (can be used multiple "
                  "times)\n";
     std::cout << "  -o, --output FILE       Output file (for gen-config)\n";
+    std::cout << "  -n, --dry-run           Show what hymofs reconcile would change\n";
+    std::cout << "      --offset N          hymofs list: skip the first N matching rules\n";
+    std::cout << "      --limit N           hymofs list: show at most N rules\n";
+    std::cout << "      --filter STR        hymofs list: only rules with STR in a path\n";
     std::cout << "  -h, --help              Show this help\n";
     std::cout << "\nExamples:\n";
     std::cout << "  hymod mount                    # Mount all modules\n";
@@ -200,11 +217,16 @@ void segregate_custom_rules(MountPlan& plan, const fs::path& mirror_dir) {
             }
         }
     }
+    // The moved layers must no longer show up in the mirror's tree index
+    invalidate_module_tree_index(mirror_dir);
 
     // DO NOT process Magic Mounts - they should use their original paths
     // Magic mount paths are module source directories, not overlay layers
 }
 
+// Long-only options
+enum { OPT_OFFSET = 256, OPT_LIMIT, OPT_FILTER };
+
 CliOptions parse_args(int argc, char** argv) {
     CliOptions opts;
 
@@ -217,6 +239,10 @@ CliOptions parse_args(int argc, char** argv) {
                                            {"verbose", no_argument, 0, 'v'},
                                            {"partition", required_argument, 0, 'p'},
                                            {"output", required_argument, 0, 'o'},
+                                           {"dry-run", no_argument, 0, 'n'},
+                                           {"offset", required_argument, 0, OPT_OFFSET},
+                                           {"limit", required_argument, 0, OPT_LIMIT},
+                                           {"filter", required_argument, 0, OPT_FILTER},
                                            {"help", no_argument, 0, 'h'},
                                            {0, 0, 0, 0}};
     // NOLINTEND(cppcoreguidelines-avoid-c-arrays,modernize-avoid-c-arrays,modernize-use-nullptr)
@@ -224,7 +250,7 @@ CliOptions parse_args(int argc, char** argv) {
     int opt;
     int option_index = 0;
 
-    while ((opt = getopt_long(argc, argv, "c:m:t:s:vp:o:h", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "c:m:t:s:vp:o:nh", long_options, &option_index)) != -1) {
         switch (opt) {
         case 'c':
             opts.config_file = optarg;
@@ -247,6 +273,18 @@ CliOptions parse_args(int argc, char** argv) {
         case 'o':
             opts.output = optarg;
             break;
+        case 'n':
+            opts.dry_run = true;
+            break;
+        case OPT_OFFSET:
+            opts.offset = std::stoul(optarg);
+            break;
+        case OPT_LIMIT:
+            opts.limit = std::stoul(optarg);
+            break;
+        case OPT_FILTER:
+            opts.filter = optarg;
+            break;
         case 'h':
             print_help();
             exit(0);
@@ -284,6 +322,69 @@ Config load_config(const CliOptions& opts) {
     }
 }
 
+// Rules a mount would install now: modules planned against the storage they were mounted
+// from (hot-mounted ones, not in that storage, against moduledir), plus user hide rules
+std::vector<HymoFSRule> desired_hymofs_rules(const Config& config) {
+    const RuntimeState state = load_runtime_state();
+    const fs::path storage_root =
+        state.mount_point.empty() ? config.moduledir : fs::path(state.mount_point);
+
+    std::vector<std::string> partitions = BUILTIN_PARTITIONS;
+    partitions.insert(partitions.end(), config.partitions.begin(), config.partitions.end());
+
+    std::vector<Module> in_storage;
+    std::vector<Module> in_moduledir;
+    for (const auto& mod : scan_modules(config.moduledir, config)) {
+        if (fs::exists(fs::path(RUN_DIR) / "hot_unmounted" / mod.id))
+            continue;
+        if (module_has_content(storage_root / mod.id, partitions)) {
+            in_storage.push_back(mod);
+        } else if (storage_root != config.moduledir &&
+                   module_has_content(mod.source_path, partitions)) {
+            in_moduledir.push_back(mod);
+        }
+    }
+
+    std::vector<HymoFSRule> rules;
+    const std::pair<const std::vector<Module>*, fs::path> groups[] = {
+        {&in_storage, storage_root}, {&in_moduledir, config.moduledir}};
+    for (const auto& [modules, root] : groups) {
+        if (modules->empty())
+            continue;
+        MountPlan plan = generate_plan(config, *modules, root);
+        auto group_rules = generate_hymofs_rules(config, *modules, root, plan);
+        std::move(group_rules.begin(), group_rules.end(), std::back_inserter(rules));
+    }
+    append_user_hide_rules(rules);
+    return rules;
+}
+
+// Writable staging dir for read-only image storage (EROFS, prebuilt ext4), emptied first
+fs::path reset_staging_dir() {
+    const fs::path staging_dir = fs::path(BASE_DIR) / "erofs_staging";
+    try {
+        if (fs::exists(staging_dir)) {
+            fs::remove_all(staging_dir);
+        }
+    } catch (...) {
+        LOG_WARN("Failed to clean image staging dir");
+    }
+    ensure_dir_exists(staging_dir);
+    return staging_dir;
+}
+
+// Build and mount the read-only image for a staged tree: modules.erofs for EROFS storage,
+// modules.ext4 for prebuilt ext4
+StorageHandle setup_image_storage(const std::string& mode, const fs::path& mnt_dir,
+                                  const fs::path& staging_dir, const Config& config) {
+    if (mode == "erofs") {
+        return setup_erofs_storage(mnt_dir, staging_dir, fs::path(BASE_DIR) / "modules.erofs",
+                                   config);
+    }
+    return setup_ext4_prebuilt_storage(mnt_dir, staging_dir, fs::path(BASE_DIR) / "modules.ext4",
+                                       config);
+}
+
 }  // namespace
 
 // NOLINTNEXTLINE(readability-function-size) legacy CLI dispatcher
@@ -360,7 +461,8 @@ int main(int argc, char** argv) {
         switch (get_command(cli.command)) {
         case Command::CONFIG: {
             if (cli.args.empty()) {
-                std::cerr << "Usage: hymod config <gen|show|sync-partitions|create-image>\n";
+                std::cerr
+                    << "Usage: hymod config <gen|show|sync-partitions|create-image|build-erofs>\n";
                 return 1;
             }
             const std::string subcmd = cli.args[0];
@@ -394,6 +496,16 @@ int main(int argc, char** argv) {
                           << (config.enable_hidexattr ? "true" : "false") << ",\n";
                 std::cout << "  \"hymofs_enabled\": " << (config.hymofs_enabled ? "true" : "false")
                           << ",\n";
+                std::cout << "  \"sync_jobs\": " << config.sync_jobs << ",\n";
+                std::cout << "  \"sync_hash\": " << (config.sync_hash ? "true" : "false")
+                          << ",\n";
+                std::cout << "  \"erofs_native\": " << (config.erofs_native ? "true" : "false")
+                          << ",\n";
+                std::cout << "  \"erofs_cluster_size\": " << config.erofs_cluster_size << ",\n";
+                std::cout << "  \"ext4_prebuilt\": " << (config.ext4_prebuilt ? "true" : "false")
+                          << ",\n";
+                std::cout << "  \"magic_bind_subtrees\": "
+                          << (config.magic_bind_subtrees ? "true" : "false") << ",\n";
                 std::cout << "  \"uname_release\": " << json_quote(config.uname_release) << ",\n";
                 std::cout << "  \"uname_version\": " << json_quote(config.uname_version) << ",\n";
                 std::cout << "  \"cmdline_value\": " << json_quote(config.cmdline_value)
@@ -475,9 +587,35 @@ int main(int argc, char** argv) {
                     LOG_ERROR("Failed to create modules.img via CLI");
                     return 1;
                 }
+            } else if (subcmd == "build-erofs") {
+                if (cli.args.size() < 3) {
+                    std::cerr << "Usage: hymod config build-erofs <src> <image> [cluster_size]\n";
+                    return 1;
+                }
+                const Config config = load_config(cli);
+                ErofsWriterOptions options;
+                options.cluster_size = static_cast<uint32_t>(config.erofs_cluster_size);
+                if (cli.args.size() >= 4) {
+                    options.cluster_size =
+                        static_cast<uint32_t>(std::strtoul(cli.args[3].c_str(), nullptr, 10));
+                }
+
+                ErofsWriterStats stats;
+                const auto start = std::chrono::steady_clock::now();
+                if (!build_erofs_image(cli.args[1], cli.args[2], options, &stats)) {
+                    std::cerr << "Failed to build EROFS image\n";
+                    return 1;
+                }
+                const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                         std::chrono::steady_clock::now() - start)
+                                         .count();
+                std::cout << "Built " << cli.args[2] << ": " << stats.inodes << " inodes, "
+                          << stats.compressed_files << " compressed files, " << stats.file_bytes
+                          << " -> " << stats.image_bytes << " bytes in " << elapsed << " ms\n";
+                return 0;
             } else {
                 std::cerr << "Unknown config subcommand: " << subcmd << "\n";
-                std::cerr << "Available: gen, show, sync-partitions, create-image\n";
+                std::cerr << "Available: gen, show, sync-partitions, create-image, build-erofs\n";
                 return 1;
             }
             break;
@@ -518,6 +656,8 @@ int main(int argc, char** argv) {
                         return 1;
                     }
 
+                    // Publish all partitions of the module at once
+                    HymoFSRuleTransaction rules_txn(true);
                     for (const auto& part : all_partitions) {
                         const fs::path src_dir = module_path / part;
                         if (fs::exists(src_dir) && fs::is_directory(src_dir)) {
@@ -529,6 +669,8 @@ int main(int argc, char** argv) {
                             }
                         }
                     }
+                    if (success_count > 0 && !rules_txn.commit())
+                        success_count = 0;
 
                     if (success_count > 0) {
                         std::cout << "Successfully added module " << module_id << "\n";
@@ -550,6 +692,7 @@ int main(int argc, char** argv) {
                         std::cout << "No content found to add for module " << module_id << "\n";
                     }
                 } else {  // delete
+                    HymoFSRuleTransaction rules_txn(true);
                     for (const auto& part : all_partitions) {
                         const fs::path src_dir = module_path / part;
                         if (fs::exists(src_dir) && fs::is_directory(src_dir)) {
@@ -561,6 +704,8 @@ int main(int argc, char** argv) {
                             }
                         }
                     }
+                    if (success_count > 0 && !rules_txn.commit())
+                        success_count = 0;
 
                     if (success_count > 0) {
                         std::cout << "Successfully removed " << success_count
@@ -610,6 +755,8 @@ int main(int argc, char** argv) {
                                          all_partitions.end());
 
                     int success_count = 0;
+                    // Publish all partitions of the module at once
+                    HymoFSRuleTransaction rules_txn(true);
                     for (const auto& part : all_partitions) {
                         const fs::path src_dir = module_path / part;
                         if (fs::exists(src_dir) && fs::is_directory(src_dir)) {
@@ -621,6 +768,8 @@ int main(int argc, char** argv) {
                             }
                         }
                     }
+                    if (success_count > 0 && !rules_txn.commit())
+                        success_count = 0;
 
                     if (success_count > 0) {
                         std::cout << "Successfully added module " << mod_id << "\n";
@@ -657,6 +806,7 @@ int main(int argc, char** argv) {
                     const fs::path module_path = config.moduledir / mod_id;
 
                     int success_count = 0;
+                    HymoFSRuleTransaction rules_txn(true);
                     for (const auto& part : all_partitions) {
                         const fs::path src_dir = module_path / part;
                         const fs::path target_base = fs::path("/") / part;
@@ -664,6 +814,8 @@ int main(int argc, char** argv) {
                             success_count++;
                         }
                     }
+                    if (success_count > 0 && !rules_txn.commit())
+                        success_count = 0;
 
                     if (success_count > 0) {
                         std::cout << "Successfully hot unmounted module " << mod_id << "\n";
@@ -770,32 +922,26 @@ int main(int argc, char** argv) {
                 // Map: file path -> list of module IDs that modify it
                 std::map<std::string, std::vector<std::string>> file_map;
 
+                const auto index = module_tree_index(config.moduledir);
                 for (const auto& mod : module_list) {
+                    const uint32_t module_entry =
+                        index->child(ModuleTreeIndex::root_index, mod.id);
                     // Skip disabled modules
-                    if (fs::exists(mod.source_path / "disable"))
+                    if (index->child(module_entry, "disable") != ModuleTreeIndex::npos)
                         continue;
 
                     for (const auto& part : all_partitions) {
-                        const fs::path part_dir = mod.source_path / part;
-                        if (!fs::exists(part_dir) || !fs::is_directory(part_dir))
+                        const uint32_t part_entry = index->child(module_entry, part);
+                        if (part_entry == ModuleTreeIndex::npos || !index->is_dir(part_entry))
                             continue;
 
                         // Walk through all files in this partition
-                        try {
-                            for (auto it = fs::recursive_directory_iterator(part_dir);
-                                 it != fs::recursive_directory_iterator(); ++it) {
-                                if (fs::is_regular_file(it->status()) ||
-                                    fs::is_symlink(it->status())) {
-                                    // Get relative path from partition root
-                                    const fs::path rel = fs::relative(it->path(), part_dir);
-                                    const std::string file_key = "/" + part + "/" + rel.string();
-                                    file_map[file_key].push_back(mod.id);
-                                }
+                        index->walk(part_entry, [&](uint32_t i, const std::string& rel) {
+                            if (index->is_regular(i)) {
+                                file_map["/" + part + "/" + rel].push_back(mod.id);
                             }
-                        } catch (const fs::filesystem_error& e) {
-                            // Skip inaccessible directories
-                            continue;
-                        }
+                            return true;
+                        });
                     }
                 }
 
@@ -836,7 +982,7 @@ int main(int argc, char** argv) {
 
         case Command::HYMOFS: {
             if (cli.args.empty()) {
-                std::cerr << "Usage: hymod hymofs <enable|disable|list|version|features|"
+                std::cerr << "Usage: hymod hymofs <enable|disable|list|reconcile|version|features|"
                              "mount-hide|maps-spoof|statfs-spoof|set-mirror|maps|raw>\n";
                 return 1;
             }
@@ -901,6 +1047,12 @@ int main(int argc, char** argv) {
                     std::cout << " merge_dir";
                 if (f & HYMO_FEATURE_SELINUX_BYPASS)
                     std::cout << " selinux_bypass";
+                if (f & HYMO_FEATURE_RULE_BATCH)
+                    std::cout << " rule_batch";
+                if (f & HYMO_FEATURE_RULE_TXN)
+                    std::cout << " rule_txn";
+                if (f & HYMO_FEATURE_RULE_PAGES)
+                    std::cout << " rule_pages";
                 std::cout << "\n";
                 return 0;
             } else if (subcmd == "maps") {
@@ -961,49 +1113,60 @@ int main(int argc, char** argv) {
                     return 1;
                 }
                 return 0;
+            } else if (subcmd == "reconcile") {
+                if (!HymoFS::is_available()) {
+                    std::cerr << "HymoFS not available.\n";
+                    return 1;
+                }
+                const Config config = load_config(cli);
+                HymoFSRuleDelta delta;
+                const bool ok = HymoFS::reconcile_rules(desired_hymofs_rules(config),
+                                                        cli.dry_run, &delta);
+                if (cli.dry_run || config.verbose) {
+                    for (const auto& path : delta.remove)
+                        std::cout << "- " << path << "\n";
+                    for (const auto& rule : delta.add) {
+                        std::cout << "+ " << rule.src;
+                        if (!rule.target.empty())
+                            std::cout << " -> " << rule.target;
+                        std::cout << "\n";
+                    }
+                }
+                std::cout << (cli.dry_run ? "Would add " : "Added ") << delta.add.size()
+                          << ", delete " << delta.remove.size() << ", keep " << delta.unchanged
+                          << " rules" << (delta.full_rebuild ? " (full rebuild)" : "") << "\n";
+                if (!ok) {
+                    std::cerr << "Some rule changes failed, see the log.\n";
+                    return 1;
+                }
+                return 0;
             } else if (subcmd == "list") {
                 json::Value root = json::Value::array();
                 if (HymoFS::is_available()) {
-                    const std::string rules_str = HymoFS::get_active_rules();
-                    std::istringstream iss(rules_str);
-                    std::string line;
-                    while (std::getline(iss, line)) {
-                        if (line.empty())
-                            continue;
+                    size_t skipped = 0;
+                    size_t shown = 0;
+                    HymoFS::for_each_rule([&](const HymoFSRule& r) {
+                        if (!cli.filter.empty() && r.src.find(cli.filter) == std::string::npos &&
+                            r.target.find(cli.filter) == std::string::npos)
+                            return true;
+                        if (skipped < cli.offset) {
+                            skipped++;
+                            return true;
+                        }
 
                         json::Value rule = json::Value::object();
-                        std::istringstream ls(line);
-                        std::string type;
-                        ls >> type;
-
-                        std::string type_upper = type;
-                        std::transform(type_upper.begin(), type_upper.end(), type_upper.begin(),
-                                       ::toupper);
-
-                        rule["type"] = json::Value(type_upper);
-
-                        if (type_upper == "ADD" || type_upper == "MERGE") {
-                            std::string target;
-                            std::string source;
-                            ls >> target >> source;
-                            rule["target"] = json::Value(target);
-                            rule["source"] = json::Value(source);
-                        } else if (type_upper == "HIDE") {
-                            std::string path;  // NOLINT(misc-const-correctness) ls >> path
-                            ls >> path;
-                            rule["path"] = json::Value(path);
+                        if (r.op == HymoFSRuleOp::Hide) {
+                            rule["type"] = json::Value("HIDE");
+                            rule["path"] = json::Value(r.src);
                         } else {
-                            std::string rest;
-                            std::getline(ls, rest);
-                            if (!rest.empty()) {
-                                const size_t first = rest.find_first_not_of(' ');
-                                if (first != std::string::npos)
-                                    rest = rest.substr(first);
-                                rule["args"] = json::Value(rest);
-                            }
+                            rule["type"] =
+                                json::Value(r.op == HymoFSRuleOp::Merge ? "MERGE" : "ADD");
+                            rule["target"] = json::Value(r.src);
+                            rule["source"] = json::Value(r.target);
                         }
                         root.push_back(rule);
-                    }
+                        return cli.limit == 0 || ++shown < cli.limit;
+                    });
                 }
                 std::cout << json::dump(root, 2) << "\n";
                 return 0;
@@ -1021,31 +1184,22 @@ int main(int argc, char** argv) {
                               << (ver != HymoFS::EXPECTED_PROTOCOL_VERSION ? "true" : "false")
                               << ",\n";
 
-                    const std::string rules = HymoFS::get_active_rules();
                     std::set<std::string> active_modules;
-                    std::istringstream iss(rules);
-                    std::string line;
-                    while (std::getline(iss, line)) {
-                        size_t pos = line.find("/data/adb/modules/");
-                        if (pos != std::string::npos) {
-                            const size_t start = pos + 18;
-                            const size_t end = line.find('/', start);
-                            if (end != std::string::npos) {
-                                const std::string mod_id = line.substr(start, end - start);
-                                active_modules.insert(mod_id);
-                            }
-                        }
-
-                        pos = line.find("/dev/hymo_mirror/");
-                        if (pos != std::string::npos) {
-                            const size_t start = pos + 17;
-                            const size_t end = line.find('/', start);
-                            if (end != std::string::npos) {
-                                const std::string mod_id = line.substr(start, end - start);
-                                active_modules.insert(mod_id);
-                            }
+                    // Module id: first component below the modules dir or the mirror
+                    const std::array<std::string_view, 2> module_roots = {"/data/adb/modules/",
+                                                                          "/dev/hymo_mirror/"};
+                    HymoFS::for_each_rule([&](const HymoFSRule& rule) {
+                        for (const std::string_view root : module_roots) {
+                            const size_t pos = rule.target.find(root);
+                            if (pos == std::string::npos)
+                                continue;
+                            const size_t start = pos + root.size();
+                            const size_t end = rule.target.find('/', start);
+                            if (end != std::string::npos)
+                                active_modules.insert(rule.target.substr(start, end - start));
                         }
-                    }
+                        return true;
+                    });
 
                     std::cout << "  \"active_modules\": [";
                     bool first = true;
@@ -1147,7 +1301,7 @@ int main(int argc, char** argv) {
                 return 0;
             } else {
                 std::cerr << "Unknown hymofs subcommand: " << subcmd << "\n";
-                std::cerr << "Available: enable, disable, list, version, set-mirror, raw\n";
+                std::cerr << "Available: enable, disable, list, reconcile, version, set-mirror, raw\n";
                 return 1;
             }
         }
@@ -1196,7 +1350,8 @@ int main(int argc, char** argv) {
 
         case Command::DEBUG: {
             if (cli.args.empty()) {
-                std::cerr << "Usage: hymod debug <enable|disable|stealth|set-uname|set-cmdline|clear-cmdline>\n";
+                std::cerr << "Usage: hymod debug <enable|disable|stealth|set-uname|set-cmdline|"
+                             "clear-cmdline|bench-hymofs>\n";
                 return 1;
             }
             const std::string subcmd = cli.args[0];
@@ -1337,9 +1492,59 @@ int main(int argc, char** argv) {
                     return 1;
                 }
                 return 0;
+            } else if (subcmd == "bench-hymofs") {
+                // Planner -> rule application against the in-process simulator, so the
+                // HymoFS path can be timed without the kernel module
+                Config config = load_config(cli);
+                config.merge_with_cli(cli.moduledir, cli.tempdir, cli.mountsource, cli.verbose,
+                                      cli.partitions);
+                auto sim = std::make_shared<HymoFSSimulator>();
+                HymoFS::set_transport(sim);
+
+                std::vector<std::string> partitions = BUILTIN_PARTITIONS;
+                partitions.insert(partitions.end(), config.partitions.begin(),
+                                  config.partitions.end());
+                auto elapsed_us = [](std::chrono::steady_clock::time_point since) {
+                    return std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - since)
+                        .count();
+                };
+                auto print_stats = [&](const char* pass, long long us) {
+                    const auto total = sim->totals();
+                    std::cout << pass << ": " << us << " us, " << total.calls << " calls, "
+                              << total.bytes << " bytes, " << sim->rule_count() << " rules\n";
+                    for (const auto& [name, st] : sim->stats()) {
+                        std::cout << "  " << name << ": " << st.calls << " calls, " << st.bytes
+                                  << " bytes\n";
+                    }
+                };
+
+                auto start = std::chrono::steady_clock::now();
+                std::vector<Module> modules;
+                for (auto& mod : scan_modules(config.moduledir, config)) {
+                    if (module_has_content(mod.source_path, partitions))
+                        modules.push_back(std::move(mod));
+                }
+                MountPlan plan = generate_plan(config, modules, config.moduledir);
+                std::cout << "plan: " << elapsed_us(start) << " us, " << modules.size()
+                          << " modules\n";
+
+                start = std::chrono::steady_clock::now();
+                update_hymofs_mappings(config, modules, config.moduledir, plan);
+                print_stats("apply", elapsed_us(start));
+
+                // Same rules again: the reconcile path of a remount
+                sim->reset_stats();
+                start = std::chrono::steady_clock::now();
+                update_hymofs_mappings(config, modules, config.moduledir, plan);
+                print_stats("reapply", elapsed_us(start));
+
+                HymoFS::set_transport(nullptr);
+                return 0;
             } else {
                 std::cerr << "Unknown debug subcommand: " << subcmd << "\n";
-                std::cerr << "Available: enable, disable, stealth, set-uname, set-cmdline, clear-cmdline\n";
+                std::cerr << "Available: enable, disable, stealth, set-uname, set-cmdline, "
+                             "clear-cmdline, bench-hymofs\n";
                 return 1;
             }
         }
@@ -1703,14 +1908,7 @@ int main(int argc, char** argv) {
                 all_partitions.push_back(part);
 
             for (const auto& mod : module_list) {
-                bool has_content = false;
-                for (const auto& part : all_partitions) {
-                    if (has_files_recursive(mod.source_path / part)) {
-                        has_content = true;
-                        break;
-                    }
-                }
-                if (has_content) {
+                if (module_has_content(mod.source_path, all_partitions)) {
                     active_modules.push_back(mod);
                 } else {
                     LOG_DEBUG("Skipping empty module: " + mod.id);
@@ -1729,49 +1927,42 @@ int main(int argc, char** argv) {
             try {
                 // Handle Tmpfs -> EROFS -> Ext4 fallback
                 try {
-                    storage = setup_storage(MIRROR_DIR, img_path, config.fs_type);
+                    storage = setup_storage(MIRROR_DIR, img_path, config.fs_type, config);
                 } catch (const std::exception& e) {
                     if (config.fs_type != FilesystemType::AUTO) {
                         LOG_WARN("Specific FS check failed, falling back to auto: " +
                                  std::string(e.what()));
-                        storage = setup_storage(MIRROR_DIR, img_path, FilesystemType::AUTO);
+                        storage =
+                            setup_storage(MIRROR_DIR, img_path, FilesystemType::AUTO, config);
                     } else {
                         throw;
                     }
                 }
                 LOG_INFO("Mirror storage setup: " + storage.mode);
 
-                // EROFS is read-only: sync into a writable staging dir first, then build+mount.
-                if (storage.mode == "erofs") {
-                    const fs::path staging_dir = fs::path(BASE_DIR) / "erofs_staging";
-                    try {
-                        if (fs::exists(staging_dir)) {
-                            fs::remove_all(staging_dir);
-                        }
-                    } catch (...) {
-                        LOG_WARN("Failed to clean EROFS staging dir");
-                    }
-                    ensure_dir_exists(staging_dir);
+                // EROFS and prebuilt ext4 are read-only: sync into a writable staging dir
+                // first, then build+mount.
+                if (storage.mode == "erofs" || (storage.mode == "ext4" && config.ext4_prebuilt)) {
+                    const fs::path staging_dir = reset_staging_dir();
 
-                    LOG_INFO("Syncing " + std::to_string(module_list.size()) +
-                             " active modules to EROFS staging...");
+                    LOG_INFO("Staging " + std::to_string(module_list.size()) +
+                             " active modules for " + storage.mode + " image (hardlinks)...");
 
-                    bool sync_ok = true;
+                    // Staging lives on the same fs as the modules: link files instead of
+                    // copying them, the image builder reads every byte anyway.
+                    std::vector<SyncJob> jobs;
                     for (const auto& mod : module_list) {
-                        const fs::path src = config.moduledir / mod.id;
-                        const fs::path dst = staging_dir / mod.id;
-                        if (!sync_dir(src, dst)) {
-                            LOG_ERROR("Failed to sync module: " + mod.id);
-                            sync_ok = false;
-                        }
+                        jobs.push_back(
+                            {mod.id, config.moduledir / mod.id, staging_dir / mod.id, true});
                     }
+                    const bool sync_ok = sync_modules(jobs, config).ok();
 
                     if (!sync_ok) {
-                        LOG_ERROR("EROFS staging sync failed. Aborting mirror strategy.");
+                        LOG_ERROR("Image staging sync failed. Aborting mirror strategy.");
                         umount(MIRROR_DIR.c_str());
                     } else {
-                        storage = setup_erofs_storage(MIRROR_DIR, staging_dir,
-                                                      fs::path(BASE_DIR) / "modules.erofs");
+                        storage =
+                            setup_image_storage(storage.mode, MIRROR_DIR, staging_dir, config);
                         mirror_success = true;
                         hymofs_active = true;
 
@@ -1794,15 +1985,11 @@ int main(int argc, char** argv) {
                     LOG_INFO("Syncing " + std::to_string(module_list.size()) +
                              " active modules to mirror...");
 
-                    bool sync_ok = true;
+                    std::vector<SyncJob> jobs;
                     for (const auto& mod : module_list) {
-                        const fs::path src = config.moduledir / mod.id;
-                        const fs::path dst = MIRROR_DIR / mod.id;
-                        if (!sync_dir(src, dst)) {
-                            LOG_ERROR("Failed to sync module: " + mod.id);
-                            sync_ok = false;
-                        }
+                        jobs.push_back({mod.id, config.moduledir / mod.id, MIRROR_DIR / mod.id});
                     }
+                    const bool sync_ok = sync_modules(jobs, config).ok();
 
                     if (sync_ok) {
                         // If using ext4 image, we need to fix permissions after sync
@@ -1854,19 +2041,7 @@ int main(int argc, char** argv) {
 
                 for (const auto& mod : module_list) {
                     // Check if module has content
-                    bool has_content = false;
-                    std::vector<std::string> all_partitions = BUILTIN_PARTITIONS;
-                    for (const auto& part : config.partitions)
-                        all_partitions.push_back(part);
-
-                    for (const auto& part : all_partitions) {
-                        if (has_files_recursive(mod.source_path / part)) {
-                            has_content = true;
-                            break;
-                        }
-                    }
-
-                    if (has_content) {
+                    if (module_has_content(mod.source_path, all_partitions)) {
                         plan.magic_module_paths.push_back(mod.source_path);
                         exec_result.magic_module_ids.push_back(mod.id);
                     }
@@ -1894,29 +2069,31 @@ int main(int argc, char** argv) {
             const fs::path mnt_base(FALLBACK_CONTENT_DIR);
             const fs::path img_path = fs::path(BASE_DIR) / "modules.img";
 
-            storage = setup_storage(mnt_base, img_path, config.fs_type);
+            storage = setup_storage(mnt_base, img_path, config.fs_type, config);
 
             // **Step 2: Scan Modules**
             module_list = scan_modules(config.moduledir, config);
             LOG_INFO("Scanned " + std::to_string(module_list.size()) + " active modules.");
 
             // **Step 3: Sync Content**
-            if (storage.mode == "erofs") {
-                // EROFS is read-only: stage content first, then build+mount.
-                const fs::path staging_dir = fs::path(BASE_DIR) / "erofs_staging";
+            bool image_ready = false;
+            if (storage.mode == "erofs" || (storage.mode == "ext4" && config.ext4_prebuilt)) {
+                // Read-only images: stage content first, then build+mount.
+                const fs::path staging_dir = reset_staging_dir();
+                perform_sync(module_list, staging_dir, config, true);
                 try {
-                    if (fs::exists(staging_dir)) {
-                        fs::remove_all(staging_dir);
-                    }
-                } catch (...) {
-                    LOG_WARN("Failed to clean EROFS staging dir");
+                    storage = setup_image_storage(storage.mode, mnt_base, staging_dir, config);
+                    image_ready = true;
+                } catch (const std::exception& e) {
+                    // e.g. mke2fs without -d or a broken mkfs.erofs: sync into modules.img
+                    LOG_WARN("Image storage failed, syncing into modules.img: " +
+                             std::string(e.what()));
+                    Config rw_config = config;
+                    rw_config.ext4_prebuilt = false;
+                    storage = setup_storage(mnt_base, img_path, FilesystemType::EXT4, rw_config);
                 }
-                ensure_dir_exists(staging_dir);
-
-                perform_sync(module_list, staging_dir, config);
-                storage = setup_erofs_storage(mnt_base, staging_dir,
-                                              fs::path(BASE_DIR) / "modules.erofs");
-            } else {
+            }
+            if (!image_ready) {
                 perform_sync(module_list, storage.mount_point, config);
 
                 // **FIX 1: Fix permissions after sync**
@@ -1954,6 +2131,7 @@ int main(int argc, char** argv) {
         RuntimeState state;
         state.storage_mode = storage.mode;
         state.mount_point = storage.mount_point.string();
+        state.erofs_image = storage.erofs_image;
         state.overlay_module_ids = exec_result.overlay_module_ids;
         state.magic_module_ids = exec_result.magic_module_ids;
         state.hymofs_module_ids = plan.hymofs_module_ids;
@@ -143,6 +143,9 @@ struct hymo_spoof_cmdline {
 #define HYMO_FEATURE_MOUNT_HIDE     (1 << 6)  /* hide overlay from /proc/mounts and /proc/pid/mountinfo */
 #define HYMO_FEATURE_MAPS_SPOOF     (1 << 7)  /* spoof ino/dev/pathname in /proc/pid/maps (read buffer filter) */
 #define HYMO_FEATURE_STATFS_SPOOF   (1 << 8)  /* spoof statfs f_type so direct matches resolved (INCONSISTENT_MOUNT) */
+#define HYMO_FEATURE_RULE_BATCH     (1 << 9)  /* HYMO_IOC_ADD_RULES_BATCH */
+#define HYMO_FEATURE_RULE_TXN       (1 << 10) /* HYMO_IOC_BEGIN/COMMIT/ABORT_RULES */
+#define HYMO_FEATURE_RULE_PAGES     (1 << 11) /* HYMO_IOC_LIST_RULES_PAGED */
 
 /*
  * Maps spoof rule: when a /proc/pid/maps line has (target_ino[, target_dev]),
@@ -183,6 +186,150 @@ struct hymo_statfs_spoof_arg {
     int err;
 };
 
+/*
+ * Batched rule submission (HYMO_IOC_ADD_RULES_BATCH).
+ * buf holds `count` records packed back to back (no alignment, no NUL terminators):
+ *   struct hymo_rule_batch_rec, then src_len bytes of src, then target_len bytes of target.
+ * Paths are prefix-compressed against the previous record: src is the first src_shared
+ * bytes of the previous src followed by the record's src bytes; target likewise. Both start
+ * empty. HIDE records have no target (target_shared = target_len = 0) and leave the
+ * previous target in place for the next record.
+ * Records are applied in order. On return, applied = records applied before the first one
+ * that failed and err = its error (0 if all were applied).
+ */
+#define HYMO_BATCH_ADD   1  /* same as HYMO_IOC_ADD_RULE, type = DT_* */
+#define HYMO_BATCH_MERGE 2  /* same as HYMO_IOC_ADD_MERGE_RULE */
+#define HYMO_BATCH_HIDE  3  /* same as HYMO_IOC_HIDE_RULE */
+
+#define HYMO_RULE_BATCH_MAX_SIZE (256 * 1024)  /* max bytes of buf per ioctl */
+
+#ifdef __KERNEL__
+struct hymo_rule_batch_rec {
+    __u8 op;
+    __u8 type;
+    __u16 src_shared;
+    __u16 src_len;
+    __u16 target_shared;
+    __u16 target_len;
+} __packed;
+
+struct hymo_rule_batch_arg {
+    __u32 count;
+    __u32 size;
+    __aligned_u64 buf;
+    __u32 applied;
+    __s32 err;
+};
+#else
+struct hymo_rule_batch_rec {
+    uint8_t op;
+    uint8_t type;
+    uint16_t src_shared;
+    uint16_t src_len;
+    uint16_t target_shared;
+    uint16_t target_len;
+} __attribute__((packed));
+
+struct hymo_rule_batch_arg {
+    uint32_t count;
+    uint32_t size;
+#if defined(__GNUC__)
+    uint64_t buf __attribute__((aligned(8)));
+#else
+    uint64_t buf;
+#endif
+    uint32_t applied;
+    int32_t err;
+};
+#endif  // #ifdef __KERNEL__
+
+#if !defined(__KERNEL__) && defined(__cplusplus)
+static_assert(sizeof(struct hymo_rule_batch_rec) == 10, "hymo_rule_batch_rec ABI mismatch");
+static_assert(sizeof(struct hymo_rule_batch_arg) == 24, "hymo_rule_batch_arg ABI mismatch");
+static_assert(offsetof(struct hymo_rule_batch_arg, buf) == 8,
+              "hymo_rule_batch_arg layout mismatch");
+#endif
+
+/*
+ * Staged rule generations (HYMO_IOC_BEGIN_RULES / COMMIT_RULES / ABORT_RULES).
+ * BEGIN opens a staged generation on the calling fd: empty, or a copy of the active rule
+ * set with HYMO_TXN_COPY_ACTIVE, and returns its number in `generation`. Until COMMIT or
+ * ABORT, rule ioctls on that fd (ADD_RULE, DEL_RULE, HIDE_RULE, ADD_MERGE_RULE,
+ * ADD_RULES_BATCH, CLEAR_ALL) edit the staged generation while lookups keep using the
+ * active one. COMMIT publishes it with a single pointer swap (the old generation is freed
+ * after a grace period); ABORT, or closing the fd, drops it. Only one generation can be
+ * staged at a time (EBUSY); COMMIT/ABORT take the number BEGIN returned (ESTALE).
+ */
+#define HYMO_TXN_COPY_ACTIVE (1 << 0)
+
+#ifdef __KERNEL__
+struct hymo_rule_txn_arg {
+    __u32 flags;
+    __u32 generation;
+};
+#else
+struct hymo_rule_txn_arg {
+    uint32_t flags;
+    uint32_t generation;
+};
+#endif  // #ifdef __KERNEL__
+
+/*
+ * Paged binary rule listing (HYMO_IOC_LIST_RULES_PAGED).
+ * Pass cursor = 0 for the first page and the returned cursor for the next one; 0 is returned
+ * after the last page. Each page fills buf with as many whole records as fit in `size`:
+ *   struct hymo_rule_list_rec, then src_len bytes of src and target_len bytes of target
+ *   (no NUL terminators), padded to a multiple of 8 bytes.
+ * op is one of HYMO_BATCH_ADD / MERGE / HIDE (HIDE has no target). Rules are listed in a
+ * stable order, so a cursor stays valid while rules are added or deleted elsewhere;
+ * total is the size of the active set when the page was taken.
+ */
+#ifdef __KERNEL__
+struct hymo_rule_list_rec {
+    __u8 op;
+    __u8 type;
+    __u16 reserved;
+    __u16 src_len;
+    __u16 target_len;
+};
+
+struct hymo_rule_page_arg {
+    __aligned_u64 cursor;
+    __aligned_u64 buf;
+    __u32 size;
+    __u32 count;
+    __u32 used;
+    __u32 total;
+};
+#else
+struct hymo_rule_list_rec {
+    uint8_t op;
+    uint8_t type;
+    uint16_t reserved;
+    uint16_t src_len;
+    uint16_t target_len;
+};
+
+struct hymo_rule_page_arg {
+#if defined(__GNUC__)
+    uint64_t cursor __attribute__((aligned(8)));
+    uint64_t buf __attribute__((aligned(8)));
+#else
+    uint64_t cursor;
+    uint64_t buf;
+#endif
+    uint32_t size;   /* in: bytes available in buf */
+    uint32_t count;  /* out: records written */
+    uint32_t used;   /* out: bytes written */
+    uint32_t total;  /* out: rules in the active set */
+};
+#endif  // #ifdef __KERNEL__
+
+#if !defined(__KERNEL__) && defined(__cplusplus)
+static_assert(sizeof(struct hymo_rule_list_rec) == 8, "hymo_rule_list_rec ABI mismatch");
+static_assert(sizeof(struct hymo_rule_page_arg) == 32, "hymo_rule_page_arg ABI mismatch");
+#endif
+
 // ioctl definitions (for fd-based mode)
 // Must be after struct definitions
 #define HYMO_IOC_MAGIC 'H'
@@ -211,5 +358,10 @@ struct hymo_statfs_spoof_arg {
 #define HYMO_IOC_SET_MOUNT_HIDE      _IOW(HYMO_IOC_MAGIC, 25, struct hymo_mount_hide_arg)
 #define HYMO_IOC_SET_MAPS_SPOOF      _IOW(HYMO_IOC_MAGIC, 26, struct hymo_maps_spoof_arg)
 #define HYMO_IOC_SET_STATFS_SPOOF    _IOW(HYMO_IOC_MAGIC, 27, struct hymo_statfs_spoof_arg)
+#define HYMO_IOC_ADD_RULES_BATCH     _IOWR(HYMO_IOC_MAGIC, 28, struct hymo_rule_batch_arg)
+#define HYMO_IOC_BEGIN_RULES         _IOWR(HYMO_IOC_MAGIC, 29, struct hymo_rule_txn_arg)
+#define HYMO_IOC_COMMIT_RULES        _IOW(HYMO_IOC_MAGIC, 30, struct hymo_rule_txn_arg)
+#define HYMO_IOC_ABORT_RULES         _IOW(HYMO_IOC_MAGIC, 31, struct hymo_rule_txn_arg)
+#define HYMO_IOC_LIST_RULES_PAGED    _IOWR(HYMO_IOC_MAGIC, 32, struct hymo_rule_page_arg)
 
 #endif /* _LINUX_HYMO_MAGIC_H */
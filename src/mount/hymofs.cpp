@@ -1,15 +1,22 @@
 #include "hymofs.hpp"
+#include <dirent.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cerrno>
 #include <chrono>
+#include <climits>
 #include <cstring>
 #include <fstream>
+#include <functional>
+#include <sstream>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include "../utils.hpp"
 #include "hymo_magic.h"
 
@@ -17,67 +24,104 @@ namespace hymo {
 
 static HymoFSStatus s_cached_status = HymoFSStatus::NotPresent;
 static bool s_status_checked = false;
-static int s_hymo_fd = -1;  // Cached anonymous fd
-
-// Fast check: if lsmod/proc/modules doesn't show hymofs_lkm, it's not loaded.
-// Avoids slow retry loop in get_anon_fd() when module is absent.
-static bool lkm_in_proc_modules() {
-    std::ifstream f("/proc/modules");
-    if (!f)
+static int s_features = -2;  // Cached get_features(), -2 until queried
+
+// Rule generation opened by begin_rules(): staged in the kernel, or applied directly
+enum class RuleTxn { None, Staged, Direct };
+static RuleTxn s_rule_txn = RuleTxn::None;
+static uint32_t s_rule_txn_generation = 0;
+
+namespace {
+
+class KernelTransport : public HymoFSTransport {
+public:
+    ~KernelTransport() override { release(); }
+
+    // Fast check: if lsmod/proc/modules doesn't show hymofs_lkm, it's not loaded.
+    // Avoids slow retry loop in get_anon_fd() when module is absent.
+    bool present() override {
+        std::ifstream f("/proc/modules");
+        if (!f)
+            return false;
+        std::string line;
+        while (std::getline(f, line)) {
+            if (line.compare(0, 11, "hymofs_lkm ") == 0 ||
+                line.compare(0, 11, "hymofs_lkm\t") == 0) {
+                return true;
+            }
+        }
         return false;
-    std::string line;
-    while (std::getline(f, line)) {
-        if (line.compare(0, 11, "hymofs_lkm ") == 0 ||
-            line.compare(0, 11, "hymofs_lkm\t") == 0) {
-            return true;
+    }
+
+    int ioctl(unsigned int cmd, void* arg) override {
+        const int fd = get_anon_fd();
+        if (fd < 0) {
+            errno = ENODEV;
+            return -1;
         }
+        return ::ioctl(fd, cmd, arg);
     }
-    return false;
-}
 
-// Get anonymous fd from kernel (only way to communicate with HymoFS)
-static int get_anon_fd() {
-    if (s_hymo_fd >= 0) {
-        return s_hymo_fd;
+    void release() override {
+        if (hymo_fd_ >= 0) {
+            close(hymo_fd_);
+            hymo_fd_ = -1;
+        }
     }
 
-    // Prefer prctl (SECCOMP-safe); fallback to SYS_reboot. Retry with backoff if LKM loads after
-    // us.
-    int fd = -1;
-    const int kWaitAttempts = 4;  // ~0 + 1s + 2s + 3s
-    const int kShortRetries = 2;
-    for (int wait = 0; wait < kWaitAttempts && fd < 0; ++wait) {
-        if (wait > 0) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+private:
+    // Get anonymous fd from kernel (only way to communicate with HymoFS)
+    int get_anon_fd() {
+        if (hymo_fd_ >= 0) {
+            return hymo_fd_;
         }
-        prctl(HYMO_PRCTL_GET_FD, reinterpret_cast<unsigned long>(&fd), 0, 0, 0);
-        if (fd < 0) {
-            for (int attempt = 0; attempt < kShortRetries && fd < 0; ++attempt) {
-                if (attempt > 0) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+
+        // Prefer prctl (SECCOMP-safe); fallback to SYS_reboot. Retry with backoff if LKM loads
+        // after us.
+        int fd = -1;
+        const int kWaitAttempts = 4;  // ~0 + 1s + 2s + 3s
+        const int kShortRetries = 2;
+        for (int wait = 0; wait < kWaitAttempts && fd < 0; ++wait) {
+            if (wait > 0) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+            prctl(HYMO_PRCTL_GET_FD, reinterpret_cast<unsigned long>(&fd), 0, 0, 0);
+            if (fd < 0) {
+                for (int attempt = 0; attempt < kShortRetries && fd < 0; ++attempt) {
+                    if (attempt > 0) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(80));
+                    }
+                    syscall(SYS_reboot, HYMO_MAGIC1, HYMO_MAGIC2, HYMO_CMD_GET_FD, &fd);
                 }
-                syscall(SYS_reboot, HYMO_MAGIC1, HYMO_MAGIC2, HYMO_CMD_GET_FD, &fd);
             }
         }
+        if (fd < 0) {
+            LOG_ERROR("Failed to get HymoFS anonymous fd (fd=" + std::to_string(fd) + ")");
+            return -1;
+        }
+
+        hymo_fd_ = fd;
+        LOG_VERBOSE("HymoFS: Got fd " + std::to_string(fd));
+        return fd;
     }
-    if (fd < 0) {
-        LOG_ERROR("Failed to get HymoFS anonymous fd (fd=" + std::to_string(fd) + ")");
-        return -1;
-    }
 
-    s_hymo_fd = fd;
-    LOG_VERBOSE("HymoFS: Got fd " + std::to_string(fd));
-    return fd;
+    int hymo_fd_ = -1;  // Cached anonymous fd
+};
+
+}  // namespace
+
+std::shared_ptr<HymoFSTransport> make_kernel_transport() {
+    return std::make_shared<KernelTransport>();
 }
 
-// Execute command via anonymous fd ioctl (only method)
-static int hymo_execute_cmd(unsigned int ioctl_cmd, void* arg) {
-    int fd = get_anon_fd();
-    if (fd < 0) {
-        return -1;
-    }
+static std::shared_ptr<HymoFSTransport>& transport() {
+    static std::shared_ptr<HymoFSTransport> s_transport = make_kernel_transport();
+    return s_transport;
+}
 
-    int ret = ioctl(fd, ioctl_cmd, arg);
+// Execute command through the transport, logging failures
+static int hymo_execute_cmd(unsigned int ioctl_cmd, void* arg) {
+    int ret = transport()->ioctl(ioctl_cmd, arg);
     if (ret < 0) {
         if (errno == EOPNOTSUPP) {
             LOG_VERBOSE("HymoFS ioctl not supported: " + std::string(strerror(errno)));
@@ -93,7 +137,7 @@ static bool hymo_execute_kstat_cmd(unsigned int ioctl_cmd, const char* op_name,
     struct hymo_spoof_kstat rule = input;
     rule.target_pathname[HYMO_MAX_LEN_PATHNAME - 1] = '\0';
 
-    LOG_VERBOSE("HymoFS: " + std::string(op_name) + " path=" + std::string(rule.target_pathname));
+    LOG_VERBOSEF("HymoFS: {} path={}", op_name, rule.target_pathname);
     const int ret = hymo_execute_cmd(ioctl_cmd, &rule);
     if (ret != 0) {
         LOG_ERROR("HymoFS: " + std::string(op_name) + " failed: " + std::string(strerror(errno)));
@@ -108,13 +152,8 @@ static bool hymo_execute_kstat_cmd(unsigned int ioctl_cmd, const char* op_name,
 }
 
 int HymoFS::get_protocol_version() {
-    int fd = get_anon_fd();
-    if (fd < 0) {
-        return -1;
-    }
-
     int version = 0;
-    if (ioctl(fd, HYMO_IOC_GET_VERSION, &version) == 0) {
+    if (transport()->ioctl(HYMO_IOC_GET_VERSION, &version) == 0) {
         return version;
     }
 
@@ -128,7 +167,7 @@ HymoFSStatus HymoFS::check_status() {
     }
 
     // Fast path: lsmod/proc/modules doesn't show hymofs_lkm → not loaded, skip slow retries
-    if (!lkm_in_proc_modules()) {
+    if (!transport()->present()) {
         s_cached_status = HymoFSStatus::NotPresent;
         s_status_checked = true;
         return HymoFSStatus::NotPresent;
@@ -181,8 +220,7 @@ bool HymoFS::clear_rules() {
 bool HymoFS::add_rule(const std::string& src, const std::string& target, int type) {
     struct hymo_syscall_arg arg = {.src = src.c_str(), .target = target.c_str(), .type = type};
 
-    LOG_INFO("HymoFS: Adding rule src=" + src + ", target=" + target +
-             ", type=" + std::to_string(type));
+    LOG_VERBOSEF("HymoFS: Adding rule src={}, target={}, type={}", src, target, type);
     bool ret = hymo_execute_cmd(HYMO_IOC_ADD_RULE, &arg) == 0;
     if (!ret) {
         LOG_ERROR("HymoFS: add_rule failed: " + std::string(strerror(errno)));
@@ -193,7 +231,7 @@ bool HymoFS::add_rule(const std::string& src, const std::string& target, int typ
 bool HymoFS::add_merge_rule(const std::string& src, const std::string& target) {
     struct hymo_syscall_arg arg = {.src = src.c_str(), .target = target.c_str(), .type = 0};
 
-    LOG_INFO("HymoFS: Adding merge rule src=" + src + ", target=" + target);
+    LOG_VERBOSEF("HymoFS: Adding merge rule src={}, target={}", src, target);
     bool ret = hymo_execute_cmd(HYMO_IOC_ADD_MERGE_RULE, &arg) == 0;
     if (!ret) {
         LOG_ERROR("HymoFS: add_merge_rule failed: " + std::string(strerror(errno)));
@@ -204,7 +242,7 @@ bool HymoFS::add_merge_rule(const std::string& src, const std::string& target) {
 bool HymoFS::delete_rule(const std::string& src) {
     struct hymo_syscall_arg arg = {.src = src.c_str(), .target = NULL, .type = 0};
 
-    LOG_INFO("HymoFS: Deleting rule src=" + src);
+    LOG_VERBOSEF("HymoFS: Deleting rule src={}", src);
     bool ret = hymo_execute_cmd(HYMO_IOC_DEL_RULE, &arg) == 0;
     if (!ret) {
         LOG_ERROR("HymoFS: delete_rule failed: " + std::string(strerror(errno)));
@@ -226,7 +264,7 @@ bool HymoFS::set_mirror_path(const std::string& path) {
 bool HymoFS::hide_path(const std::string& path) {
     struct hymo_syscall_arg arg = {.src = path.c_str(), .target = NULL, .type = 0};
 
-    LOG_INFO("HymoFS: Hiding path=" + path);
+    LOG_VERBOSEF("HymoFS: Hiding path={}", path);
     bool ret = hymo_execute_cmd(HYMO_IOC_HIDE_RULE, &arg) == 0;
     if (!ret) {
         LOG_ERROR("HymoFS: hide_path failed: " + std::string(strerror(errno)));
@@ -234,10 +272,224 @@ bool HymoFS::hide_path(const std::string& path) {
     return ret;
 }
 
+static bool apply_rule(const HymoFSRule& rule) {
+    switch (rule.op) {
+    case HymoFSRuleOp::Add:
+        return HymoFS::add_rule(rule.src, rule.target, rule.type);
+    case HymoFSRuleOp::Merge:
+        return HymoFS::add_merge_rule(rule.src, rule.target);
+    case HymoFSRuleOp::Hide:
+        return HymoFS::hide_path(rule.src);
+    }
+    return false;
+}
+
+static size_t apply_rules_one_by_one(const std::vector<HymoFSRule>& rules, size_t first) {
+    size_t failed = 0;
+    for (size_t i = first; i < rules.size(); ++i) {
+        if (!apply_rule(rules[i])) {
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+static bool has_feature(int feature) {
+    if (s_features == -2) {
+        s_features = HymoFS::get_features();
+    }
+    return s_features >= 0 && (s_features & feature);
+}
+
+static size_t shared_prefix(const std::string& a, const std::string& b) {
+    const size_t n = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) {
+        ++i;
+    }
+    return i;
+}
+
+// Records are packed unaligned with no terminators, see HYMO_IOC_ADD_RULES_BATCH
+static void pack_rule(std::string& buf, const HymoFSRule& rule, size_t src_shared,
+                      size_t target_shared) {
+    const bool has_target = rule.op != HymoFSRuleOp::Hide;
+    struct hymo_rule_batch_rec rec = {};
+    rec.op = static_cast<uint8_t>(rule.op);
+    rec.type = static_cast<uint8_t>(rule.type);
+    rec.src_shared = static_cast<uint16_t>(src_shared);
+    rec.src_len = static_cast<uint16_t>(rule.src.size() - src_shared);
+    if (has_target) {
+        rec.target_shared = static_cast<uint16_t>(target_shared);
+        rec.target_len = static_cast<uint16_t>(rule.target.size() - target_shared);
+    }
+    buf.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    buf.append(rule.src, src_shared, std::string::npos);
+    if (has_target) {
+        buf.append(rule.target, target_shared, std::string::npos);
+    }
+}
+
+bool HymoFS::add_rules_batch(const std::vector<HymoFSRule>& rules) {
+    if (rules.empty()) {
+        return true;
+    }
+    if (!has_feature(HYMO_FEATURE_RULE_BATCH)) {
+        const size_t failed = apply_rules_one_by_one(rules, 0);
+        LOG_INFO("HymoFS: Added " + std::to_string(rules.size() - failed) + "/" +
+                 std::to_string(rules.size()) + " rules one by one");
+        return failed == 0;
+    }
+
+    std::string buf;
+    buf.reserve(HYMO_RULE_BATCH_MAX_SIZE);
+    size_t next = 0;
+    size_t failed = 0;
+    size_t ioctls = 0;
+    size_t bytes = 0;
+    while (next < rules.size()) {
+        // Pack as many records as fit, prefix-compressed against the previous one
+        buf.clear();
+        const std::string* prev_src = nullptr;
+        const std::string* prev_target = nullptr;
+        size_t end = next;
+        for (; end < rules.size(); ++end) {
+            const HymoFSRule& rule = rules[end];
+            if (rule.src.size() >= PATH_MAX || rule.target.size() >= PATH_MAX) {
+                break;
+            }
+            const bool has_target = rule.op != HymoFSRuleOp::Hide;
+            const size_t src_shared = prev_src ? shared_prefix(*prev_src, rule.src) : 0;
+            const size_t target_shared =
+                has_target && prev_target ? shared_prefix(*prev_target, rule.target) : 0;
+            const size_t rec_size = sizeof(hymo_rule_batch_rec) + rule.src.size() -
+                                    src_shared +
+                                    (has_target ? rule.target.size() - target_shared : 0);
+            if (buf.size() + rec_size > HYMO_RULE_BATCH_MAX_SIZE) {
+                break;
+            }
+            pack_rule(buf, rule, src_shared, target_shared);
+            prev_src = &rule.src;
+            if (has_target) {
+                prev_target = &rule.target;
+            }
+        }
+        if (end == next) {
+            // Path too long to pack; let the kernel reject it the usual way
+            if (!apply_rule(rules[next])) {
+                ++failed;
+            }
+            ++next;
+            continue;
+        }
+
+        struct hymo_rule_batch_arg arg = {};
+        arg.count = static_cast<uint32_t>(end - next);
+        arg.size = static_cast<uint32_t>(buf.size());
+        arg.buf = static_cast<decltype(arg.buf)>(reinterpret_cast<std::uintptr_t>(buf.data()));
+        if (transport()->ioctl(HYMO_IOC_ADD_RULES_BATCH, &arg) != 0) {
+            if (errno == ENOTTY || errno == EINVAL || errno == EOPNOTSUPP) {
+                LOG_WARN("HymoFS: Batched rules not supported (" + std::string(strerror(errno)) +
+                         "), adding one by one");
+                s_features &= ~HYMO_FEATURE_RULE_BATCH;
+            } else {
+                LOG_ERROR("HymoFS: add_rules_batch failed: " + std::string(strerror(errno)) +
+                          ", adding the rest one by one");
+            }
+            failed += apply_rules_one_by_one(rules, next);
+            next = rules.size();
+            break;
+        }
+        ++ioctls;
+        bytes += buf.size();
+
+        if (arg.err != 0 && arg.applied < arg.count) {
+            const HymoFSRule& rule = rules[next + arg.applied];
+            LOG_ERROR("HymoFS: Batched rule " + rule.src +
+                      " failed, kernel err=" + std::to_string(arg.err));
+            ++failed;
+            next += arg.applied + 1;
+        } else {
+            next = end;
+        }
+    }
+
+    LOG_INFO("HymoFS: Added " + std::to_string(rules.size() - failed) + "/" +
+             std::to_string(rules.size()) + " rules in " + std::to_string(ioctls) +
+             " batch ioctl(s), " + std::to_string(bytes) + " bytes");
+    return failed == 0;
+}
+
+bool HymoFS::begin_rules(bool copy_active) {
+    if (s_rule_txn != RuleTxn::None) {
+        LOG_ERROR("HymoFS: begin_rules: a rule generation is already open");
+        return false;
+    }
+
+    if (has_feature(HYMO_FEATURE_RULE_TXN)) {
+        struct hymo_rule_txn_arg arg = {};
+        arg.flags = copy_active ? HYMO_TXN_COPY_ACTIVE : 0;
+        if (hymo_execute_cmd(HYMO_IOC_BEGIN_RULES, &arg) == 0) {
+            s_rule_txn = RuleTxn::Staged;
+            s_rule_txn_generation = arg.generation;
+            LOG_VERBOSE("HymoFS: Staging rule generation " + std::to_string(arg.generation) +
+                        (copy_active ? " (copy of active rules)" : ""));
+            return true;
+        }
+        LOG_WARN("HymoFS: begin_rules failed: " + std::string(strerror(errno)) +
+                 ", applying rules directly");
+    }
+
+    // No staging: edit the active rule set in place
+    s_rule_txn = RuleTxn::Direct;
+    if (!copy_active && !clear_rules()) {
+        s_rule_txn = RuleTxn::None;
+        return false;
+    }
+    return true;
+}
+
+bool HymoFS::commit_rules() {
+    const RuleTxn txn = s_rule_txn;
+    s_rule_txn = RuleTxn::None;
+    if (txn != RuleTxn::Staged) {
+        return txn == RuleTxn::Direct;
+    }
+
+    struct hymo_rule_txn_arg arg = {};
+    arg.generation = s_rule_txn_generation;
+    if (hymo_execute_cmd(HYMO_IOC_COMMIT_RULES, &arg) != 0) {
+        LOG_ERROR("HymoFS: commit_rules failed: " + std::string(strerror(errno)) +
+                  ", previous rules stay active");
+        hymo_execute_cmd(HYMO_IOC_ABORT_RULES, &arg);
+        return false;
+    }
+    LOG_INFO("HymoFS: Committed rule generation " + std::to_string(arg.generation));
+    return true;
+}
+
+void HymoFS::abort_rules() {
+    const RuleTxn txn = s_rule_txn;
+    s_rule_txn = RuleTxn::None;
+    if (txn == RuleTxn::Direct) {
+        LOG_WARN("HymoFS: Rules were applied directly and cannot be rolled back");
+    } else if (txn == RuleTxn::Staged) {
+        struct hymo_rule_txn_arg arg = {};
+        arg.generation = s_rule_txn_generation;
+        hymo_execute_cmd(HYMO_IOC_ABORT_RULES, &arg);
+        LOG_WARN("HymoFS: Aborted rule generation " + std::to_string(arg.generation));
+    }
+}
+
+bool HymoFS::rules_staged() {
+    return s_rule_txn == RuleTxn::Staged;
+}
+
 bool HymoFS::add_rules_from_directory(const fs::path& target_base, const fs::path& module_dir) {
     if (!fs::exists(module_dir) || !fs::is_directory(module_dir))
         return false;
 
+    std::vector<HymoFSRule> rules;
     try {
         for (const auto& entry : fs::recursive_directory_iterator(module_dir)) {
             const fs::path& current_path = entry.path();
@@ -247,12 +499,13 @@ bool HymoFS::add_rules_from_directory(const fs::path& target_base, const fs::pat
             fs::path target_path = target_base / rel_path;
 
             if (entry.is_regular_file() || entry.is_symlink()) {
-                add_rule(target_path.string(), current_path.string());
+                rules.push_back(
+                    {HymoFSRuleOp::Add, target_path.string(), current_path.string(), 0});
             } else if (entry.is_character_file()) {
                 // Redirection for whiteout (0:0)
                 struct stat st;
                 if (stat(current_path.c_str(), &st) == 0 && st.st_rdev == 0) {
-                    hide_path(target_path.string());
+                    rules.push_back({HymoFSRuleOp::Hide, target_path.string(), "", 0});
                 }
             }
         }
@@ -260,6 +513,7 @@ bool HymoFS::add_rules_from_directory(const fs::path& target_base, const fs::pat
         LOG_WARN("HymoFS rule generation error for " + module_dir.string() + ": " + e.what());
         return false;
     }
+    add_rules_batch(rules);
     return true;
 }
 
@@ -293,30 +547,259 @@ bool HymoFS::remove_rules_from_directory(const fs::path& target_base, const fs::
     return true;
 }
 
-std::string HymoFS::get_active_rules() {
-    size_t buf_size = 16 * 1024;  // 16KB buffer
-    char* raw_buf = (char*)malloc(buf_size);
-    if (!raw_buf) {
-        return "Error: Out of memory\n";
+// Text listing of kernels without HYMO_FEATURE_RULE_PAGES. The kernel fills at most
+// size - 1 bytes; retry with a larger buffer until the listing fits.
+static bool read_rule_listing(std::string& result) {
+    constexpr size_t kMaxListing = 64 * 1024 * 1024;
+    std::vector<char> buf(16 * 1024);  // 16KB buffer
+    while (true) {
+        std::fill(buf.begin(), buf.end(), '\0');
+        struct hymo_syscall_list_arg arg = {.buf = buf.data(), .size = buf.size()};
+        if (hymo_execute_cmd(HYMO_IOC_LIST_RULES, &arg) < 0) {
+            return false;
+        }
+        const size_t len = strnlen(buf.data(), buf.size());
+        if (len < buf.size() - 1 || buf.size() >= kMaxListing) {
+            result.assign(buf.data(), len);
+            return true;
+        }
+        buf.resize(buf.size() * 2);
     }
-    memset(raw_buf, 0, buf_size);
+}
 
-    struct hymo_syscall_list_arg arg = {.buf = raw_buf, .size = buf_size};
+// "add <path> <source> [type]", "merge <path> <source>" or "hide <path>"; other entries of
+// the text listing are not rules
+static bool parse_rule_line(const std::string& line, HymoFSRule& rule) {
+    std::istringstream ls(line);
+    std::string kind;
+    if (!(ls >> kind >> rule.src)) {
+        return false;
+    }
+    std::transform(kind.begin(), kind.end(), kind.begin(), ::tolower);
+    if (kind == "add") {
+        rule.op = HymoFSRuleOp::Add;
+        if (!(ls >> rule.target)) {
+            return false;
+        }
+        if (!(ls >> rule.type)) {
+            rule.type = 0;
+        }
+    } else if (kind == "merge") {
+        rule.op = HymoFSRuleOp::Merge;
+        rule.type = DT_DIR;
+        return static_cast<bool>(ls >> rule.target);
+    } else if (kind == "hide") {
+        rule.op = HymoFSRuleOp::Hide;
+    } else {
+        return false;
+    }
+    return true;
+}
 
-    int ret = hymo_execute_cmd(HYMO_IOC_LIST_RULES, &arg);
-    if (ret < 0) {
-        std::string err = "Error: command failed: ";
-        err += strerror(errno);
-        err += "\n";
-        LOG_ERROR("HymoFS: get_active_rules failed: " + std::string(strerror(errno)));
-        free(raw_buf);
-        return err;
+static bool for_each_listed_rule(const std::function<bool(const HymoFSRule&)>& visit) {
+    std::string listing;
+    if (!read_rule_listing(listing)) {
+        LOG_ERROR("HymoFS: Listing rules failed: " + std::string(strerror(errno)));
+        return false;
     }
+    std::istringstream iss(listing);
+    std::string line;
+    while (std::getline(iss, line)) {
+        HymoFSRule rule;
+        if (parse_rule_line(line, rule) && !visit(rule)) {
+            break;
+        }
+    }
+    return true;
+}
 
-    std::string result(raw_buf);
+// Records of one HYMO_IOC_LIST_RULES_PAGED page; false if the page is malformed or `visit`
+// asked to stop (`stopped` tells which)
+static bool visit_rule_page(const uint8_t* page, const hymo_rule_page_arg& arg,
+                            const std::function<bool(const HymoFSRule&)>& visit, bool& stopped) {
+    size_t off = 0;
+    for (uint32_t i = 0; i < arg.count; ++i) {
+        struct hymo_rule_list_rec rec;
+        if (off + sizeof(rec) > arg.used) {
+            return false;
+        }
+        memcpy(&rec, page + off, sizeof(rec));
+        const size_t len = sizeof(rec) + rec.src_len + rec.target_len;
+        if (off + len > arg.used || rec.op < HYMO_BATCH_ADD || rec.op > HYMO_BATCH_HIDE) {
+            return false;
+        }
+        HymoFSRule rule;
+        rule.op = static_cast<HymoFSRuleOp>(rec.op);
+        rule.type = rec.type;
+        const char* paths = reinterpret_cast<const char*>(page + off + sizeof(rec));
+        rule.src.assign(paths, rec.src_len);
+        rule.target.assign(paths + rec.src_len, rec.target_len);
+        if (!visit(rule)) {
+            stopped = true;
+            return false;
+        }
+        off += (len + 7) & ~static_cast<size_t>(7);
+    }
+    return true;
+}
 
-    free(raw_buf);
-    return result;
+bool HymoFS::for_each_rule(const std::function<bool(const HymoFSRule&)>& visit) {
+    if (!has_feature(HYMO_FEATURE_RULE_PAGES)) {
+        return for_each_listed_rule(visit);
+    }
+    std::vector<uint64_t> page(64 * 1024 / sizeof(uint64_t));  // 8-byte aligned records
+    uint8_t* const page_data = reinterpret_cast<uint8_t*>(page.data());
+    uint64_t cursor = 0;
+    size_t pages = 0;
+    do {
+        struct hymo_rule_page_arg arg = {};
+        arg.cursor = cursor;
+        arg.buf = static_cast<decltype(arg.buf)>(reinterpret_cast<std::uintptr_t>(page_data));
+        arg.size = static_cast<uint32_t>(page.size() * sizeof(uint64_t));
+        if (transport()->ioctl(HYMO_IOC_LIST_RULES_PAGED, &arg) != 0) {
+            if (pages == 0 && (errno == ENOTTY || errno == EINVAL || errno == EOPNOTSUPP)) {
+                LOG_WARN("HymoFS: Paged rule listing not supported (" +
+                         std::string(strerror(errno)) + "), using the text listing");
+                s_features &= ~HYMO_FEATURE_RULE_PAGES;
+                return for_each_listed_rule(visit);
+            }
+            LOG_ERROR("HymoFS: Listing rules failed: " + std::string(strerror(errno)));
+            return false;
+        }
+        ++pages;
+        if (arg.used > arg.size) {
+            LOG_ERROR("HymoFS: Malformed rule page");
+            return false;
+        }
+
+        bool stopped = false;
+        if (!visit_rule_page(page_data, arg, visit, stopped)) {
+            if (stopped) {
+                return true;
+            }
+            LOG_ERROR("HymoFS: Malformed rule page");
+            return false;
+        }
+        if (arg.count == 0 && arg.cursor != 0 && arg.cursor == cursor) {
+            LOG_ERROR("HymoFS: Rule listing made no progress");
+            return false;
+        }
+        cursor = arg.cursor;
+    } while (cursor != 0);
+
+    LOG_VERBOSE("HymoFS: Listed rules in " + std::to_string(pages) + " page(s)");
+    return true;
+}
+
+bool HymoFS::list_rules(std::vector<HymoFSRule>& rules) {
+    return for_each_rule([&](const HymoFSRule& rule) {
+        rules.push_back(rule);
+        return true;
+    });
+}
+
+// Type is only compared when both sides know it; the listing may not include it
+static bool same_rule(const HymoFSRule& a, const HymoFSRule& b) {
+    return a.op == b.op && a.target == b.target &&
+           (a.op != HymoFSRuleOp::Add || a.type == 0 || b.type == 0 || a.type == b.type);
+}
+
+// Rules grouped by path in first-seen order, as the kernel ends up holding them: a later
+// add replaces an earlier one (module overrides), every module's merge of a directory is
+// kept, exact duplicates are dropped
+static std::unordered_map<std::string, std::vector<const HymoFSRule*>> group_rules(
+    const std::vector<HymoFSRule>& rules) {
+    std::unordered_map<std::string, std::vector<const HymoFSRule*>> groups;
+    groups.reserve(rules.size());
+    for (const auto& rule : rules) {
+        auto& group = groups[rule.src];
+        auto it = std::find_if(group.begin(), group.end(), [&](const HymoFSRule* r) {
+            return rule.op == HymoFSRuleOp::Merge ? same_rule(*r, rule) : r->op == rule.op;
+        });
+        if (it == group.end()) {
+            group.push_back(&rule);
+        } else if (rule.op == HymoFSRuleOp::Add) {
+            *it = &rule;
+        }
+    }
+    return groups;
+}
+
+HymoFSRuleDelta HymoFS::diff_rules(const std::vector<HymoFSRule>& active,
+                                   const std::vector<HymoFSRule>& desired) {
+    HymoFSRuleDelta delta;
+    const auto active_groups = group_rules(active);
+    const auto desired_groups = group_rules(desired);
+
+    std::unordered_set<std::string> changed;
+    for (const auto& [path, want] : desired_groups) {
+        auto it = active_groups.find(path);
+        if (it != active_groups.end()) {
+            const auto& have = it->second;
+            const bool same = have.size() == want.size() &&
+                              std::all_of(want.begin(), want.end(), [&](const HymoFSRule* w) {
+                                  return std::any_of(have.begin(), have.end(),
+                                                     [&](const HymoFSRule* h) {
+                                                         return same_rule(*h, *w);
+                                                     });
+                              });
+            if (same) {
+                delta.unchanged += want.size();
+                continue;
+            }
+            delta.remove.push_back(path);
+        }
+        changed.insert(path);
+    }
+    for (const auto& [path, have] : active_groups) {
+        if (desired_groups.find(path) == desired_groups.end()) {
+            delta.remove.push_back(path);
+        }
+    }
+    std::sort(delta.remove.begin(), delta.remove.end());
+
+    // Keep the caller's order (adds before hides), once per rule
+    for (const auto& rule : desired) {
+        if (changed.count(rule.src) == 0) {
+            continue;
+        }
+        const auto& want = desired_groups.at(rule.src);
+        if (std::find(want.begin(), want.end(), &rule) != want.end()) {
+            delta.add.push_back(rule);
+        }
+    }
+    return delta;
+}
+
+bool HymoFS::reconcile_rules(const std::vector<HymoFSRule>& desired, bool dry_run,
+                             HymoFSRuleDelta* delta_out) {
+    std::vector<HymoFSRule> active;
+    HymoFSRuleDelta delta;
+    if (list_rules(active)) {
+        delta = diff_rules(active, desired);
+    } else {
+        delta = diff_rules({}, desired);
+        delta.full_rebuild = true;
+    }
+    LOG_INFO("HymoFS: Reconcile: " + std::to_string(delta.add.size()) + " to add, " +
+             std::to_string(delta.remove.size()) + " to delete, " +
+             std::to_string(delta.unchanged) + " unchanged" +
+             (delta.full_rebuild ? " (full rebuild)" : ""));
+
+    bool ok = true;
+    if (!dry_run && (delta.full_rebuild || !delta.add.empty() || !delta.remove.empty())) {
+        HymoFSRuleTransaction txn(!delta.full_rebuild);
+        for (const auto& path : delta.remove) {
+            ok = delete_rule(path) && ok;
+        }
+        ok = add_rules_batch(delta.add) && ok;
+        ok = txn.commit() && ok;
+    }
+
+    if (delta_out) {
+        *delta_out = std::move(delta);
+    }
+    return ok;
 }
 
 std::string HymoFS::get_hooks() {
@@ -479,12 +962,8 @@ bool HymoFS::hide_overlay_xattrs(const std::string& path) {
 }
 
 int HymoFS::get_features() {
-    int fd = get_anon_fd();
-    if (fd < 0) {
-        return -1;
-    }
     int features = 0;
-    if (ioctl(fd, HYMO_IOC_GET_FEATURES, &features) != 0) {
+    if (transport()->ioctl(HYMO_IOC_GET_FEATURES, &features) != 0) {
         LOG_VERBOSE("HymoFS: get_features failed: " + std::string(strerror(errno)));
         return -1;
     }
@@ -558,16 +1037,21 @@ bool HymoFS::clear_maps_rules() {
 }
 
 void HymoFS::release_connection() {
-    if (s_hymo_fd >= 0) {
-        close(s_hymo_fd);
-        s_hymo_fd = -1;
-    }
+    transport()->release();
     s_status_checked = false;
     s_cached_status = HymoFSStatus::NotPresent;
+    s_features = -2;
+    s_rule_txn = RuleTxn::None;
+}
+
+void HymoFS::set_transport(std::shared_ptr<HymoFSTransport> backend) {
+    release_connection();
+    transport() = backend ? std::move(backend) : make_kernel_transport();
 }
 
 void HymoFS::invalidate_status_cache() {
     s_status_checked = false;
+    s_features = -2;
 }
 
 }  // namespace hymo
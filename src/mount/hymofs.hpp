@@ -2,10 +2,13 @@
 
 #include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include "defs.hpp"
 #include "hymo_magic.h"
+#include "hymofs_transport.hpp"
 
 namespace fs = std::filesystem;
 
@@ -13,6 +16,28 @@ namespace hymo {
 
 enum class HymoFSStatus { Available, NotPresent, KernelTooOld, ModuleTooOld };
 
+enum class HymoFSRuleOp : std::uint8_t {
+    Add = HYMO_BATCH_ADD,
+    Merge = HYMO_BATCH_MERGE,
+    Hide = HYMO_BATCH_HIDE,
+};
+
+// One add_rule / add_merge_rule / hide_path call, for add_rules_batch()
+struct HymoFSRule {
+    HymoFSRuleOp op = HymoFSRuleOp::Add;
+    std::string src;
+    std::string target;  // Empty for Hide
+    int type = 0;        // DT_* for Add
+};
+
+// What reconcile_rules() changes to turn the active rule set into the desired one
+struct HymoFSRuleDelta {
+    std::vector<std::string> remove;  // delete_rule() paths, applied before the adds
+    std::vector<HymoFSRule> add;
+    size_t unchanged = 0;
+    bool full_rebuild = false;  // Active rules could not be listed: start from an empty set
+};
+
 class HymoFS {
 public:
     static constexpr int EXPECTED_PROTOCOL_VERSION = HYMO_PROTOCOL_VERSION;
@@ -26,6 +51,33 @@ public:
     static bool set_mirror_path(const std::string& path);
     static bool hide_path(const std::string& path);
     static bool add_merge_rule(const std::string& src, const std::string& target);
+    // Submit `rules` in order with as few ioctls as possible (HYMO_FEATURE_RULE_BATCH), or
+    // one by one on kernels without it. A failing rule does not stop the others; returns
+    // false if any failed.
+    static bool add_rules_batch(const std::vector<HymoFSRule>& rules);
+
+    // Staged rule generation: rules added until commit_rules() stay invisible to lookups,
+    // which switch to the new set at once (HYMO_FEATURE_RULE_TXN). The staged set starts
+    // empty or as a copy of the active one. Kernels without staging get the old behaviour:
+    // an empty start clears the active rules, commit is a no-op and abort cannot roll back.
+    static bool begin_rules(bool copy_active);
+    static bool commit_rules();
+    static void abort_rules();
+    static bool rules_staged();  // begin_rules() opened a kernel-side generation
+
+    // Visit the add, merge and hide rules of the active set in kernel order, a page at a time
+    // (HYMO_FEATURE_RULE_PAGES) or from the text listing on older kernels. `visit` returns
+    // false to stop early.
+    static bool for_each_rule(const std::function<bool(const HymoFSRule&)>& visit);
+    static bool list_rules(std::vector<HymoFSRule>& rules);
+    // Rules sharing a path are compared as a group: a path whose rules differ is deleted and
+    // re-added, one with no desired rules is deleted, the rest is left alone
+    static HymoFSRuleDelta diff_rules(const std::vector<HymoFSRule>& active,
+                                      const std::vector<HymoFSRule>& desired);
+    // Bring the active set to `desired` with only the needed deletes and adds, published as
+    // one generation. With dry_run nothing is changed; `delta` receives the plan either way.
+    static bool reconcile_rules(const std::vector<HymoFSRule>& desired, bool dry_run = false,
+                                HymoFSRuleDelta* delta = nullptr);
 
     // Helper to recursively walk a directory and generate rules
     static bool add_rules_from_directory(const fs::path& target_base, const fs::path& module_dir);
@@ -33,7 +85,6 @@ public:
                                             const fs::path& module_dir);
 
     // Debug & Stealth
-    static std::string get_active_rules();
     static std::string get_hooks();
     static bool set_debug(bool enable);
     static bool set_stealth(bool enable);
@@ -61,6 +112,34 @@ public:
 
     // Invalidate status cache so next check_status() re-queries (e.g. after LKM load).
     static void invalidate_status_cache();
+
+    // Route all commands through `backend` (nullptr restores the kernel transport). Drops the
+    // current connection and cached status.
+    static void set_transport(std::shared_ptr<HymoFSTransport> backend);
+};
+
+// begin_rules() for a scope; aborts unless commit() was called
+class HymoFSRuleTransaction {
+public:
+    explicit HymoFSRuleTransaction(bool copy_active)
+        : open_(HymoFS::begin_rules(copy_active)) {}
+    ~HymoFSRuleTransaction() {
+        if (open_)
+            HymoFS::abort_rules();
+    }
+    HymoFSRuleTransaction(const HymoFSRuleTransaction&) = delete;
+    HymoFSRuleTransaction& operator=(const HymoFSRuleTransaction&) = delete;
+
+    bool is_open() const { return open_; }
+    bool commit() {
+        if (!open_)
+            return false;
+        open_ = false;
+        return HymoFS::commit_rules();
+    }
+
+private:
+    bool open_;
 };
 
 }  // namespace hymo
@@ -0,0 +1,348 @@
+// mount/hymofs_sim.cpp - In-process HymoFS backend for tests and benchmarks
+#include "hymofs_sim.hpp"
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace hymo {
+
+static int fail(int err) {
+    errno = err;
+    return -1;
+}
+
+static const char* command_name(unsigned int cmd) {
+    switch (cmd) {
+    case HYMO_IOC_ADD_RULE:
+        return "ADD_RULE";
+    case HYMO_IOC_DEL_RULE:
+        return "DEL_RULE";
+    case HYMO_IOC_HIDE_RULE:
+        return "HIDE_RULE";
+    case HYMO_IOC_CLEAR_ALL:
+        return "CLEAR_ALL";
+    case HYMO_IOC_GET_VERSION:
+        return "GET_VERSION";
+    case HYMO_IOC_LIST_RULES:
+        return "LIST_RULES";
+    case HYMO_IOC_ADD_MERGE_RULE:
+        return "ADD_MERGE_RULE";
+    case HYMO_IOC_GET_FEATURES:
+        return "GET_FEATURES";
+    case HYMO_IOC_SET_ENABLED:
+        return "SET_ENABLED";
+    case HYMO_IOC_ADD_RULES_BATCH:
+        return "ADD_RULES_BATCH";
+    case HYMO_IOC_BEGIN_RULES:
+        return "BEGIN_RULES";
+    case HYMO_IOC_COMMIT_RULES:
+        return "COMMIT_RULES";
+    case HYMO_IOC_ABORT_RULES:
+        return "ABORT_RULES";
+    case HYMO_IOC_LIST_RULES_PAGED:
+        return "LIST_RULES_PAGED";
+    default:
+        return "OTHER";
+    }
+}
+
+int HymoFSSimulator::ioctl(unsigned int cmd, void* arg) {
+    uint64_t bytes = _IOC_SIZE(cmd);
+    int ret = 0;
+
+    switch (cmd) {
+    case HYMO_IOC_ADD_RULE:
+    case HYMO_IOC_ADD_MERGE_RULE:
+    case HYMO_IOC_HIDE_RULE:
+    case HYMO_IOC_DEL_RULE: {
+        const auto* a = static_cast<const hymo_syscall_arg*>(arg);
+        const bool needs_target = cmd == HYMO_IOC_ADD_RULE || cmd == HYMO_IOC_ADD_MERGE_RULE;
+        if (!a || !a->src || (needs_target && !a->target)) {
+            ret = fail(EINVAL);
+            break;
+        }
+        const std::string src = a->src;
+        bytes += src.size() + 1;
+        RuleTables& t = edit_tables();
+        if (cmd == HYMO_IOC_ADD_RULE) {
+            bytes += strlen(a->target) + 1;
+            t.add[src] = {a->target, a->type};
+        } else if (cmd == HYMO_IOC_ADD_MERGE_RULE) {
+            bytes += strlen(a->target) + 1;
+            t.merge[src].insert(a->target);
+        } else if (cmd == HYMO_IOC_HIDE_RULE) {
+            t.hide.insert(src);
+        } else if (t.add.erase(src) + t.merge.erase(src) + t.hide.erase(src) == 0) {
+            ret = fail(ENOENT);
+        }
+        break;
+    }
+    case HYMO_IOC_CLEAR_ALL:
+        edit_tables() = RuleTables();
+        break;
+    case HYMO_IOC_GET_VERSION:
+        *static_cast<int*>(arg) = HYMO_PROTOCOL_VERSION;
+        break;
+    case HYMO_IOC_GET_FEATURES:
+        *static_cast<int*>(arg) = features_;
+        break;
+    case HYMO_IOC_SET_ENABLED:
+        enabled_ = *static_cast<const int*>(arg) != 0;
+        break;
+    case HYMO_IOC_LIST_RULES:
+        ret = list_text(*static_cast<hymo_syscall_list_arg*>(arg), bytes);
+        break;
+    case HYMO_IOC_GET_HOOKS: {
+        auto* a = static_cast<hymo_syscall_list_arg*>(arg);
+        if (a->buf && a->size > 0)
+            a->buf[0] = '\0';
+        break;
+    }
+    case HYMO_IOC_LIST_RULES_PAGED:
+        ret = (features_ & HYMO_FEATURE_RULE_PAGES)
+                  ? list_page(*static_cast<hymo_rule_page_arg*>(arg), bytes)
+                  : fail(ENOTTY);
+        break;
+    case HYMO_IOC_ADD_RULES_BATCH:
+        ret = (features_ & HYMO_FEATURE_RULE_BATCH)
+                  ? add_batch(*static_cast<hymo_rule_batch_arg*>(arg), bytes)
+                  : fail(ENOTTY);
+        break;
+    case HYMO_IOC_BEGIN_RULES: {
+        if (!(features_ & HYMO_FEATURE_RULE_TXN)) {
+            ret = fail(ENOTTY);
+            break;
+        }
+        if (staged_) {
+            ret = fail(EBUSY);
+            break;
+        }
+        auto* a = static_cast<hymo_rule_txn_arg*>(arg);
+        staged_ = (a->flags & HYMO_TXN_COPY_ACTIVE) ? active_ : RuleTables();
+        a->generation = ++generation_;
+        break;
+    }
+    case HYMO_IOC_COMMIT_RULES:
+    case HYMO_IOC_ABORT_RULES: {
+        if (!(features_ & HYMO_FEATURE_RULE_TXN)) {
+            ret = fail(ENOTTY);
+            break;
+        }
+        const auto* a = static_cast<const hymo_rule_txn_arg*>(arg);
+        if (!staged_) {
+            ret = fail(EINVAL);
+        } else if (a->generation != generation_) {
+            ret = fail(ESTALE);
+        } else {
+            if (cmd == HYMO_IOC_COMMIT_RULES)
+                active_ = std::move(*staged_);
+            staged_.reset();
+        }
+        break;
+    }
+    case HYMO_IOC_SET_DEBUG:
+    case HYMO_IOC_REORDER_MNT_ID:
+    case HYMO_IOC_SET_STEALTH:
+    case HYMO_IOC_HIDE_OVERLAY_XATTRS:
+    case HYMO_IOC_SET_MIRROR_PATH:
+    case HYMO_IOC_ADD_SPOOF_KSTAT:
+    case HYMO_IOC_UPDATE_SPOOF_KSTAT:
+    case HYMO_IOC_SET_UNAME:
+    case HYMO_IOC_SET_CMDLINE:
+    case HYMO_IOC_SET_HIDE_UIDS:
+    case HYMO_IOC_ADD_MAPS_RULE:
+    case HYMO_IOC_CLEAR_MAPS_RULES:
+    case HYMO_IOC_SET_MOUNT_HIDE:
+    case HYMO_IOC_SET_MAPS_SPOOF:
+    case HYMO_IOC_SET_STATFS_SPOOF:
+        break;
+    default:
+        ret = fail(ENOTTY);
+        break;
+    }
+
+    CommandStats& st = stats_[command_name(cmd)];
+    st.calls++;
+    st.bytes += bytes;
+    return ret;
+}
+
+int HymoFSSimulator::add_batch(hymo_rule_batch_arg& arg, uint64_t& bytes) {
+    if (arg.size > HYMO_RULE_BATCH_MAX_SIZE || (arg.size > 0 && arg.buf == 0)) {
+        return fail(EINVAL);
+    }
+    bytes += arg.size;
+
+    const char* p = reinterpret_cast<const char*>(static_cast<uintptr_t>(arg.buf));
+    const char* const end = p + arg.size;
+    std::string src;
+    std::string target;
+    RuleTables& t = edit_tables();
+    arg.applied = 0;
+    arg.err = 0;
+    for (uint32_t i = 0; i < arg.count; ++i) {
+        struct hymo_rule_batch_rec rec;
+        if (static_cast<size_t>(end - p) < sizeof(rec)) {
+            arg.err = -EINVAL;
+            return 0;
+        }
+        memcpy(&rec, p, sizeof(rec));
+        p += sizeof(rec);
+        const bool has_target = rec.op != HYMO_BATCH_HIDE;
+        if (rec.op < HYMO_BATCH_ADD || rec.op > HYMO_BATCH_HIDE || rec.src_shared > src.size() ||
+            (has_target && rec.target_shared > target.size()) ||
+            static_cast<size_t>(end - p) < size_t{rec.src_len} + rec.target_len) {
+            arg.err = -EINVAL;
+            return 0;
+        }
+        src.resize(rec.src_shared);
+        src.append(p, rec.src_len);
+        p += rec.src_len;
+        if (has_target) {
+            target.resize(rec.target_shared);
+            target.append(p, rec.target_len);
+            p += rec.target_len;
+        }
+
+        if (rec.op == HYMO_BATCH_ADD) {
+            t.add[src] = {target, rec.type};
+        } else if (rec.op == HYMO_BATCH_MERGE) {
+            t.merge[src].insert(target);
+        } else {
+            t.hide.insert(src);
+        }
+        arg.applied = i + 1;
+    }
+    return 0;
+}
+
+int HymoFSSimulator::list_text(hymo_syscall_list_arg& arg, uint64_t& bytes) const {
+    if (!arg.buf || arg.size == 0) {
+        return fail(EINVAL);
+    }
+    std::string out;
+    for (const auto& [path, rule] : active_.add) {
+        out += "add " + path + " " + rule.first + " " + std::to_string(rule.second) + "\n";
+    }
+    for (const auto& [path, sources] : active_.merge) {
+        for (const auto& source : sources) {
+            out += "merge " + path + " " + source + "\n";
+        }
+    }
+    for (const auto& path : active_.hide) {
+        out += "hide " + path + "\n";
+    }
+    const size_t n = std::min(out.size(), arg.size - 1);
+    memcpy(arg.buf, out.data(), n);
+    arg.buf[n] = '\0';
+    bytes += n;
+    return 0;
+}
+
+int HymoFSSimulator::list_page(hymo_rule_page_arg& arg, uint64_t& bytes) const {
+    auto* out = reinterpret_cast<uint8_t*>(static_cast<uintptr_t>(arg.buf));
+    if (!out) {
+        return fail(EFAULT);
+    }
+    if (arg.cursor > cursors_.size()) {
+        return fail(EINVAL);
+    }
+
+    // Resume after the last record of the previous page, looked up by key
+    const ListCursor* from = arg.cursor ? &cursors_[arg.cursor - 1] : nullptr;
+    uint32_t used = 0;
+    uint32_t count = 0;
+    bool full = false;
+    ListCursor last{};
+    auto emit = [&](int table, uint8_t op, int type, const std::string& src,
+                    const std::string& target) {
+        const size_t len = sizeof(hymo_rule_list_rec) + src.size() + target.size();
+        const size_t padded = (len + 7) & ~static_cast<size_t>(7);
+        if (used + padded > arg.size) {
+            full = true;
+            return false;
+        }
+        struct hymo_rule_list_rec rec = {};
+        rec.op = op;
+        rec.type = static_cast<uint8_t>(type);
+        rec.src_len = static_cast<uint16_t>(src.size());
+        rec.target_len = static_cast<uint16_t>(target.size());
+        uint8_t* dst = out + used;
+        memcpy(dst, &rec, sizeof(rec));
+        memcpy(dst + sizeof(rec), src.data(), src.size());
+        memcpy(dst + sizeof(rec) + src.size(), target.data(), target.size());
+        memset(dst + len, 0, padded - len);
+        used += static_cast<uint32_t>(padded);
+        count++;
+        last = {table, src, op == HYMO_BATCH_MERGE ? target : std::string()};
+        return true;
+    };
+
+    const int from_table = from ? from->table : 0;
+    if (from_table <= 0) {
+        auto it = from ? active_.add.upper_bound(from->path) : active_.add.begin();
+        for (; it != active_.add.end(); ++it) {
+            if (!emit(0, HYMO_BATCH_ADD, it->second.second, it->first, it->second.first)) {
+                break;
+            }
+        }
+    }
+    if (!full && from_table <= 1) {
+        auto it = from_table == 1 ? active_.merge.lower_bound(from->path) : active_.merge.begin();
+        for (bool first = true; !full && it != active_.merge.end(); ++it, first = false) {
+            const auto& sources = it->second;
+            auto src = first && from_table == 1 && it->first == from->path
+                           ? sources.upper_bound(from->source)
+                           : sources.begin();
+            for (; src != sources.end(); ++src) {
+                if (!emit(1, HYMO_BATCH_MERGE, DT_DIR, it->first, *src)) {
+                    break;
+                }
+            }
+        }
+    }
+    if (!full) {
+        auto it = from_table == 2 ? active_.hide.upper_bound(from->path) : active_.hide.begin();
+        for (; it != active_.hide.end(); ++it) {
+            if (!emit(2, HYMO_BATCH_HIDE, 0, *it, std::string())) {
+                break;
+            }
+        }
+    }
+    if (full && count == 0) {
+        return fail(ENOSPC);
+    }
+
+    if (full) {
+        cursors_.push_back(std::move(last));
+        arg.cursor = cursors_.size();
+    } else {
+        arg.cursor = 0;
+    }
+    arg.count = count;
+    arg.used = used;
+    arg.total = static_cast<uint32_t>(rule_count());
+    bytes += used;
+    return 0;
+}
+
+HymoFSSimulator::CommandStats HymoFSSimulator::totals() const {
+    CommandStats total;
+    for (const auto& [name, st] : stats_) {
+        total.calls += st.calls;
+        total.bytes += st.bytes;
+    }
+    return total;
+}
+
+size_t HymoFSSimulator::rule_count() const {
+    size_t merges = 0;
+    for (const auto& [path, sources] : active_.merge) {
+        merges += sources.size();
+    }
+    return active_.add.size() + merges + active_.hide.size();
+}
+
+}  // namespace hymo
@@ -0,0 +1,76 @@
+// mount/hymofs_sim.hpp - In-process HymoFS backend for tests and benchmarks
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "hymo_magic.h"
+#include "hymofs_transport.hpp"
+
+namespace hymo {
+
+// Keeps the rule tables in userspace and answers HYMO_IOC_* commands the way the kernel
+// module does: add/merge/hide/delete/clear rules, text and paged listings, batched
+// submission and staged generations. Settings (stealth, spoofing, ...) are accepted and
+// ignored. Every command is counted together with the bytes that would cross the ioctl
+// boundary (argument struct, path strings and buffers).
+class HymoFSSimulator : public HymoFSTransport {
+public:
+    static constexpr int ALL_FEATURES =
+        HYMO_FEATURE_MERGE_DIR | HYMO_FEATURE_RULE_BATCH | HYMO_FEATURE_RULE_TXN |
+        HYMO_FEATURE_RULE_PAGES;
+
+    struct CommandStats {
+        uint64_t calls = 0;
+        uint64_t bytes = 0;
+    };
+
+    explicit HymoFSSimulator(int features = ALL_FEATURES) : features_(features) {}
+
+    bool present() override { return true; }
+    int ioctl(unsigned int cmd, void* arg) override;
+
+    // Per command, keyed by name ("ADD_RULE", "LIST_RULES_PAGED", ...)
+    const std::map<std::string, CommandStats>& stats() const { return stats_; }
+    CommandStats totals() const;
+    void reset_stats() { stats_.clear(); }
+
+    // Rules in the active generation
+    size_t rule_count() const;
+    bool enabled() const { return enabled_; }
+
+private:
+    struct RuleTables {
+        std::map<std::string, std::pair<std::string, int>> add;  // path -> source, DT_*
+        std::map<std::string, std::set<std::string>> merge;      // path -> source dirs
+        std::set<std::string> hide;
+    };
+
+    // Last record of a listed page (tables in add, merge, hide order). Paging resumes
+    // after it by key, so rules added or deleted in between never shift the next page.
+    struct ListCursor {
+        int table;
+        std::string path;
+        std::string source;  // Merge only
+    };
+
+    // Rule ioctls edit the staged generation while one is open
+    RuleTables& edit_tables() { return staged_ ? *staged_ : active_; }
+    int add_batch(struct hymo_rule_batch_arg& arg, uint64_t& bytes);
+    int list_text(struct hymo_syscall_list_arg& arg, uint64_t& bytes) const;
+    int list_page(struct hymo_rule_page_arg& arg, uint64_t& bytes) const;
+
+    int features_;
+    bool enabled_ = false;
+    RuleTables active_;
+    std::optional<RuleTables> staged_;
+    uint32_t generation_ = 0;
+    std::map<std::string, CommandStats> stats_;
+    mutable std::vector<ListCursor> cursors_;  // HYMO_IOC_LIST_RULES_PAGED cursor n is [n - 1]
+};
+
+}  // namespace hymo
@@ -0,0 +1,25 @@
+// mount/hymofs_transport.hpp - How HymoFS commands reach the kernel
+#pragma once
+
+#include <memory>
+
+namespace hymo {
+
+// Carries HYMO_IOC_* commands with ioctl(2) semantics. HymoFS talks to the kernel module
+// through the anon-fd backend unless another one is installed with HymoFS::set_transport().
+class HymoFSTransport {
+public:
+    virtual ~HymoFSTransport() = default;
+
+    // Cheap check that the backend can be reached at all (no waiting or retries)
+    virtual bool present() = 0;
+    // Run one HYMO_IOC_* command: 0 on success, -1 with errno set otherwise
+    virtual int ioctl(unsigned int cmd, void* arg) = 0;
+    // Drop the connection so kernel module refs can drain; the next ioctl reconnects
+    virtual void release() {}
+};
+
+// Anonymous fd from the HymoFS kernel module (prctl, SYS_reboot as fallback)
+std::shared_ptr<HymoFSTransport> make_kernel_transport();
+
+}  // namespace hymo
@@ -1,5 +1,6 @@
 // mount/magic.cpp - Magic mount implementation
 #include "magic.hpp"
+#include <dirent.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <sys/mount.h>
@@ -9,11 +10,15 @@
 #include <sys/xattr.h>
 #include <unistd.h>
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <map>
 #include <set>
 #include <sstream>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include "../core/module_index.hpp"
 #include "../core/state.hpp"
 #include "../defs.hpp"
 #include "../utils.hpp"
@@ -38,36 +43,163 @@ struct MountStats {
     int dirs_mounted = 0;
     int symlinks_created = 0;
     int overlayfs_mounts = 0;
+    int subtree_binds = 0;
+    int mounts_saved = 0;
+    int planned_mounts = 0;
+    int actual_mounts = 0;
+    int file_syscalls = 0;
 };
 
 static MountStats g_mount_stats;
 
 enum class NodeFileType { RegularFile, Directory, Symlink, Whiteout };
 
+using NodeId = uint32_t;
+constexpr NodeId kNoNode = UINT32_MAX;
+
 struct Node {
-    std::string name;
-    NodeFileType file_type;
-    std::unordered_map<std::string, Node> children;
-    fs::path module_path;     // Path to module file
-    std::string module_name;  // Module ID that owns this node
-    bool replace = false;     // Directory marked for replacement (xattr/file)
-    bool skip = false;        // Skip mounting this node
-    bool done = false;        // Already processed flag
+    std::string_view name;         // Interned
+    std::string_view module_path;  // Path to module file, empty if none
+    std::string_view module_name;  // Module ID that owns this node (interned)
+    NodeId parent = kNoNode;
+    NodeId first_child = kNoNode;
+    NodeId next_sibling = kNoNode;
+    NodeFileType file_type = NodeFileType::Directory;
+    bool replace = false;  // Directory marked for replacement (xattr/file)
+    bool skip = false;     // Skip mounting this node
 };
 
-static bool dir_is_replace(const fs::path& path) {
-    char buf[4];
-    ssize_t len = lgetxattr(path.c_str(), REPLACE_DIR_XATTR, buf, sizeof(buf));
-    if (len > 0 && buf[0] == 'y') {
-        return true;
+// Bump allocator for the strings of one NodeTree; views stay valid while it lives
+class StringArena {
+public:
+    std::string_view store(std::string_view str) {
+        if (str.empty()) {
+            return {};
+        }
+        if (str.size() > avail_) {
+            const size_t size = std::max(kBlockSize, str.size());
+            blocks_.push_back(std::make_unique<char[]>(size));
+            cur_ = blocks_.back().get();
+            avail_ = size;
+        }
+        char* data = cur_;
+        memcpy(data, str.data(), str.size());
+        cur_ += str.size();
+        avail_ -= str.size();
+        return {data, str.size()};
     }
 
-    if (fs::exists(path / REPLACE_DIR_FILE_NAME)) {
-        return true;
+    // One copy per distinct string, so interned views compare by address
+    std::string_view intern(std::string_view str) {
+        auto it = interned_.find(str);
+        if (it != interned_.end()) {
+            return *it;
+        }
+        const std::string_view stored = store(str);
+        interned_.insert(stored);
+        return stored;
     }
 
-    return false;
-}
+    // The interned copy of `str`, or a null view if it was never interned
+    std::string_view find(std::string_view str) const {
+        auto it = interned_.find(str);
+        return it != interned_.end() ? *it : std::string_view();
+    }
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* cur_ = nullptr;
+    size_t avail_ = 0;
+    std::unordered_set<std::string_view> interned_;
+};
+
+// All nodes of one magic mount in a flat table. Children are index-linked and found by a
+// (parent, interned name) hash, so adding a node allocates O(1) and moving a subtree to
+// another parent relinks one node instead of copying it.
+class NodeTree {
+public:
+    NodeTree() = default;
+    NodeTree(NodeTree&&) = default;
+    NodeTree& operator=(NodeTree&&) = default;
+    NodeTree(const NodeTree&) = delete;
+    NodeTree& operator=(const NodeTree&) = delete;
+
+    // New node below `parent` (detached with kNoNode)
+    NodeId add(NodeId parent, std::string_view name, NodeFileType type) {
+        const NodeId id = static_cast<NodeId>(nodes_.size());
+        Node& node = nodes_.emplace_back();
+        node.name = strings_.intern(name);
+        node.file_type = type;
+        if (parent != kNoNode) {
+            attach(parent, id);
+        }
+        return id;
+    }
+
+    NodeId child(NodeId parent, std::string_view name) const {
+        const std::string_view interned = strings_.find(name);
+        if (interned.data() == nullptr) {
+            return kNoNode;
+        }
+        auto it = by_name_.find({parent, interned.data()});
+        return it != by_name_.end() ? it->second : kNoNode;
+    }
+
+    // `id` must be detached; replaces a child of the same name
+    void attach(NodeId parent, NodeId id) {
+        const NodeId old = child(parent, nodes_[id].name);
+        if (old != kNoNode) {
+            detach(old);
+        }
+        Node& node = nodes_[id];
+        node.parent = parent;
+        node.next_sibling = nodes_[parent].first_child;
+        nodes_[parent].first_child = id;
+        by_name_[{parent, node.name.data()}] = id;
+    }
+
+    void detach(NodeId id) {
+        Node& node = nodes_[id];
+        if (node.parent == kNoNode) {
+            return;
+        }
+        NodeId* link = &nodes_[node.parent].first_child;
+        while (*link != id) {
+            link = &nodes_[*link].next_sibling;
+        }
+        *link = node.next_sibling;
+        by_name_.erase({node.parent, node.name.data()});
+        node.parent = kNoNode;
+        node.next_sibling = kNoNode;
+    }
+
+    Node& operator[](NodeId id) { return nodes_[id]; }
+    const Node& operator[](NodeId id) const { return nodes_[id]; }
+    size_t size() const { return nodes_.size(); }
+
+    std::string_view store(std::string_view str) { return strings_.store(str); }
+    std::string_view intern(std::string_view str) { return strings_.intern(str); }
+
+private:
+    struct ChildKey {
+        NodeId parent;
+        const char* name;
+        bool operator==(const ChildKey& other) const {
+            return parent == other.parent && name == other.name;
+        }
+    };
+    struct ChildKeyHash {
+        size_t operator()(const ChildKey& key) const {
+            return std::hash<const char*>()(key.name) * 31 + key.parent;
+        }
+    };
+
+    std::vector<Node> nodes_;
+    std::unordered_map<ChildKey, NodeId, ChildKeyHash> by_name_;
+    StringArena strings_;
+};
 
 static NodeFileType get_file_type(const fs::path& path) {
     struct stat st;
@@ -86,75 +218,80 @@ static NodeFileType get_file_type(const fs::path& path) {
     }
 }
 
-static bool collect_module_files(Node& node, const fs::path& module_dir,
-                                 const std::string& module_name = "") {
-    if (!fs::exists(module_dir)) {
-        LOG_DEBUG("Module dir does not exist: " + module_dir.string());
-        return false;
+static NodeFileType get_file_type(const ModuleTreeIndex& index, uint32_t i) {
+    if (index.is_whiteout(i)) {
+        return NodeFileType::Whiteout;
     }
-
-    if (!fs::is_directory(module_dir)) {
-        LOG_DEBUG("Module dir is not a directory: " + module_dir.string());
-        return false;
+    switch (index.entry(i).type) {
+        case DT_DIR:
+            return NodeFileType::Directory;
+        case DT_LNK:
+            return NodeFileType::Symlink;
+        default:
+            return NodeFileType::RegularFile;
     }
+}
 
+static bool dir_is_replace(const ModuleTreeIndex& index, uint32_t dir) {
+    return (index.entry(dir).flags & MTI_OPAQUE) ||
+           index.child(dir, REPLACE_DIR_FILE_NAME) != ModuleTreeIndex::npos;
+}
+
+// `module_dir` is the module path of `node`; it is extended in place for the children
+static bool collect_module_files(NodeTree& tree, NodeId node, const ModuleTreeIndex& index,
+                                 uint32_t dir, std::string& module_dir,
+                                 std::string_view module_name) {
     bool has_file = false;
     int file_count = 0;
     int dir_count = 0;
+    const size_t base = module_dir.size();
+
+    const ModuleTreeEntry& d = index.entry(dir);
+    for (uint32_t i = d.first_child; i < d.first_child + d.child_count; ++i) {
+        const std::string_view name = index.name(i);
+        module_dir += '/';
+        module_dir += name;
+        NodeFileType ft = get_file_type(index, i);
+
+        // Node may already exist from another module - merge
+        NodeId child = tree.child(node, name);
+        if (child == kNoNode) {
+            child = tree.add(node, name, ft);
+            tree[child].module_path = tree.store(module_dir);
+            tree[child].module_name = module_name;
+        }
 
-    try {
-        for (const auto& entry : fs::directory_iterator(module_dir)) {
-            std::string name = entry.path().filename().string();
-            NodeFileType ft = get_file_type(entry.path());
-
-            auto it = node.children.find(name);
-            Node* child = nullptr;
-
-            if (it != node.children.end()) {
-                // Node already exists from another module - merge
-                child = &it->second;
-            } else {
-                // Create new node
-                Node new_child;
-                new_child.name = name;
-                new_child.file_type = ft;
-                new_child.module_path = entry.path();
-                new_child.module_name = module_name;
-                node.children[name] = new_child;
-                child = &node.children[name];
-            }
-
-            if (ft == NodeFileType::Directory) {
-                dir_count++;
-                child->replace = dir_is_replace(entry.path());
-                bool child_has_file = collect_module_files(*child, entry.path(), module_name);
-                has_file |= child_has_file || child->replace;
-                if (child->replace) {
-                    LOG_DEBUG("  Replace dir: " + entry.path().string());
-                }
-            } else {
-                file_count++;
-                has_file = true;
+        if (ft == NodeFileType::Directory) {
+            dir_count++;
+            const bool replace = dir_is_replace(index, i);
+            tree[child].replace = replace;
+            bool child_has_file =
+                collect_module_files(tree, child, index, i, module_dir, module_name);
+            has_file |= child_has_file || replace;
+            if (replace) {
+                LOG_DEBUGF("  Replace dir: {}", module_dir);
             }
+        } else {
+            file_count++;
+            has_file = true;
         }
+        module_dir.resize(base);
+    }
 
-        if (has_file) {
-            LOG_DEBUG("Scanned " + module_dir.string() + ": " + std::to_string(file_count) +
-                      " files, " + std::to_string(dir_count) + " dirs");
-        }
-    } catch (const std::exception& e) {
-        LOG_ERROR("Exception scanning " + module_dir.string() + ": " + std::string(e.what()));
-        return false;
+    if (has_file) {
+        LOG_DEBUGF("Scanned {}: {} files, {} dirs", module_dir, file_count, dir_count);
     }
 
     return has_file;
 }
 
-static Node* collect_all_modules(const std::vector<fs::path>& module_paths,
-                                 const std::vector<std::string>& extra_partitions) {
-    Node* root = new Node{"", NodeFileType::Directory, {}, {}, "", false, false, false};
-    Node system{"system", NodeFileType::Directory, {}, {}, "", false, false, false};
-    system.module_path = "/system";  // Set source for attribute cloning
+// Node 0 of `tree` becomes the root; false if no module has anything to mount
+static bool collect_all_modules(NodeTree& tree, const std::vector<fs::path>& module_paths,
+                                const std::vector<std::string>& extra_partitions) {
+    const NodeId root = tree.add(kNoNode, "", NodeFileType::Directory);
+    // Detached until the partitions that live at / have been moved out of it
+    const NodeId system = tree.add(kNoNode, "system", NodeFileType::Directory);
+    tree[system].module_path = tree.store("/system");  // Set source for attribute cloning
 
     bool has_file = false;
     std::vector<std::string> failed_modules;
@@ -167,17 +304,25 @@ static Node* collect_all_modules(const std::vector<fs::path>& module_paths,
 
     for (const auto& module_path : module_paths) {
         std::string module_id = module_path.filename().string();
+        const auto index = module_tree_index(module_path.parent_path());
+        const uint32_t module_entry = index->child(ModuleTreeIndex::root_index, module_id);
+        if (module_entry == ModuleTreeIndex::npos) {
+            LOG_DEBUG("Module dir does not exist: " + module_path.string());
+            continue;
+        }
 
         // Check if module is disabled or should be skipped
-        if (fs::exists(module_path / "disable") || fs::exists(module_path / "remove") ||
-            fs::exists(module_path / "skip_mount")) {
+        if (index->child(module_entry, "disable") != ModuleTreeIndex::npos ||
+            index->child(module_entry, "remove") != ModuleTreeIndex::npos ||
+            index->child(module_entry, "skip_mount") != ModuleTreeIndex::npos) {
             LOG_DEBUG("Skipped module " + module_id + " (disabled/removed/skip_mount)");
             continue;
         }
 
         bool module_modified = false;
         for (const auto& p : partitions_to_check) {
-            if (fs::is_directory(module_path / p)) {
+            const uint32_t part_entry = index->child(module_entry, p);
+            if (part_entry != ModuleTreeIndex::npos && index->is_dir(part_entry)) {
                 module_modified = true;
                 break;
             }
@@ -190,31 +335,27 @@ static Node* collect_all_modules(const std::vector<fs::path>& module_paths,
 
         LOG_INFO("Processing module: " + module_id);
         try {
+            const std::string_view module_name = tree.intern(module_id);
             bool module_has_file = false;
             for (const auto& p : partitions_to_check) {
-                fs::path part_path = module_path / p;
-                if (fs::exists(part_path) && fs::is_directory(part_path)) {
-                    if (p == "system") {
-                        if (collect_module_files(system, part_path, module_id)) {
-                            module_has_file = true;
-                        }
-                    } else {
+                std::string part_path = (module_path / p).string();
+                const uint32_t part_entry = index->child(module_entry, p);
+                if (part_entry != ModuleTreeIndex::npos && index->is_dir(part_entry)) {
+                    NodeId part_node = system;
+                    if (p != "system") {
                         // For top-level partitions like vendor/, product/ (KernelSU style)
                         // Add them to system's children so they get extracted properly later
-                        auto it = system.children.find(p);
-                        if (it == system.children.end()) {
-                            Node p_node;
-                            p_node.name = p;
-                            p_node.file_type = NodeFileType::Directory;
-                            p_node.module_path = part_path;
-                            p_node.module_name = module_id;
-                            system.children[p] = p_node;
-                            it = system.children.find(p);
-                        }
-                        if (collect_module_files(it->second, part_path, module_id)) {
-                            module_has_file = true;
+                        part_node = tree.child(system, p);
+                        if (part_node == kNoNode) {
+                            part_node = tree.add(system, p, NodeFileType::Directory);
+                            tree[part_node].module_path = tree.store(part_path);
+                            tree[part_node].module_name = module_name;
                         }
                     }
+                    if (collect_module_files(tree, part_node, *index, part_entry, part_path,
+                                             module_name)) {
+                        module_has_file = true;
+                    }
                 }
             }
 
@@ -235,8 +376,7 @@ static Node* collect_all_modules(const std::vector<fs::path>& module_paths,
 
     if (!has_file) {
         LOG_WARN("No files to magic mount from any module");
-        delete root;
-        return nullptr;
+        return false;
     }
 
     LOG_INFO("File collection successful");
@@ -250,9 +390,9 @@ static Node* collect_all_modules(const std::vector<fs::path>& module_paths,
 
         if (fs::is_directory(path_of_root) &&
             (!require_symlink || fs::is_symlink(path_of_system))) {
-            auto it = system.children.find(partition);
-            if (it != system.children.end()) {
-                Node& node = it->second;
+            const NodeId id = tree.child(system, partition);
+            if (id != kNoNode) {
+                Node& node = tree[id];
                 if (node.file_type == NodeFileType::Symlink) {
                     if (fs::is_directory(node.module_path)) {
                         node.file_type = NodeFileType::Directory;
@@ -260,11 +400,11 @@ static Node* collect_all_modules(const std::vector<fs::path>& module_paths,
                 }
 
                 if (node.module_path.empty()) {
-                    node.module_path = path_of_root;
+                    node.module_path = tree.store(path_of_root.string());
                 }
 
-                root->children[partition] = node;
-                system.children.erase(it);
+                tree.detach(id);
+                tree.attach(root, id);
             }
         }
     }
@@ -283,41 +423,94 @@ static Node* collect_all_modules(const std::vector<fs::path>& module_paths,
 
         fs::path path_of_root = fs::path("/") / partition;
         if (fs::is_directory(path_of_root)) {
-            auto it = system.children.find(partition);
-            if (it != system.children.end()) {
+            const NodeId id = tree.child(system, partition);
+            if (id != kNoNode) {
                 LOG_DEBUG("attach extra partition '" + partition + "' to root");
-                Node& node = it->second;
+                Node& node = tree[id];
                 if (node.file_type == NodeFileType::Symlink && fs::is_directory(node.module_path)) {
                     node.file_type = NodeFileType::Directory;
                 }
                 if (node.module_path.empty()) {
-                    node.module_path = path_of_root;
+                    node.module_path = tree.store(path_of_root.string());
                 }
-                root->children[partition] = node;
-                system.children.erase(it);
+                tree.detach(id);
+                tree.attach(root, id);
             }
         }
     }
 
-    root->children["system"] = system;
-    return root;
+    tree.attach(root, system);
+    LOG_DEBUG("Magic mount tree: " + std::to_string(tree.size()) + " nodes");
+    return true;
 }
 
-static bool mount_mirror(const fs::path& src_path, const fs::path& dst_path,
-                         const std::string& name) {
+// Files counted below a mirrored directory before giving up on an exact number
+static constexpr int kMirrorCountLimit = 1024;
+
+// Regular files below `name` (not following symlinks), i.e. the binds mirroring it would
+// make; stops counting at `limit`
+static int count_mirror_binds(int parent_fd, const char* name, int limit = INT_MAX) {
+    const int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return 0;
+    }
+    int count = 0;
+    while (count < limit) {
+        struct dirent* entry = readdir(dir);
+        if (!entry) {
+            break;
+        }
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_REG) {
+            count++;
+        } else if (type == DT_DIR) {
+            count += count_mirror_binds(fd, entry->d_name, limit - count);
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+// Name for the *at calls: relative to `dir_fd`, or the full path when there is no fd
+static const char* at_name(int dir_fd, const fs::path& full, const std::string& name) {
+    return dir_fd == AT_FDCWD ? full.c_str() : name.c_str();
+}
+
+// `src_dir_fd`/`dst_dir_fd` are src_path and dst_path opened by the caller (or AT_FDCWD)
+static bool mount_mirror(const fs::path& src_path, const fs::path& dst_path, int src_dir_fd,
+                         int dst_dir_fd, const std::string& name,
+                         const MagicMountOptions& opts) {
     fs::path src = src_path / name;
     fs::path dst = dst_path / name;
+    const char* src_at = at_name(src_dir_fd, src, name);
+    const char* dst_at = at_name(dst_dir_fd, dst, name);
 
     try {
         struct stat st;
-        if (lstat(src.c_str(), &st) != 0) {
+        if (fstatat(src_dir_fd, src_at, &st, AT_SYMLINK_NOFOLLOW) != 0) {
             LOG_WARN("lstat failed for: " + src.string());
             return false;
         }
 
         if (S_ISREG(st.st_mode)) {
             // Regular file: create empty file then bind mount
-            int fd = open(dst.c_str(), O_CREAT | O_WRONLY | O_TRUNC, st.st_mode & 07777);
+            int fd = openat(dst_dir_fd, dst_at, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,
+                            st.st_mode & 07777);
             if (fd < 0) {
                 LOG_ERROR("Failed to create mirror file: " + dst.string());
                 return false;
@@ -328,45 +521,85 @@ static bool mount_mirror(const fs::path& src_path, const fs::path& dst_path,
                 LOG_WARN("Failed to bind mirror file: " + src.string());
                 return false;
             }
-            LOG_VERBOSE("Mirror file: " + src.string() + " -> " + dst.string());
+            g_mount_stats.actual_mounts++;
+            LOG_VERBOSEF("Mirror file: {} -> {}", src, dst);
         } else if (S_ISDIR(st.st_mode)) {
             // Directory: create dir, copy attributes, recursively mirror children
-            if (mkdir(dst.c_str(), st.st_mode & 07777) != 0 && errno != EEXIST) {
+            if (mkdirat(dst_dir_fd, dst_at, st.st_mode & 07777) != 0 && errno != EEXIST) {
                 LOG_ERROR("Failed to create mirror directory: " + dst.string());
                 return false;
             }
 
-            chmod(dst.c_str(), st.st_mode & 07777);
-            chown(dst.c_str(), st.st_uid, st.st_gid);
-            clone_attr(src, dst);
+            // Nothing below it is modified: one recursive bind replaces a bind per file. A
+            // directory without files is cheaper to mirror (mkdir only). The count that
+            // decides it stops at kMirrorCountLimit files, so a large tree costs a handful of
+            // getdents calls rather than a full walk, and mounts_saved is a lower bound.
+            const int file_binds =
+                opts.bind_subtrees ? count_mirror_binds(src_dir_fd, src_at, kMirrorCountLimit)
+                                   : 0;
+            if (file_binds > 0) {
+                if (mount_bind_modern(src, dst, true)) {
+                    g_mount_stats.subtree_binds++;
+                    g_mount_stats.actual_mounts++;
+                    g_mount_stats.mounts_saved += file_binds - 1;
+                    LOG_VERBOSEF("Mirror dir: {} -> {} (1 bind for {}{} files)", src, dst,
+                                 file_binds, file_binds >= kMirrorCountLimit ? "+" : "");
+                    return true;
+                }
+                LOG_WARN("Failed to bind mirror directory, mirroring entries: " + src.string());
+            }
+
+            clone_attr_at(src_dir_fd, src_at, dst_dir_fd, dst_at);
+
+            // Recursively mirror all children, resolving them against the two directories
+            const int child_src_fd =
+                openat(src_dir_fd, src_at, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            DIR* dir = child_src_fd >= 0 ? fdopendir(child_src_fd) : nullptr;
+            if (!dir) {
+                if (child_src_fd >= 0) {
+                    close(child_src_fd);
+                }
+                LOG_WARN("Failed to open directory: " + src.string());
+                return false;
+            }
+            int child_dst_fd =
+                openat(dst_dir_fd, dst_at, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (child_dst_fd < 0) {
+                child_dst_fd = AT_FDCWD;
+            }
 
-            // Recursively mirror all children
             bool ok = true;
-            for (const auto& entry : fs::directory_iterator(src)) {
-                std::string child_name = entry.path().filename().string();
-                if (!mount_mirror(src, dst, child_name)) {
+            while (struct dirent* entry = readdir(dir)) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                    continue;
+                }
+                if (!mount_mirror(src, dst, dirfd(dir), child_dst_fd, entry->d_name, opts)) {
                     ok = false;
                 }
             }
+            closedir(dir);
+            if (child_dst_fd != AT_FDCWD) {
+                close(child_dst_fd);
+            }
             if (!ok) {
                 return false;
             }
         } else if (S_ISLNK(st.st_mode)) {
             // Symlink: read target and create symlink
             char target[PATH_MAX];
-            ssize_t len = readlink(src.c_str(), target, sizeof(target) - 1);
+            ssize_t len = readlinkat(src_dir_fd, src_at, target, sizeof(target) - 1);
             if (len < 0) {
                 LOG_ERROR("Failed to read symlink: " + src.string());
                 return false;
             }
             target[len] = '\0';
 
-            if (symlink(target, dst.c_str()) != 0) {
+            if (symlinkat(target, dst_dir_fd, dst_at) != 0) {
                 LOG_ERROR("Failed to create symlink: " + dst.string());
                 return false;
             }
-            clone_attr(src, dst);
-            LOG_VERBOSE("Mirror symlink: " + src.string() + " -> " + std::string(target));
+            clone_attr_at(src_dir_fd, src_at, dst_dir_fd, dst_at);
+            LOG_VERBOSEF("Mirror symlink: {} -> {}", src, target);
         }
     } catch (const std::exception& e) {
         LOG_WARN("Failed to mirror " + src.string() + ": " + std::string(e.what()));
@@ -376,55 +609,85 @@ static bool mount_mirror(const fs::path& src_path, const fs::path& dst_path,
     return true;
 }
 
-static bool mount_file(const fs::path& path, const fs::path& work_dir_path, const Node& node,
-                       bool has_tmpfs, bool disable_umount) {
+// Where the entries of a directory are created
+enum class Placement : uint8_t {
+    Real,      // On the real path; only files can be bound over
+    Skeleton,  // In a tmpfs skeleton being built; entries are created there
+    Patch,     // In a skeleton, over a bind of the real directory; only files can be bound over
+};
+
+// `dir_fd` is the directory the target is created in (AT_FDCWD: use the full path)
+static bool mount_file(const fs::path& path, const fs::path& work_dir_path, int dir_fd,
+                       const Node& node, Placement placement, const MagicMountOptions& opts) {
     g_mount_stats.total_mounts++;
     g_mount_stats.files_mounted++;
 
-    fs::path target_path = has_tmpfs ? work_dir_path : path;
+    fs::path target_path = placement == Placement::Real ? path : work_dir_path;
+    const std::string name = target_path.filename().string();
+    const char* target = dir_fd == AT_FDCWD ? target_path.c_str() : name.c_str();
+    int syscalls = 0;
 
-    if (has_tmpfs) {
-        std::ofstream f(work_dir_path);
-        f.close();
+    if (placement == Placement::Skeleton) {
+        const int fd = openat(dir_fd, target, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+        syscalls++;
+        if (fd >= 0) {
+            close(fd);
+            syscalls++;
+        }
     }
 
+    bool ok = true;
     if (!node.module_path.empty()) {
-        if (!mount_bind_modern(node.module_path, target_path, true)) {
-            LOG_ERROR("Failed to bind mount file: " + node.module_path.string() + " -> " +
-                      target_path.string());
-            g_mount_stats.failed_mounts++;
-            return false;
-        }
-        LOG_VERBOSE("Mount file: " + node.module_path.string() + " -> " + target_path.string());
+        if (mount_bind_file_ro_at(fs::path(node.module_path), dir_fd, target, &syscalls)) {
+            LOG_VERBOSEF("Mount file: {} -> {}", node.module_path, target_path);
+
+            // Inside a skeleton the bind goes away with the tmpfs, which finalize_tmpfs_overlay
+            // registers once for the whole directory
+            if (placement == Placement::Real && !opts.disable_umount) {
+                send_unmountable(target_path);
+                syscalls++;
+            }
 
-        if (!disable_umount) {
-            send_unmountable(target_path);
+            g_mount_stats.successful_mounts++;
+            g_mount_stats.actual_mounts++;
+        } else {
+            LOG_ERROR("Failed to bind mount file: " + std::string(node.module_path) + " -> " +
+                      target_path.string() + " - " + strerror(errno));
+            g_mount_stats.failed_mounts++;
+            ok = false;
         }
-
-        mount(nullptr, target_path.c_str(), nullptr, MS_REMOUNT | MS_RDONLY | MS_BIND, nullptr);
-        g_mount_stats.successful_mounts++;
     }
 
-    return true;
+    g_mount_stats.file_syscalls += syscalls;
+    return ok;
 }
 
-static bool mount_symlink(const fs::path& work_dir_path, const Node& node) {
+// `dir_fd` is the skeleton directory the link is created in (AT_FDCWD: use the full path)
+static bool mount_symlink(const fs::path& work_dir_path, int dir_fd, const Node& node) {
     g_mount_stats.total_mounts++;
     g_mount_stats.symlinks_created++;
 
     if (!node.module_path.empty()) {
         try {
-            auto link_target = fs::read_symlink(node.module_path);
+            const fs::path module_path(node.module_path);
+            auto link_target = fs::read_symlink(module_path);
 
             // Validate symlink safety
-            if (!is_safe_symlink(node.module_path, fs::path("/"))) {
-                LOG_ERROR("Unsafe symlink detected: " + node.module_path.string());
+            if (!is_safe_symlink(module_path, fs::path("/"))) {
+                LOG_ERROR("Unsafe symlink detected: " + module_path.string());
                 g_mount_stats.failed_mounts++;
                 return false;
             }
 
-            fs::create_symlink(link_target, work_dir_path);
-            clone_attr(node.module_path, work_dir_path);
+            const std::string name = work_dir_path.filename().string();
+            const char* at = at_name(dir_fd, work_dir_path, name);
+            if (symlinkat(link_target.c_str(), dir_fd, at) != 0) {
+                LOG_ERROR("Failed to create symlink: " + work_dir_path.string() + ": " +
+                          strerror(errno));
+                g_mount_stats.failed_mounts++;
+                return false;
+            }
+            clone_attr_at(AT_FDCWD, module_path.c_str(), dir_fd, at);
             g_mount_stats.successful_mounts++;
         } catch (...) {
             g_mount_stats.failed_mounts++;
@@ -434,22 +697,29 @@ static bool mount_symlink(const fs::path& work_dir_path, const Node& node) {
     return true;
 }
 
-static bool create_whiteout(const fs::path& target_path, const fs::path& work_dir_path) {
+// `src_dir_fd`/`dir_fd` are the real and skeleton parents (or AT_FDCWD)
+static bool create_whiteout(const fs::path& target_path, const fs::path& work_dir_path,
+                            int src_dir_fd, int dir_fd) {
     try {
-        fs::create_directories(work_dir_path.parent_path());
+        if (dir_fd == AT_FDCWD) {
+            fs::create_directories(work_dir_path.parent_path());
+        }
 
-        if (fs::exists(work_dir_path)) {
-            fs::remove(work_dir_path);
+        const std::string name = work_dir_path.filename().string();
+        const char* src_at = at_name(src_dir_fd, target_path, name);
+        const char* at = at_name(dir_fd, work_dir_path, name);
+        if (unlinkat(dir_fd, at, 0) != 0 && errno == EISDIR) {
+            unlinkat(dir_fd, at, AT_REMOVEDIR);
         }
 
-        if (mknod(work_dir_path.c_str(), S_IFCHR | 0000, makedev(0, 0)) != 0) {
+        if (mknodat(dir_fd, at, S_IFCHR | 0000, makedev(0, 0)) != 0) {
             LOG_ERROR("Failed to create whiteout: " + work_dir_path.string() + ": " +
                       strerror(errno));
             return false;
         }
 
-        if (fs::exists(target_path)) {
-            clone_attr(target_path, work_dir_path);
+        if (faccessat(src_dir_fd, src_at, F_OK, 0) == 0) {
+            clone_attr_at(src_dir_fd, src_at, dir_fd, at);
         } else {
             copy_path_context(work_dir_path.parent_path(), work_dir_path);
         }
@@ -462,65 +732,29 @@ static bool create_whiteout(const fs::path& target_path, const fs::path& work_di
     }
 }
 
-static bool do_magic_mount(const fs::path& path, const fs::path& work_dir_path, const Node& current,
-                           bool has_tmpfs, bool disable_umount);
-
-static bool mount_directory_children(const fs::path& path, const fs::path& work_dir_path,
-                                     const Node& node, bool has_tmpfs, bool disable_umount) {
-    bool ok = true;
-    if (fs::exists(path) && !node.replace) {
-        try {
-            for (const auto& entry : fs::directory_iterator(path)) {
-                std::string name = entry.path().filename().string();
-                auto it = node.children.find(name);
-                if (it != node.children.end()) {
-                    if (!it->second.skip) {
-                        if (!do_magic_mount(path, work_dir_path, it->second, has_tmpfs,
-                                            disable_umount)) {
-                            ok = false;
-                        }
-                    }
-                } else if (has_tmpfs) {
-                    if (!mount_mirror(path, work_dir_path, name)) {
-                        ok = false;
-                    }
-                }
-            }
-        } catch (...) {
-            LOG_WARN("Failed to iterate directory: " + path.string());
-            ok = false;
-        }
-    }
-
-    for (const auto& [name, child_node] : node.children) {
-        if (child_node.skip) {
-            continue;
-        }
-
-        fs::path real_path = path / name;
-        bool processed_in_first_loop = fs::exists(real_path) && !node.replace;
-
-        if (!processed_in_first_loop) {
-            if (!do_magic_mount(path, work_dir_path, child_node, has_tmpfs, disable_umount)) {
-                ok = false;
-            }
-        }
+// Attributes of a directory created in the work tree: from the real one when it exists,
+// else from the module's
+static void clone_dir_attr(int src_dir_fd, const char* src_at, const Node& node, int dst_dir_fd,
+                           const char* dst_at) {
+    if (faccessat(src_dir_fd, src_at, F_OK, 0) == 0) {
+        clone_attr_at(src_dir_fd, src_at, dst_dir_fd, dst_at);
+    } else {
+        const std::string module_path(node.module_path);
+        clone_attr_at(AT_FDCWD, module_path.c_str(), dst_dir_fd, dst_at);
     }
-
-    return ok;
 }
 
-static bool should_create_tmpfs(const Node& node, const fs::path& path, bool has_tmpfs) {
-    if (has_tmpfs) {
-        return true;
-    }
-
+// The directory cannot keep its real contents: it is replaced, or a module entry is new,
+// changes type or is a symlink, or a whiteout hides an existing entry
+static bool needs_tmpfs(const NodeTree& tree, NodeId id, const fs::path& path) {
+    const Node& node = tree[id];
     if (node.replace) {
-        return fs::exists(path) || !node.module_path.empty();
+        return true;
     }
 
-    for (const auto& [name, child] : node.children) {
-        fs::path real_path = path / name;
+    for (NodeId c = node.first_child; c != kNoNode; c = tree[c].next_sibling) {
+        const Node& child = tree[c];
+        fs::path real_path = path / child.name;
 
         bool need = false;
         if (child.file_type == NodeFileType::Symlink) {
@@ -541,10 +775,6 @@ static bool should_create_tmpfs(const Node& node, const fs::path& path, bool has
         }
 
         if (need) {
-            if (node.module_path.empty() && !fs::exists(path)) {
-                LOG_ERROR("Cannot create tmpfs on " + path.string() + " (no source)");
-                return false;
-            }
             return true;
         }
     }
@@ -552,18 +782,285 @@ static bool should_create_tmpfs(const Node& node, const fs::path& path, bool has
     return false;
 }
 
+enum class DirStrategy : uint8_t {
+    Direct,     // Real placement: children are bound over the real directory
+    Skeleton,   // A tmpfs copy is built entry by entry (the real path gets one tmpfs mount)
+    BindPatch,  // Inside a skeleton: the real directory is bound whole, files bound on top
+};
+
+struct MagicPlan {
+    std::vector<DirStrategy> real;      // By NodeId: strategy of a directory in Real placement
+    std::vector<DirStrategy> skeleton;  // ... and of one inside a skeleton
+    long mounts = 0;                    // Predicted for the whole tree
+};
+
+// Counts the mounts (mountinfo entries) each strategy would leave for every directory node
+// and picks the cheapest per node. The cost of a subtree only depends on the placement it is
+// reached in, so taking the minimum bottom-up gives the cheapest tree overall.
+class MagicPlanner {
+public:
+    MagicPlanner(const NodeTree& tree, const MagicMountOptions& opts)
+        : tree_(tree),
+          opts_(opts),
+          real_cost_(tree.size(), kUnknown),
+          skeleton_cost_(tree.size(), kUnknown),
+          patch_cost_(tree.size(), kUnknown) {
+        plan_.real.assign(tree.size(), DirStrategy::Direct);
+        plan_.skeleton.assign(tree.size(), DirStrategy::Skeleton);
+    }
+
+    MagicPlan plan(NodeId root, const fs::path& path) {
+        plan_.mounts = real_cost(root, path);
+        return std::move(plan_);
+    }
+
+private:
+    static constexpr long kUnknown = -2;
+    static constexpr long kImpossible = -1;
+
+    // Real placement: min(bind the children in place, build a skeleton here)
+    long real_cost(NodeId id, const fs::path& path) {
+        if (real_cost_[id] != kUnknown) {
+            return real_cost_[id];
+        }
+        const Node& node = tree_[id];
+        long direct = 0;
+        for (NodeId c = node.first_child; c != kNoNode; c = tree_[c].next_sibling) {
+            direct += child_cost(c, path / tree_[c].name, Placement::Real);
+        }
+
+        // A skeleton is also worth it when not needed: it absorbs the tmpfs mounts its
+        // subdirectories would need on their own, e.g. several modified apps under /system/app
+        const bool needed = needs_tmpfs(tree_, id, path);
+        long cost = direct;
+        if (path != "/" && (fs::exists(path) || !node.module_path.empty())) {
+            const long skeleton = 1 + skeleton_cost(id, path);
+            if (needed || skeleton < direct) {
+                plan_.real[id] = DirStrategy::Skeleton;
+                cost = skeleton;
+            }
+        } else if (needed && !node.replace) {
+            LOG_ERROR("Cannot create tmpfs on " + path.string() + " (no source)");
+        }
+        real_cost_[id] = cost;
+        return cost;
+    }
+
+    // Skeleton placement: mirrored real entries plus the module entries
+    long skeleton_cost(NodeId id, const fs::path& path) {
+        if (skeleton_cost_[id] != kUnknown) {
+            return skeleton_cost_[id];
+        }
+        const Node& node = tree_[id];
+        long cost = node.replace ? 0 : mirror_cost(id, path);
+        for (NodeId c = node.first_child; c != kNoNode; c = tree_[c].next_sibling) {
+            cost += child_cost(c, path / tree_[c].name, Placement::Skeleton);
+        }
+        skeleton_cost_[id] = cost;
+        return cost;
+    }
+
+    // Patch placement: file binds over a bind of the real directory; kImpossible when some
+    // entry below would have to be created
+    long patch_cost(NodeId id, const fs::path& path) {
+        if (patch_cost_[id] != kUnknown) {
+            return patch_cost_[id];
+        }
+        const Node& node = tree_[id];
+        long cost = kImpossible;
+        if (!node.replace && fs::is_directory(path) && !fs::is_symlink(path) &&
+            !needs_tmpfs(tree_, id, path)) {
+            cost = 0;
+            for (NodeId c = node.first_child; c != kNoNode; c = tree_[c].next_sibling) {
+                const long child = child_cost(c, path / tree_[c].name, Placement::Patch);
+                if (child == kImpossible) {
+                    cost = kImpossible;
+                    break;
+                }
+                cost += child;
+            }
+        }
+        patch_cost_[id] = cost;
+        return cost;
+    }
+
+    long child_cost(NodeId id, const fs::path& path, Placement placement) {
+        const Node& node = tree_[id];
+        if (node.skip) {
+            return 0;
+        }
+        switch (node.file_type) {
+        case NodeFileType::RegularFile:
+            return node.module_path.empty() ? 0 : 1;
+        case NodeFileType::Symlink:
+            // Created in a skeleton, bound anywhere else
+            return placement == Placement::Skeleton || node.module_path.empty() ? 0 : 1;
+        case NodeFileType::Whiteout:
+            return 0;
+        case NodeFileType::Directory:
+            break;
+        }
+
+        if (placement == Placement::Real) {
+            return real_cost(id, path);
+        }
+        if (placement == Placement::Patch) {
+            return patch_cost(id, path);
+        }
+        const long skeleton = skeleton_cost(id, path);
+        const long patch = patch_cost(id, path);
+        if (patch != kImpossible && 1 + patch < skeleton) {
+            plan_.skeleton[id] = DirStrategy::BindPatch;
+            return 1 + patch;
+        }
+        return skeleton;
+    }
+
+    // Binds mount_mirror makes for the real entries that have no module node
+    long mirror_cost(NodeId id, const fs::path& path) {
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+            return 0;
+        }
+        const int fd = dirfd(dir);
+        long cost = 0;
+        while (struct dirent* entry = readdir(dir)) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+                tree_.child(id, entry->d_name) != kNoNode) {
+                continue;
+            }
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type == DT_REG) {
+                cost++;
+            } else if (type == DT_DIR) {
+                cost += opts_.bind_subtrees ? std::min(count_mirror_binds(fd, entry->d_name, 1), 1)
+                                            : count_mirror_binds(fd, entry->d_name);
+            }
+        }
+        closedir(dir);
+        return cost;
+    }
+
+    const NodeTree& tree_;
+    const MagicMountOptions& opts_;
+    std::vector<long> real_cost_;
+    std::vector<long> skeleton_cost_;
+    std::vector<long> patch_cost_;
+    MagicPlan plan_;
+};
+
+static bool do_magic_mount(const fs::path& path, const fs::path& work_dir_path, int dir_fd,
+                           int src_dir_fd, const NodeTree& tree, NodeId current,
+                           Placement placement, const MagicPlan& plan,
+                           const MagicMountOptions& opts);
+
+static bool mount_directory_children(const fs::path& path, const fs::path& work_dir_path,
+                                     const NodeTree& tree, NodeId id, Placement placement,
+                                     const MagicPlan& plan, const MagicMountOptions& opts) {
+    const Node& node = tree[id];
+    bool ok = true;
+
+    // Children are created and bound relative to this fd. It is opened only now, so it sees
+    // the skeleton or patch bind already mounted on the work path.
+    const fs::path& target_dir = placement == Placement::Real ? path : work_dir_path;
+    int dir_fd = open(target_dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) {
+        dir_fd = AT_FDCWD;
+    }
+
+    // The real directory, which entries are mirrored and attributes cloned from. In Real
+    // placement it is the target itself.
+    int src_fd = placement == Placement::Real
+                     ? dir_fd
+                     : open(path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (src_fd < 0) {
+        src_fd = AT_FDCWD;
+    }
+
+    // Only a skeleton needs the untouched entries; elsewhere they are already visible
+    const bool mirror = placement == Placement::Skeleton && !node.replace && fs::exists(path);
+    if (mirror) {
+        try {
+            for (const auto& entry : fs::directory_iterator(path)) {
+                std::string name = entry.path().filename().string();
+                const NodeId child = tree.child(id, name);
+                if (child != kNoNode) {
+                    if (!tree[child].skip) {
+                        if (!do_magic_mount(path, work_dir_path, dir_fd, src_fd, tree, child,
+                                            placement, plan, opts)) {
+                            ok = false;
+                        }
+                    }
+                } else if (!mount_mirror(path, work_dir_path, src_fd, dir_fd, name, opts)) {
+                    ok = false;
+                }
+            }
+        } catch (...) {
+            LOG_WARN("Failed to iterate directory: " + path.string());
+            ok = false;
+        }
+    }
+
+    for (NodeId child = node.first_child; child != kNoNode; child = tree[child].next_sibling) {
+        if (tree[child].skip) {
+            continue;
+        }
+
+        bool processed_in_first_loop = mirror && fs::exists(path / tree[child].name);
+
+        if (!processed_in_first_loop) {
+            if (!do_magic_mount(path, work_dir_path, dir_fd, src_fd, tree, child, placement,
+                                plan, opts)) {
+                ok = false;
+            }
+        }
+    }
+
+    if (src_fd != AT_FDCWD && src_fd != dir_fd) {
+        close(src_fd);
+    }
+    if (dir_fd != AT_FDCWD) {
+        close(dir_fd);
+    }
+    return ok;
+}
+
+// `src_dir_fd` is the real parent of `path` (or AT_FDCWD)
 static bool prepare_tmpfs_dir(const fs::path& path, const fs::path& work_dir_path,
-                              const Node& node) {
+                              int src_dir_fd, const Node& node) {
     try {
-        fs::create_directories(work_dir_path);
-
-        if (!fs::exists(path) && node.module_path.empty()) {
+        const std::string name = path.filename().string();
+        const char* src_at = at_name(src_dir_fd, path, name);
+        if (faccessat(src_dir_fd, src_at, F_OK, 0) != 0 && node.module_path.empty()) {
             LOG_ERROR("No source for tmpfs skeleton: " + path.string());
             return false;
         }
 
-        fs::path src_path = fs::exists(path) ? path : node.module_path;
-        clone_attr(src_path, work_dir_path);
+        const fs::path work_parent = work_dir_path.parent_path();
+        fs::create_directories(work_parent);
+        int work_fd = open(work_parent.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (work_fd < 0) {
+            work_fd = AT_FDCWD;
+        }
+        const char* at = at_name(work_fd, work_dir_path, name);
+        if (mkdirat(work_fd, at, 0755) != 0 && errno != EEXIST) {
+            LOG_ERROR("Failed to create directory: " + work_dir_path.string());
+            if (work_fd != AT_FDCWD) {
+                close(work_fd);
+            }
+            return false;
+        }
+        clone_dir_attr(src_dir_fd, src_at, node, work_fd, at);
+        if (work_fd != AT_FDCWD) {
+            close(work_fd);
+        }
 
         mount(work_dir_path.c_str(), work_dir_path.c_str(), nullptr, MS_BIND | MS_REC, nullptr);
     } catch (...) {
@@ -574,63 +1071,90 @@ static bool prepare_tmpfs_dir(const fs::path& path, const fs::path& work_dir_pat
 }
 
 static bool finalize_tmpfs_overlay(const fs::path& path, const fs::path& work_dir_path,
-                                   bool disable_umount) {
+                                   const MagicMountOptions& opts) {
     mount(nullptr, work_dir_path.c_str(), nullptr, MS_REMOUNT | MS_RDONLY | MS_BIND, nullptr);
     mount(work_dir_path.c_str(), path.c_str(), nullptr, MS_MOVE, nullptr);
     // MS_SLAVE to avoid MOUNT_PROPAGATION detection (private = Magisk Hide indicator). Source
     // "none" for propagation-only.
     mount("none", path.c_str(), nullptr, MS_SLAVE, nullptr);
 
-    if (!disable_umount) {
+    if (!opts.disable_umount) {
         send_unmountable(path);
     }
 
+    g_mount_stats.actual_mounts++;
     LOG_VERBOSE("Finalized tmpfs overlay: " + work_dir_path.string() + " -> " + path.string());
     return true;
 }
 
-static bool do_magic_mount(const fs::path& path, const fs::path& work_dir_path, const Node& current,
-                           bool has_tmpfs, bool disable_umount) {
+// `dir_fd` is the directory entries are created in (see mount_directory_children) and
+// `src_dir_fd` the real parent; AT_FDCWD for either means full paths
+static bool do_magic_mount(const fs::path& path, const fs::path& work_dir_path, int dir_fd,
+                           int src_dir_fd, const NodeTree& tree, NodeId id, Placement placement,
+                           const MagicPlan& plan, const MagicMountOptions& opts) {
+    const Node& current = tree[id];
     fs::path target_path = path / current.name;
     fs::path target_work_path = work_dir_path / current.name;
 
     switch (current.file_type) {
     case NodeFileType::RegularFile:
-        return mount_file(target_path, target_work_path, current, has_tmpfs, disable_umount);
+        return mount_file(target_path, target_work_path, dir_fd, current, placement, opts);
 
     case NodeFileType::Symlink:
-        if (has_tmpfs) {
-            return mount_symlink(target_work_path, current);
+        if (placement == Placement::Skeleton) {
+            return mount_symlink(target_work_path, dir_fd, current);
         } else {
-            return mount_file(target_path, target_work_path, current, has_tmpfs, disable_umount);
+            return mount_file(target_path, target_work_path, dir_fd, current, placement, opts);
         }
 
     case NodeFileType::Directory: {
         g_mount_stats.dirs_mounted++;
-        bool create_tmpfs = !has_tmpfs && should_create_tmpfs(current, target_path, false);
-        bool effective_tmpfs = has_tmpfs || create_tmpfs;
-
-        if (effective_tmpfs) {
-            if (create_tmpfs) {
-                if (!prepare_tmpfs_dir(target_path, target_work_path, current)) {
-                    g_mount_stats.failed_mounts++;
-                    return false;
-                }
-            } else if (has_tmpfs && !fs::exists(target_work_path)) {
-                fs::create_directory(target_work_path);
-                fs::path src_path = fs::exists(target_path) ? target_path : current.module_path;
-                clone_attr(src_path, target_work_path);
+        Placement children = placement;
+        bool create_tmpfs = false;
+
+        if (placement == Placement::Real && plan.real[id] == DirStrategy::Skeleton) {
+            if (!prepare_tmpfs_dir(target_path, target_work_path, src_dir_fd, current)) {
+                g_mount_stats.failed_mounts++;
+                return false;
+            }
+            create_tmpfs = true;
+            children = Placement::Skeleton;
+        } else if (placement == Placement::Skeleton &&
+                   plan.skeleton[id] == DirStrategy::BindPatch) {
+            // Untouched entries come with the bind; only module files go on top
+            if (mkdir(target_work_path.c_str(), 0755) != 0 && errno != EEXIST) {
+                LOG_ERROR("Failed to create directory: " + target_work_path.string());
+                g_mount_stats.failed_mounts++;
+                return false;
+            }
+            if (!mount_bind_modern(target_path, target_work_path, true)) {
+                g_mount_stats.failed_mounts++;
+                return false;
+            }
+            g_mount_stats.actual_mounts++;
+            LOG_VERBOSEF("Bind dir for patching: {} -> {}", target_path, target_work_path);
+            children = Placement::Patch;
+        } else if (placement == Placement::Skeleton) {
+            const std::string name = target_work_path.filename().string();
+            const char* at = at_name(dir_fd, target_work_path, name);
+            if (mkdirat(dir_fd, at, 0755) == 0) {
+                clone_dir_attr(src_dir_fd, at_name(src_dir_fd, target_path, name), current,
+                               dir_fd, at);
+            } else if (errno != EEXIST) {
+                LOG_ERROR("Failed to create directory: " + target_work_path.string());
+                g_mount_stats.failed_mounts++;
+                return false;
             }
         }
 
-        if (!mount_directory_children(target_path, target_work_path, current, effective_tmpfs,
-                                      disable_umount)) {
+        if (!mount_directory_children(target_path, target_work_path, tree, id, children, plan,
+                                      opts)) {
             g_mount_stats.failed_mounts++;
             return false;
         }
 
         if (create_tmpfs) {
-            if (!finalize_tmpfs_overlay(target_path, target_work_path, disable_umount)) {
+            if (!finalize_tmpfs_overlay(target_path, target_work_path, opts)) {
                 g_mount_stats.failed_mounts++;
                 return false;
             }
@@ -639,8 +1163,8 @@ static bool do_magic_mount(const fs::path& path, const fs::path& work_dir_path,
     }
 
     case NodeFileType::Whiteout:
-        if (has_tmpfs) {
-            if (!create_whiteout(target_path, target_work_path)) {
+        if (placement == Placement::Skeleton) {
+            if (!create_whiteout(target_path, target_work_path, src_dir_fd, dir_fd)) {
                 g_mount_stats.failed_mounts++;
                 return false;
             }
@@ -654,13 +1178,14 @@ static bool do_magic_mount(const fs::path& path, const fs::path& work_dir_path,
 
 bool mount_partitions(const fs::path& tmp_path, const std::vector<fs::path>& module_paths,
                       const std::string& mount_source,
-                      const std::vector<std::string>& extra_partitions, bool disable_umount) {
+                      const std::vector<std::string>& extra_partitions,
+                      const MagicMountOptions& options) {
     // KernelSU CRITICAL: use configured mount source (e.g. "KSU") so KernelSU can identify and
     // manage mounts.
     const std::string effective_source = mount_source.empty() ? "KSU" : mount_source;
 
-    Node* root = collect_all_modules(module_paths, extra_partitions);
-    if (!root) {
+    NodeTree tree;
+    if (!collect_all_modules(tree, module_paths, extra_partitions)) {
         LOG_INFO("No files to magic mount");
         return true;
     }
@@ -669,7 +1194,6 @@ bool mount_partitions(const fs::path& tmp_path, const std::vector<fs::path>& mod
 
     if (!mount_tmpfs(work_dir, effective_source.c_str())) {
         LOG_ERROR("Failed to create workdir tmpfs at " + work_dir.string());
-        delete root;
         return false;
     }
 
@@ -677,9 +1201,16 @@ bool mount_partitions(const fs::path& tmp_path, const std::vector<fs::path>& mod
     // "none" for propagation-only.
     mount("none", work_dir.c_str(), nullptr, MS_SLAVE, nullptr);
 
+    const MagicPlan plan = MagicPlanner(tree, options).plan(0, "/");
+    g_mount_stats.planned_mounts += static_cast<int>(plan.mounts);
+    const int mounts_before = g_mount_stats.actual_mounts;
+    const int files_before = g_mount_stats.files_mounted;
+    const int syscalls_before = g_mount_stats.file_syscalls;
+
     bool result = false;
     try {
-        result = do_magic_mount("/", work_dir, *root, false, disable_umount);
+        result = do_magic_mount("/", work_dir, AT_FDCWD, AT_FDCWD, tree, 0, Placement::Real,
+                                plan, options);
     } catch (const std::exception& e) {
         LOG_ERROR("Magic mount failed with exception: " + std::string(e.what()));
         result = false;
@@ -688,6 +1219,11 @@ bool mount_partitions(const fs::path& tmp_path, const std::vector<fs::path>& mod
         result = false;
     }
 
+    LOG_INFO("Magic mount: " + std::to_string(g_mount_stats.actual_mounts - mounts_before) +
+             " mounts made, " + std::to_string(plan.mounts) + " predicted");
+    LOG_DEBUGF("Magic mount: {} files, {} syscalls", g_mount_stats.files_mounted - files_before,
+               g_mount_stats.file_syscalls - syscalls_before);
+
     g_mount_stats.tmpfs_created++;
     if (umount2(work_dir.c_str(), MNT_DETACH) != 0) {
         LOG_WARN("Failed to umount workdir: " + work_dir.string() + ": " + strerror(errno));
@@ -700,15 +1236,13 @@ bool mount_partitions(const fs::path& tmp_path, const std::vector<fs::path>& mod
         LOG_WARN("Failed to remove workdir: " + work_dir.string() + ": " + e.what());
     }
 
-    delete root;
-
     save_mount_statistics();
 
     return result;
 }
 
 bool mount_partitions_auto(const fs::path& tmp_path, const std::vector<fs::path>& module_paths,
-                           const std::string& mount_source, bool disable_umount) {
+                           const std::string& mount_source, const MagicMountOptions& options) {
     // Automatically detect all partitions
     LOG_INFO("Detecting partitions from /proc/mounts");
     auto all_partitions = detect_partitions();
@@ -717,7 +1251,7 @@ bool mount_partitions_auto(const fs::path& tmp_path, const std::vector<fs::path>
     LOG_INFO("Detected " + std::to_string(all_partitions.size()) + " partitions, " +
              std::to_string(extra_partitions.size()) + " extra partitions");
 
-    return mount_partitions(tmp_path, module_paths, mount_source, extra_partitions, disable_umount);
+    return mount_partitions(tmp_path, module_paths, mount_source, extra_partitions, options);
 }
 
 MountStatistics get_mount_statistics() {
@@ -748,6 +1282,11 @@ MountStatistics get_mount_statistics() {
             stats.dirs_mounted = get_int("dirs_mounted");
             stats.symlinks_created = get_int("symlinks_created");
             stats.overlayfs_mounts = get_int("overlayfs_mounts");
+            stats.subtree_binds = get_int("subtree_binds");
+            stats.mounts_saved = get_int("mounts_saved");
+            stats.planned_mounts = get_int("planned_mounts");
+            stats.actual_mounts = get_int("actual_mounts");
+            stats.file_syscalls = get_int("file_syscalls");
         } catch (...) {
             // Return zeros on parse error
         }
@@ -771,7 +1310,12 @@ void save_mount_statistics() {
          << "  \"files_mounted\": " << g_mount_stats.files_mounted << ",\n"
          << "  \"dirs_mounted\": " << g_mount_stats.dirs_mounted << ",\n"
          << "  \"symlinks_created\": " << g_mount_stats.symlinks_created << ",\n"
-         << "  \"overlayfs_mounts\": " << g_mount_stats.overlayfs_mounts << "\n"
+         << "  \"overlayfs_mounts\": " << g_mount_stats.overlayfs_mounts << ",\n"
+         << "  \"subtree_binds\": " << g_mount_stats.subtree_binds << ",\n"
+         << "  \"mounts_saved\": " << g_mount_stats.mounts_saved << ",\n"
+         << "  \"planned_mounts\": " << g_mount_stats.planned_mounts << ",\n"
+         << "  \"actual_mounts\": " << g_mount_stats.actual_mounts << ",\n"
+         << "  \"file_syscalls\": " << g_mount_stats.file_syscalls << "\n"
          << "}\n";
 
     file.close();
@@ -19,6 +19,12 @@ struct MountStatistics {
     int dirs_mounted = 0;
     int symlinks_created = 0;
     int overlayfs_mounts = 0;  // OverlayFS partition mounts
+    int subtree_binds = 0;     // Untouched directories attached with one recursive bind
+    int mounts_saved = 0;      // Per-file mirror binds those replaced, minus the binds themselves
+                               // (at most 1024 files counted per directory)
+    int planned_mounts = 0;    // Magic mount: mounts the cost model predicted
+    int actual_mounts = 0;     // Magic mount: mounts actually made
+    int file_syscalls = 0;     // Magic mount: syscalls spent creating and binding module files
 
     // Calculate success rate
     double get_success_rate() const {
@@ -26,14 +32,22 @@ struct MountStatistics {
     }
 };
 
+struct MagicMountOptions {
+    bool disable_umount = false;
+    // In a tmpfs skeleton, attach an untouched sibling directory with one recursive bind
+    // instead of mirroring it entry by entry
+    bool bind_subtrees = true;
+};
+
 // Mount partitions using magic mount (recursive bind mount with tmpfs)
 bool mount_partitions(const fs::path& tmp_path, const std::vector<fs::path>& module_paths,
                       const std::string& mount_source,
-                      const std::vector<std::string>& extra_partitions, bool disable_umount);
+                      const std::vector<std::string>& extra_partitions,
+                      const MagicMountOptions& options);
 
 // Mount partitions with automatic partition detection
 bool mount_partitions_auto(const fs::path& tmp_path, const std::vector<fs::path>& module_paths,
-                           const std::string& mount_source, bool disable_umount);
+                           const std::string& mount_source, const MagicMountOptions& options);
 
 // Get mount statistics (for WebUI/debugging)
 MountStatistics get_mount_statistics();
@@ -5,11 +5,14 @@
 #include <sys/syscall.h>
 #include <sys/xattr.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cerrno>
 #include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <ctime>
 #include <thread>
+#include <vector>
 #include "../defs.hpp"
 #include "../utils.hpp"
 
@@ -25,24 +28,92 @@
 #define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
 #endif  // #ifndef MOVE_MOUNT_F_EMPTY_PATH
 
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif  // #ifndef OPEN_TREE_CLOEXEC
+
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#endif  // #ifndef MOUNT_ATTR_RDONLY
+
 namespace hymo {
 
+namespace {
+
+// Reused by every clone on this thread, so cloning a tree does not allocate per node
+struct XattrScratch {
+    std::vector<char> names = std::vector<char>(256);
+    std::vector<char> value = std::vector<char>(256);
+};
+
+thread_local XattrScratch t_xattr;
+
+// O_PATH handle on a node: symlinks and device nodes are opened as themselves, and
+// /proc/self/fd/N resolves to that same inode for the calls that take no fd
+struct PathFd {
+    int fd = -1;
+    std::string proc;
+
+    PathFd(int dir_fd, const char* name)
+        : fd(openat(dir_fd, name, O_PATH | O_NOFOLLOW | O_CLOEXEC)) {
+        if (fd >= 0) {
+            proc = "/proc/self/fd/" + std::to_string(fd);
+        }
+    }
+    ~PathFd() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    PathFd(const PathFd&) = delete;
+    PathFd& operator=(const PathFd&) = delete;
+};
+
+// Reads through get(buf, size) into `buf`, growing it only on ERANGE
+template <typename F>
+ssize_t read_xattr(std::vector<char>& buf, F get) {
+    for (;;) {
+        const ssize_t len = get(buf.data(), buf.size());
+        if (len >= 0 || errno != ERANGE) {
+            return len;
+        }
+        const ssize_t need = get(nullptr, 0);
+        if (need < 0) {
+            return need;
+        }
+        buf.resize(std::max(buf.size() * 2, static_cast<size_t>(need)));
+    }
+}
+
+}  // namespace
+
 bool clone_attr(const fs::path& source, const fs::path& target) {
+    return clone_attr_at(AT_FDCWD, source.c_str(), AT_FDCWD, target.c_str());
+}
+
+bool clone_attr_at(int src_dir_fd, const char* src_name, int dst_dir_fd, const char* dst_name) {
+    const PathFd src(src_dir_fd, src_name);
     struct stat st;
-    if (lstat(source.c_str(), &st) != 0) {
-        LOG_ERROR("Failed to stat source: " + source.string() + " - " + strerror(errno));
+    if (src.fd < 0 || fstatat(src.fd, "", &st, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) != 0) {
+        LOG_ERROR("Failed to stat source: " + std::string(src_name) + " - " + strerror(errno));
+        return false;
+    }
+
+    const PathFd dst(dst_dir_fd, dst_name);
+    if (dst.fd < 0) {
+        LOG_ERROR("Failed to open target: " + std::string(dst_name) + " - " + strerror(errno));
         return false;
     }
 
     // Set owner and group
-    if (lchown(target.c_str(), st.st_uid, st.st_gid) != 0) {
-        LOG_WARN("Failed to chown " + target.string() + ": " + strerror(errno));
+    if (fchownat(dst.fd, "", st.st_uid, st.st_gid, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) != 0) {
+        LOG_WARN("Failed to chown " + std::string(dst_name) + ": " + strerror(errno));
     }
 
     // Set permissions (for non-symlinks)
     if (!S_ISLNK(st.st_mode)) {
-        if (chmod(target.c_str(), st.st_mode & 07777) != 0) {
-            LOG_WARN("Failed to chmod " + target.string() + ": " + strerror(errno));
+        if (fchmodat(AT_FDCWD, dst.proc.c_str(), st.st_mode & 07777, 0) != 0) {
+            LOG_WARN("Failed to chmod " + std::string(dst_name) + ": " + strerror(errno));
         }
     }
 
@@ -51,56 +122,40 @@ bool clone_attr(const fs::path& source, const fs::path& target) {
     times[0] = st.st_atim;  // access time
     times[1] = st.st_mtim;  // modification time
 
-    if (utimensat(AT_FDCWD, target.c_str(), times, AT_SYMLINK_NOFOLLOW) != 0) {
-        LOG_WARN("Failed to set times on " + target.string() + ": " + strerror(errno));
+    if (utimensat(AT_FDCWD, dst.proc.c_str(), times, 0) != 0) {
+        LOG_WARN("Failed to set times on " + std::string(dst_name) + ": " + strerror(errno));
     }
 
-#ifdef __ANDROID__
-    // Copy SELinux context only if source has one
-    ssize_t sel_len = lgetxattr(source.c_str(), SELINUX_XATTR, nullptr, 0);
-    if (sel_len > 0) {
-        std::string context;
-        context.resize(static_cast<size_t>(sel_len));
-        if (lgetxattr(source.c_str(), SELINUX_XATTR, context.data(), sel_len) > 0) {
-            if (!lsetfilecon(target, context)) {
-                LOG_WARN("Failed to set SELinux context on " + target.string() + ": " +
-                         strerror(errno));
-            }
-        } else {
-            LOG_WARN("Failed to read SELinux context from " + source.string() + ": " +
-                     strerror(errno));
+    // Copy extended attributes, SELinux context included, through the fd links
+    XattrScratch& scratch = t_xattr;
+    const ssize_t list_size = read_xattr(scratch.names, [&](char* buf, size_t size) {
+        return listxattr(src.proc.c_str(), buf, size);
+    });
+
+    const char* list = scratch.names.data();
+    for (const char* name = list; list_size > 0 && name < list + list_size;
+         name += strlen(name) + 1) {
+#ifndef __ANDROID__
+        // Only meaningful (and settable) with Android's policy
+        if (strcmp(name, SELINUX_XATTR) == 0) {
+            continue;
+        }
+#endif  // #ifndef __ANDROID__
+
+        const ssize_t val_size = read_xattr(scratch.value, [&](char* buf, size_t size) {
+            return getxattr(src.proc.c_str(), name, buf, size);
+        });
+        if (val_size < 0) {
+            LOG_WARN("Failed to read xattr " + std::string(name) + " from " +
+                     std::string(src_name) + ": " + strerror(errno));
+            continue;
         }
-    }
-#endif  // #ifdef __ANDROID__
-
-    // Copy extended attributes (except security.selinux which we already copied)
-    char* list = nullptr;
-    ssize_t list_size = llistxattr(source.c_str(), nullptr, 0);
-
-    if (list_size > 0) {
-        list = new char[list_size];
-        if (llistxattr(source.c_str(), list, list_size) > 0) {
-            for (char* name = list; name < list + list_size; name += strlen(name) + 1) {
-                // Skip security.selinux as we already copied it with lgetfilecon
-                if (strcmp(name, "security.selinux") == 0) {
-                    continue;
-                }
 
-                // Get xattr value
-                ssize_t val_size = lgetxattr(source.c_str(), name, nullptr, 0);
-                if (val_size > 0) {
-                    char* value = new char[val_size];
-                    if (lgetxattr(source.c_str(), name, value, val_size) > 0) {
-                        if (lsetxattr(target.c_str(), name, value, val_size, 0) != 0) {
-                            LOG_WARN("Failed to set xattr " + std::string(name) + " on " +
-                                     target.string() + ": " + strerror(errno));
-                        }
-                    }
-                    delete[] value;
-                }
-            }
+        if (setxattr(dst.proc.c_str(), name, scratch.value.data(),
+                     static_cast<size_t>(val_size), 0) != 0) {
+            LOG_WARN("Failed to set xattr " + std::string(name) + " on " +
+                     std::string(dst_name) + ": " + strerror(errno));
         }
-        delete[] list;
     }
 
     return true;
@@ -150,6 +205,57 @@ bool mount_bind_modern(const fs::path& source, const fs::path& target, bool recu
     return false;
 }
 
+// struct mount_attr from linux/mount.h, which not every libc exposes
+struct MountAttr {
+    uint64_t attr_set;
+    uint64_t attr_clr;
+    uint64_t propagation;
+    uint64_t userns_fd;
+};
+
+bool mount_bind_file_ro_at(const fs::path& source, int dir_fd, const char* name, int* syscalls) {
+    int calls = 0;
+    bool ok = false;
+
+#if defined(__NR_open_tree) && defined(__NR_mount_setattr)
+    // The clone is made read-only before it is attached, so no remount is needed afterwards
+    int tree_fd = syscall(__NR_open_tree, AT_FDCWD, source.c_str(),
+                          OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC);
+    calls++;
+    if (tree_fd >= 0) {
+        MountAttr attr = {};
+        attr.attr_set = MOUNT_ATTR_RDONLY;
+        calls++;
+        if (syscall(__NR_mount_setattr, tree_fd, "", AT_EMPTY_PATH, &attr, sizeof(attr)) == 0) {
+            calls++;
+            ok = syscall(__NR_move_mount, tree_fd, "", dir_fd, name, MOVE_MOUNT_F_EMPTY_PATH) ==
+                 0;
+        }
+        close(tree_fd);
+        calls++;
+    }
+#endif  // #if defined(__NR_open_tree) && defined(__NR_mount_setattr)
+
+    if (!ok) {
+        // Path-based fallback; the directory fd is reached through procfs
+        std::string target = name;
+        if (dir_fd != AT_FDCWD) {
+            target = "/proc/self/fd/" + std::to_string(dir_fd) + "/" + name;
+        }
+        calls++;
+        if (mount(source.c_str(), target.c_str(), nullptr, MS_BIND, nullptr) == 0) {
+            calls++;
+            mount(nullptr, target.c_str(), nullptr, MS_REMOUNT | MS_RDONLY | MS_BIND, nullptr);
+            ok = true;
+        }
+    }
+
+    if (syscalls) {
+        *syscalls += calls;
+    }
+    return ok;
+}
+
 bool mount_with_retry(const char* source, const char* target, const char* filesystemtype,
                       unsigned long mountflags, const void* data, int max_retries) {
     for (int attempt = 0; attempt < max_retries; ++attempt) {
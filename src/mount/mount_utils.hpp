@@ -19,11 +19,23 @@ namespace hymo {
 // Includes: owner, permissions, timestamps, SELinux context, xattrs
 bool clone_attr(const fs::path& source, const fs::path& target);
 
+// Same, with names relative to directory fds (or AT_FDCWD): each side is opened once with
+// O_PATH and every attribute, xattrs included, is read and set through that fd, so cloning
+// the entries of one directory resolves each name once
+bool clone_attr_at(int src_dir_fd, const char* src_name, int dst_dir_fd, const char* dst_name);
+
 // Modern mount using open_tree + move_mount (kernel 5.2+)
 // Falls back to traditional mount on failure
 // Note: This function does NOT log - caller should log appropriately
 bool mount_bind_modern(const fs::path& source, const fs::path& target, bool recursive = true);
 
+// Read-only bind of a single file onto `name` relative to `dir_fd` using open_tree +
+// mount_setattr + move_mount (kernel 5.12+); falls back to bind + remount on failure.
+// Adds the syscalls issued to *syscalls when given.
+// Note: This function does NOT log - caller should log appropriately
+bool mount_bind_file_ro_at(const fs::path& source, int dir_fd, const char* name,
+                           int* syscalls = nullptr);
+
 // Mount with automatic retry and fallback
 bool mount_with_retry(const char* source, const char* target, const char* filesystemtype,
                       unsigned long mountflags, const void* data, int max_retries = 3);
@@ -259,7 +259,7 @@ static std::string get_mirror_path(const std::string& target_root) {
 }
 
 bool bind_mount(const fs::path& from, const fs::path& to, bool disable_umount) {
-    LOG_DEBUG("bind mount " + from.string() + " -> " + to.string());
+    LOG_DEBUGF("bind mount {} -> {}", from, to);
 
     // Use OPEN_TREE_CLOEXEC instead of FSOPEN_CLOEXEC
     int tree_fd =
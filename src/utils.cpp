@@ -5,78 +5,357 @@
 #include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/wait.h>
 #include <sys/xattr.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstring>
 #include <ctime>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <set>
 #include <sstream>
+#include <thread>
 #include <vector>
 #include "defs.hpp"
 
 extern char** environ;
 
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif  // #ifndef FICLONE
+
 namespace hymo {
 
 // Logger implementation
+namespace {
+
+constexpr size_t kLogBatchBytes = 256 * 1024;
+constexpr auto kLogIdleWait = std::chrono::milliseconds(100);
+constexpr int kLogCrashSignals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+
+// Cleared by ~Logger so a late signal does not touch a destroyed ring
+std::atomic<Logger*> g_crash_logger{nullptr};
+
+const char* const kLogLevelNames[] = {"VERBOSE", "DEBUG", "INFO", "WARN", "ERROR"};
+
+const char* log_level_name(LogLevel level) {
+    return kLogLevelNames[static_cast<size_t>(level)];
+}
+
+void append_log_line(std::string& out, const char* time_buf, LogLevel level,
+                     std::string_view message) {
+    out += '[';
+    out += time_buf;
+    out += "] [";
+    out += log_level_name(level);
+    out += "] ";
+    out += message;
+    out += '\n';
+}
+
+// Async-signal-safe
+void write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        const ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+
+void write_all(int fd, const char* str) {
+    write_all(fd, str, strlen(str));
+}
+
+// Async-signal-safe; localtime is not, so crash lines carry the epoch
+void write_number(int fd, uint64_t value) {
+    char buf[24];
+    size_t pos = sizeof(buf);
+    do {
+        buf[--pos] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    write_all(fd, buf + pos, sizeof(buf) - pos);
+}
+
+}  // namespace
+
 Logger& Logger::getInstance() {
     static Logger instance;
     return instance;
 }
 
+Logger::Logger() : ring_(std::make_unique<Slot[]>(kRingSize)) {
+    for (size_t i = 0; i < kRingSize; ++i) {
+        ring_[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+Logger::~Logger() {
+    g_crash_logger.store(nullptr);
+    stop_writer();
+    if (log_fd_ >= 0)
+        close(log_fd_);
+}
+
 void Logger::init(bool debug, bool verbose) {
     debug_ = debug;
     verbose_ = verbose;
+    start_writer();
 }
 
 void Logger::init(bool debug, bool verbose, const char* log_path) {
     debug_ = debug;
     verbose_ = verbose;
     if (log_path && *log_path) {
+        // Everything queued so far belongs to the previous file
+        stop_writer();
+        if (log_fd_ >= 0) {
+            close(log_fd_);
+            log_fd_ = -1;
+        }
         try {
             fs::path p(log_path);
             const fs::path parent = p.parent_path();
             if (!parent.empty()) {
                 ensure_dir_exists(parent);
             }
-            // Always append: short-lived commands (getFeatures, getStatus, etc.) run in separate
-            // processes; trunc would clear the log every time the Manager refreshes.
-            log_file_ = std::make_unique<std::ofstream>(log_path, std::ios::app);
-            if (!log_file_->is_open()) {
-                log_file_.reset();
-            }
         } catch (...) {
-            log_file_.reset();
         }
+        // Always append: short-lived commands (getFeatures, getStatus, etc.) run in separate
+        // processes; trunc would clear the log every time the Manager refreshes.
+        log_fd_ = open(log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
     }
+    start_writer();
 }
 
-void Logger::log(const std::string& level, const std::string& message) {
-    if (level == "VERBOSE" && !verbose_)
+void Logger::log(LogLevel level, std::string_view message) {
+    if (!enabled(level))
         return;
-    if (level == "DEBUG" && !debug_)
+
+    if (running_.load(std::memory_order_acquire)) {
+        push(level, message);
         return;
+    }
 
+    // No writer thread (before init): write through
     auto now = std::time(nullptr);
-    char time_buf[64];
-    std::strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    char time_buf[32];
+    struct tm tm_buf;
+    std::strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &tm_buf));
+
+    std::string log_line;
+    append_log_line(log_line, time_buf, level, message);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_out(log_line);
+}
+
+void Logger::flush() {
+    if (!running_.load(std::memory_order_acquire))
+        return;
+    const size_t target = tail_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    wake_.notify_one();
+    written_cv_.wait(lock, [&] { return written_ >= target || stop_; });
+}
+
+// Bounded MPMC queue (Vyukov): a slot's seq says whose turn it is. seq == pos means free
+// for the producer of `pos`, seq == pos + 1 filled for the consumer of `pos`.
+bool Logger::push(LogLevel level, std::string_view message) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &ring_[pos & (kRingSize - 1)];
+        const size_t seq = slot->seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = tail_.load(std::memory_order_relaxed);
+        }
+    }
+    slot->time = std::time(nullptr);
+    slot->level = level;
+    slot->message.assign(message.data(), message.size());
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    // Pairs with the fence in writer_loop: either we see it idle or it sees the record
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writer_idle_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        wake_.notify_one();
+    }
+    return true;
+}
+
+template <typename F>
+bool Logger::pop(F&& consume) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = ring_[pos & (kRingSize - 1)];
+        const size_t seq = slot.seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                consume(slot);
+                slot.seq.store(pos + kRingSize, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Empty, or the next record is still being filled in
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::start_writer() {
+    if (running_.load(std::memory_order_acquire))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_ = false;
+    }
+    try {
+        writer_ = std::thread(&Logger::writer_loop, this);
+    } catch (const std::system_error&) {
+        return;  // Keep writing through
+    }
+    running_.store(true, std::memory_order_release);
+
+    static bool handlers_installed = false;
+    if (!handlers_installed) {
+        handlers_installed = true;
+        g_crash_logger.store(this);
+        struct sigaction sa = {};
+        sa.sa_handler = &Logger::crash_handler;
+        sa.sa_flags = SA_RESETHAND;
+        sigemptyset(&sa.sa_mask);
+        for (int sig : kLogCrashSignals) {
+            struct sigaction old = {};
+            // Leave handlers someone else installed alone
+            if (sigaction(sig, nullptr, &old) == 0 && old.sa_handler == SIG_DFL)
+                sigaction(sig, &sa, nullptr);
+        }
+    }
+}
 
-    std::string log_line = std::string("[") + time_buf + "] [" + level + "] " + message + "\n";
+void Logger::stop_writer() {
+    if (!running_.load(std::memory_order_acquire))
+        return;
+    running_.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    written_cv_.notify_all();
+    // Records pushed by callers that saw running_ just before it dropped
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain();
+}
+
+void Logger::writer_loop() {
+    for (;;) {
+        drain();
 
-    if (log_file_ && log_file_->is_open()) {
-        *log_file_ << log_line;
-        log_file_->flush();
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        written_ = head_.load(std::memory_order_relaxed);
+        written_cv_.notify_all();
+
+        auto pending = [this] {
+            const size_t pos = head_.load(std::memory_order_relaxed);
+            return ring_[pos & (kRingSize - 1)].seq.load(std::memory_order_acquire) == pos + 1;
+        };
+        if (pending())
+            continue;
+        if (stop_)
+            break;
+        writer_idle_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // The timeout only covers a producer that reserved a slot but has not filled it yet
+        wake_.wait_for(lock, kLogIdleWait, [&] { return stop_ || pending(); });
+        writer_idle_.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Logger::drain() {
+    auto append = [this](Slot& slot) {
+        if (slot.time != batch_time_) {
+            batch_time_ = slot.time;
+            struct tm tm_buf;
+            std::strftime(batch_time_buf_, sizeof(batch_time_buf_), "%Y-%m-%d %H:%M:%S",
+                          localtime_r(&batch_time_, &tm_buf));
+        }
+        append_log_line(batch_, batch_time_buf_, slot.level, slot.message);
+    };
+    for (;;) {
+        while (batch_.size() < kLogBatchBytes && pop(append)) {
+        }
+        const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != dropped_reported_) {
+            append_log_line(batch_, batch_time_buf_, LogLevel::Warn,
+                            "Logger: " + std::to_string(dropped - dropped_reported_) +
+                                " messages dropped (queue full)");
+            dropped_reported_ = dropped;
+        }
+        if (batch_.empty())
+            return;
+        write_out(batch_);
+        batch_.clear();
+    }
+}
+
+void Logger::write_out(const std::string& data) {
+    if (log_fd_ >= 0) {
+        write_all(log_fd_, data.data(), data.size());
     } else {
-        std::clog << log_line;
+        std::clog << data;
         std::clog.flush();
     }
 }
 
+// Writes what is still queued with plain write(2), then dies from the same signal. A batch
+// the writer thread already took off the ring is lost.
+void Logger::crash_handler(int sig) {
+    Logger* logger = g_crash_logger.exchange(nullptr);
+    if (logger) {
+        const int fd = logger->log_fd_ >= 0 ? logger->log_fd_ : STDERR_FILENO;
+        while (logger->pop([fd](Slot& slot) {
+            write_all(fd, "[@");
+            write_number(fd, static_cast<uint64_t>(slot.time));
+            write_all(fd, "] [");
+            write_all(fd, log_level_name(slot.level));
+            write_all(fd, "] ");
+            write_all(fd, slot.message.data(), slot.message.size());
+            write_all(fd, "\n");
+        })) {
+        }
+        write_all(fd, "[FATAL] Caught signal ");
+        write_number(fd, static_cast<uint64_t>(sig));
+        write_all(fd, "\n");
+    }
+    raise(sig);  // SA_RESETHAND restored the default action
+}
+
 // File system utilities
 bool ensure_dir_exists(const fs::path& path) {
     try {
@@ -100,6 +379,16 @@ bool lsetfilecon(const fs::path& path, const std::string& context) {
     return false;
 }
 
+bool fsetfilecon(int fd, const std::string& context) {
+#ifdef __ANDROID__
+    if (fsetxattr(fd, SELINUX_XATTR, context.c_str(), context.length(), 0) == 0) {
+        return true;
+    }
+    LOG_DEBUG("fsetfilecon failed for fd " + std::to_string(fd) + ": " + strerror(errno));
+#endif  // #ifdef __ANDROID__
+    return false;
+}
+
 std::string lgetfilecon(const fs::path& path) {
 #ifdef __ANDROID__
     char buf[256];
@@ -164,24 +453,6 @@ bool mount_tmpfs(const fs::path& target, const char* source) {
     return true;
 }
 
-bool has_files_recursive(const fs::path& path) {
-    if (!fs::exists(path) || !fs::is_directory(path)) {
-        return false;
-    }
-
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(path)) {
-            if (fs::is_regular_file(entry) || fs::is_symlink(entry)) {
-                return true;
-            }
-        }
-    } catch (...) {
-        return true;
-    }
-
-    return false;
-}
-
 // Forward declaration for loop device helper
 static int setup_loop_device(const std::string& image_path, std::string& loop_path, bool read_only);
 
@@ -410,9 +681,245 @@ bool repair_image(const fs::path& image_path) {
     return true;
 }
 
-static bool native_cp_r(const fs::path& src, const fs::path& dst) {
+// File copy backends, fastest first. A backend that fails before moving any data is
+// unsupported for that filesystem pair; the next one is tried and the choice is cached.
+enum class CopyMethod { Clone, CopyFileRange, Sendfile, ReadWrite };
+
+static std::mutex g_copy_method_mutex;
+static std::map<std::pair<dev_t, dev_t>, CopyMethod> g_copy_methods;
+
+static const char* copy_method_name(CopyMethod method) {
+    switch (method) {
+    case CopyMethod::Clone:
+        return "reflink";
+    case CopyMethod::CopyFileRange:
+        return "copy_file_range";
+    case CopyMethod::Sendfile:
+        return "sendfile";
+    default:
+        return "read/write";
+    }
+}
+
+// Errors meaning "this backend cannot be used here" rather than an I/O failure
+static bool is_copy_unsupported(int err) {
+    return err == EOPNOTSUPP || err == EXDEV || err == EINVAL || err == ENOSYS || err == ENOTTY;
+}
+
+// Move up to `len` bytes with a streaming backend; returns bytes copied or -1 with errno set.
+// Both file offsets advance, so another backend can pick up where this one stopped.
+static ssize_t copy_chunk(CopyMethod method, int src_fd, int dst_fd, size_t len) {
+    constexpr size_t CHUNK = 1 << 30;
+    len = std::min(len, CHUNK);
+    if (method == CopyMethod::CopyFileRange) {
+        return syscall(__NR_copy_file_range, src_fd, nullptr, dst_fd, nullptr, len, 0);
+    }
+    return sendfile(dst_fd, src_fd, nullptr, len);
+}
+
+static bool copy_read_write(int src_fd, int dst_fd) {
+    constexpr size_t BUF_SIZE = 1 << 20;
+    thread_local std::vector<char> buf(BUF_SIZE);
+    while (true) {
+        ssize_t n = read(src_fd, buf.data(), buf.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n == 0;
+        }
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(dst_fd, buf.data() + off, n - off);
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                return false;
+            }
+            off += w;
+        }
+    }
+}
+
+// Copy the whole of src_fd into an empty dst_fd using the best backend for the fs pair
+static bool copy_fd_data(int src_fd, const struct stat& src_st, int dst_fd, dev_t dst_dev) {
+    const auto key = std::make_pair(src_st.st_dev, dst_dev);
+    CopyMethod method = CopyMethod::Clone;
+    {
+        std::lock_guard<std::mutex> lock(g_copy_method_mutex);
+        auto it = g_copy_methods.find(key);
+        if (it != g_copy_methods.end()) {
+            method = it->second;
+        }
+    }
+    const CopyMethod cached = method;
+
+    auto demote = [&](CopyMethod next, int err) {
+        LOG_VERBOSE(std::string("copy: ") + copy_method_name(method) + " unsupported (" +
+                    strerror(err) + "), trying " + copy_method_name(next));
+        method = next;
+    };
+
+    bool ok = false;
+    if (method == CopyMethod::Clone) {
+        if (ioctl(dst_fd, FICLONE, src_fd) == 0) {
+            ok = true;
+        } else if (is_copy_unsupported(errno)) {
+            demote(CopyMethod::CopyFileRange, errno);
+        } else {
+            return false;
+        }
+    }
+
+    uint64_t remaining = static_cast<uint64_t>(src_st.st_size);
+    while (!ok && method != CopyMethod::ReadWrite) {
+        bool moved = false;
+        int err = 0;
+        while (remaining > 0) {
+            ssize_t n = copy_chunk(method, src_fd, dst_fd, remaining);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                err = n < 0 ? errno : 0;
+                break;
+            }
+            moved = true;
+            remaining -= static_cast<uint64_t>(n);
+        }
+        if (remaining == 0) {
+            ok = true;
+        } else if (moved) {
+            // Source changed size under us; finish with plain I/O and keep the cache as is
+            return copy_read_write(src_fd, dst_fd);
+        } else if (err == 0 || is_copy_unsupported(err)) {
+            demote(method == CopyMethod::CopyFileRange ? CopyMethod::Sendfile
+                                                       : CopyMethod::ReadWrite,
+                   err);
+        } else {
+            errno = err;
+            return false;
+        }
+    }
+
+    if (!ok) {
+        ok = copy_read_write(src_fd, dst_fd);
+    }
+
+    if (ok && method != cached) {
+        std::lock_guard<std::mutex> lock(g_copy_method_mutex);
+        g_copy_methods[key] = method;
+        LOG_DEBUG(std::string("copy: using ") + copy_method_name(method) + " for dev " +
+                  std::to_string(src_st.st_dev) + " -> " + std::to_string(dst_dev));
+    }
+    return ok;
+}
+
+// Copy a regular file with mode and SELinux context applied through the open fd
+static void copy_regular_file(const fs::path& src_path, const fs::path& dst_path) {
+    auto fail = [&](const char* what, int err) {
+        throw fs::filesystem_error(what, src_path, dst_path,
+                                   std::error_code(err, std::generic_category()));
+    };
+
+    int src_fd = open(src_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) {
+        fail("copy: open source", errno);
+    }
+    struct stat src_st;
+    if (fstat(src_fd, &src_st) != 0 || !S_ISREG(src_st.st_mode)) {
+        close(src_fd);
+        fail("copy: not a regular file", EINVAL);
+    }
+
+    // O_NOFOLLOW: a symlink left at dst by an older sync must be replaced, not have its
+    // target truncated
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW;
+    int dst_fd = open(dst_path.c_str(), flags, 0600);
+    if (dst_fd < 0 && errno != ENOENT) {
+        // Replace whatever is in the way: that symlink (ELOOP) or a read-only file
+        unlink(dst_path.c_str());
+        dst_fd = open(dst_path.c_str(), flags, 0600);
+    }
+    if (dst_fd < 0) {
+        const int err = errno;
+        close(src_fd);
+        fail("copy: open destination", err);
+    }
+
+    struct stat dst_st;
+    bool ok = fstat(dst_fd, &dst_st) == 0 && copy_fd_data(src_fd, src_st, dst_fd, dst_st.st_dev);
+    ok = ok && fchmod(dst_fd, src_st.st_mode & 07777) == 0;
+    int err = errno;
+    if (ok) {
+        fsetfilecon(dst_fd, get_context_for_path(dst_path));
+        // Keep the source mtime so rebuilt staging trees fingerprint identically
+        const struct timespec times[2] = {src_st.st_atim, src_st.st_mtim};
+        futimens(dst_fd, times);
+    }
+    close(src_fd);
+    if (close(dst_fd) != 0 && ok) {
+        ok = false;
+        err = errno;
+    }
+    if (!ok) {
+        fail("copy", err);
+    }
+}
+
+// Hardlink a regular file into a staging tree. Returns false when no link can be made
+// (different filesystem, link limit, protected_hardlinks) or when the staged path needs a
+// different SELinux context than the source has: the link shares the module file's inode,
+// which must never be relabelled, so the caller copies instead.
+static bool link_regular_file(const fs::path& src_path, const fs::path& dst_path) {
+    struct stat src_st, dst_st;
+    const bool linked = stat(src_path.c_str(), &src_st) == 0 &&
+                        lstat(dst_path.c_str(), &dst_st) == 0 &&
+                        src_st.st_dev == dst_st.st_dev && src_st.st_ino == dst_st.st_ino;
+
+    if (lgetfilecon(src_path) != get_context_for_path(dst_path)) {
+        // A link left by an earlier run must go, or the copy would write through it
+        if (linked) {
+            unlink(dst_path.c_str());
+        }
+        LOG_VERBOSEF("context differs for {}, copying", src_path);
+        return false;
+    }
+    if (linked) {
+        return true;
+    }
+
+    if (link(src_path.c_str(), dst_path.c_str()) != 0) {
+        if (errno != EEXIST) {
+            LOG_VERBOSEF("link failed for {} ({}), copying", src_path, strerror(errno));
+            return false;
+        }
+        if (unlink(dst_path.c_str()) != 0 || link(src_path.c_str(), dst_path.c_str()) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool native_cp_r(const fs::path& src, const fs::path& dst, bool hardlink);
+
+// Copy one non-directory entry (file or symlink) to dst_path
+static void copy_entry(const fs::path& src_path, const fs::path& dst_path, bool hardlink) {
+    if (fs::is_symlink(src_path)) {
+        auto link_target = fs::read_symlink(src_path);
+        if (fs::exists(dst_path)) {
+            fs::remove(dst_path);
+        }
+        fs::create_symlink(link_target, dst_path);
+        lsetfilecon(dst_path, get_context_for_path(dst_path));
+    } else if (!hardlink || !link_regular_file(src_path, dst_path)) {
+        copy_regular_file(src_path, dst_path);
+    }
+}
+
+static bool native_cp_r(const fs::path& src, const fs::path& dst, bool hardlink) {
     try {
-        LOG_DEBUG("native_cp_r: " + src.string() + " -> " + dst.string());
+        LOG_DEBUGF("native_cp_r: {} -> {}", src, dst);
 
         if (!fs::exists(dst)) {
             fs::create_directories(dst);
@@ -426,21 +933,12 @@ static bool native_cp_r(const fs::path& src, const fs::path& dst) {
             count++;
 
             if (fs::is_directory(entry)) {
-                if (!native_cp_r(entry.path(), dst_path)) {
+                if (!native_cp_r(entry.path(), dst_path, hardlink)) {
                     LOG_ERROR("Failed to copy dir: " + entry.path().string());
                     return false;
                 }
-            } else if (fs::is_symlink(entry)) {
-                auto link_target = fs::read_symlink(entry.path());
-                if (fs::exists(dst_path)) {
-                    fs::remove(dst_path);
-                }
-                fs::create_symlink(link_target, dst_path);
-                lsetfilecon(dst_path, get_context_for_path(dst_path));
             } else {
-                fs::copy_file(entry.path(), dst_path, fs::copy_options::overwrite_existing);
-                fs::permissions(dst_path, fs::status(entry.path()).permissions());
-                lsetfilecon(dst_path, get_context_for_path(dst_path));
+                copy_entry(entry.path(), dst_path, hardlink);
             }
         }
 
@@ -453,6 +951,36 @@ static bool native_cp_r(const fs::path& src, const fs::path& dst) {
     }
 }
 
+bool copy_tree(const fs::path& src, const fs::path& dst, bool hardlink) {
+    return native_cp_r(src, dst, hardlink);
+}
+
+bool copy_node(const fs::path& src, const fs::path& dst, bool hardlink) {
+    try {
+        copy_entry(src, dst, hardlink);
+        return true;
+    } catch (const std::exception& e) {
+        LOG_ERROR("copy_node failed (" + src.string() + " -> " + dst.string() +
+                  "): " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool copy_dir_files(const fs::path& src, const fs::path& dst, bool hardlink) {
+    try {
+        for (const auto& entry : fs::directory_iterator(src)) {
+            if (!fs::is_directory(entry)) {
+                copy_entry(entry.path(), dst / entry.path().filename(), hardlink);
+            }
+        }
+        return true;
+    } catch (const std::exception& e) {
+        LOG_ERROR("copy_dir_files failed (" + src.string() + " -> " + dst.string() +
+                  "): " + std::string(e.what()));
+        return false;
+    }
+}
+
 bool sync_dir(const fs::path& src, const fs::path& dst) {
     LOG_DEBUG("sync_dir: " + src.string() + " -> " + dst.string());
 
@@ -466,7 +994,7 @@ bool sync_dir(const fs::path& src, const fs::path& dst) {
         return false;
     }
 
-    bool result = native_cp_r(src, dst);
+    bool result = native_cp_r(src, dst, false);
     LOG_DEBUG("sync_dir result: " + std::to_string(result));
     return result;
 }
@@ -483,9 +1011,46 @@ bool check_tmpfs_xattr() {
     return supported;
 }
 
+void parallel_for(size_t count, size_t jobs, const std::function<void(size_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    jobs = std::min(jobs, count);
+    if (jobs <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    // Workers pull the next index from a shared counter; the pool is bounded by `jobs`.
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            fn(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(jobs - 1);
+    for (size_t t = 1; t < jobs; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& th : threads) {
+        th.join();
+    }
+}
+
 // Process utilities
 bool camouflage_process(const std::string& name) {
     if (prctl(PR_SET_NAME, name.c_str(), 0, 0, 0) == 0) {
+        // Helper threads (log writer) still carry the old name
+        std::error_code ec;
+        for (const auto& task : fs::directory_iterator("/proc/self/task", ec)) {
+            std::ofstream comm(task.path() / "comm");
+            comm << name;
+        }
         return true;
     }
     LOG_WARN("Failed to camouflage process: " + std::string(strerror(errno)));
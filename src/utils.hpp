@@ -1,40 +1,198 @@
 // utils.hpp - Utility functions
 #pragma once
 
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 
 namespace fs = std::filesystem;
 
 namespace hymo {
 
 // Logging
+enum class LogLevel : uint8_t { Verbose, Debug, Info, Warn, Error };
+
+// Levels below this are compiled out: 0 = Verbose ... 4 = Error (CMake HYMO_LOG_MIN_LEVEL)
+#ifndef HYMO_LOG_MIN_LEVEL
+#define HYMO_LOG_MIN_LEVEL 0
+#endif  // #ifndef HYMO_LOG_MIN_LEVEL
+
+constexpr bool log_compiled_in(LogLevel level) {
+#if HYMO_LOG_MIN_LEVEL > 0
+    return static_cast<int>(level) >= HYMO_LOG_MIN_LEVEL;
+#else
+    (void)level;
+    return true;
+#endif  // #if HYMO_LOG_MIN_LEVEL > 0
+}
+
+namespace log_detail {
+
+inline void append(std::string& out, std::string_view value) {
+    out.append(value);
+}
+inline void append(std::string& out, const std::string& value) {
+    out.append(value);
+}
+inline void append(std::string& out, const char* value) {
+    out.append(value ? value : "(null)");
+}
+inline void append(std::string& out, const fs::path& value) {
+    out.append(value.native());
+}
+inline void append(std::string& out, char value) {
+    out.push_back(value);
+}
+inline void append(std::string& out, bool value) {
+    out.append(value ? "true" : "false");
+}
+template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+void append(std::string& out, T value) {
+    char buf[24];
+    const auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, result.ptr);
+}
+
+inline void format_to(std::string& out, std::string_view fmt) {
+    out.append(fmt);
+}
+
+// Each "{}" in `fmt` takes the next argument; extra arguments are ignored
+template <typename T, typename... Rest>
+void format_to(std::string& out, std::string_view fmt, const T& arg, const Rest&... rest) {
+    const size_t pos = fmt.find("{}");
+    if (pos == std::string_view::npos) {
+        out.append(fmt);
+        return;
+    }
+    out.append(fmt.substr(0, pos));
+    append(out, arg);
+    format_to(out, fmt.substr(pos + 2), rest...);
+}
+
+}  // namespace log_detail
+
+// Records go into a bounded lock-free ring; a writer thread started by init() batches them
+// to the log file. A full ring drops the record and counts it. Queued records are written
+// on exit and, best effort, from the handler of a fatal signal.
 class Logger {
 public:
     static Logger& getInstance();
     void init(bool debug, bool verbose);
     void init(bool debug, bool verbose, const char* log_path);  // YukiSU: write to file
-    void log(const std::string& level, const std::string& message);
+    bool enabled(LogLevel level) const {
+        switch (level) {
+        case LogLevel::Verbose:
+            return verbose_;
+        case LogLevel::Debug:
+            return debug_;
+        default:
+            return true;
+        }
+    }
+    void log(LogLevel level, std::string_view message);
+    // Formats into a per-thread buffer, so an enabled record allocates nothing once warm
+    template <typename... Args>
+    void logf(LogLevel level, std::string_view fmt, const Args&... args) {
+        thread_local std::string buf;
+        buf.clear();
+        log_detail::format_to(buf, fmt, args...);
+        log(level, buf);
+    }
+    // Blocks until everything logged so far has been written
+    void flush();
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
 
 private:
-    Logger() = default;
+    static constexpr size_t kRingSize = 8192;  // Power of two
+
+    struct Slot {
+        std::atomic<size_t> seq{0};
+        std::time_t time = 0;
+        LogLevel level = LogLevel::Info;
+        std::string message;  // Keeps its capacity, reused by the next record
+    };
+
+    Logger();
+    ~Logger();
+    bool push(LogLevel level, std::string_view message);
+    template <typename F>
+    bool pop(F&& consume);
+    void start_writer();
+    void stop_writer();
+    void writer_loop();
+    void drain();  // Writer thread, or the caller of stop_writer after the join
+    void write_out(const std::string& data);
+    static void crash_handler(int sig);
+
     bool debug_ = false;
     bool verbose_ = false;
-    std::unique_ptr<std::ofstream> log_file_;
+    int log_fd_ = -1;   // -1: std::clog
+    std::mutex mutex_;  // Direct writes while no writer thread runs
+
+    std::unique_ptr<Slot[]> ring_;
+    std::atomic<size_t> head_{0};
+    std::atomic<size_t> tail_{0};
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t dropped_reported_ = 0;
+    std::string batch_;
+    std::time_t batch_time_ = -1;  // Second that batch_time_buf_ holds
+    char batch_time_buf_[32] = {};
+
+    std::thread writer_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> writer_idle_{false};
+    bool stop_ = false;
+    size_t written_ = 0;  // Ring position up to which records are on disk
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::condition_variable written_cv_;
 };
 
-#define LOG_INFO(msg) Logger::getInstance().log("INFO", msg)
-#define LOG_WARN(msg) Logger::getInstance().log("WARN", msg)
-#define LOG_ERROR(msg) Logger::getInstance().log("ERROR", msg)
-#define LOG_DEBUG(msg) Logger::getInstance().log("DEBUG", msg)
-#define LOG_VERBOSE(msg) Logger::getInstance().log("VERBOSE", msg)
+// Arguments are only evaluated when the level is enabled
+#define HYMO_LOG_ENABLED(level) \
+    (::hymo::log_compiled_in(level) && ::hymo::Logger::getInstance().enabled(level))
+#define HYMO_LOG(level, msg)                                   \
+    do {                                                       \
+        if (HYMO_LOG_ENABLED(level))                           \
+            ::hymo::Logger::getInstance().log((level), (msg)); \
+    } while (0)
+#define HYMO_LOGF(level, ...)                                        \
+    do {                                                             \
+        if (HYMO_LOG_ENABLED(level))                                 \
+            ::hymo::Logger::getInstance().logf((level), __VA_ARGS__); \
+    } while (0)
+
+#define LOG_INFO(msg) HYMO_LOG(::hymo::LogLevel::Info, msg)
+#define LOG_WARN(msg) HYMO_LOG(::hymo::LogLevel::Warn, msg)
+#define LOG_ERROR(msg) HYMO_LOG(::hymo::LogLevel::Error, msg)
+#define LOG_DEBUG(msg) HYMO_LOG(::hymo::LogLevel::Debug, msg)
+#define LOG_VERBOSE(msg) HYMO_LOG(::hymo::LogLevel::Verbose, msg)
+
+// LOG_DEBUGF("Mirror file: {} -> {}", src, dst)
+#define LOG_INFOF(...) HYMO_LOGF(::hymo::LogLevel::Info, __VA_ARGS__)
+#define LOG_WARNF(...) HYMO_LOGF(::hymo::LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERRORF(...) HYMO_LOGF(::hymo::LogLevel::Error, __VA_ARGS__)
+#define LOG_DEBUGF(...) HYMO_LOGF(::hymo::LogLevel::Debug, __VA_ARGS__)
+#define LOG_VERBOSEF(...) HYMO_LOGF(::hymo::LogLevel::Verbose, __VA_ARGS__)
 
 // File system utilities
 bool ensure_dir_exists(const fs::path& path);
 bool is_xattr_supported(const fs::path& path);
 bool lsetfilecon(const fs::path& path, const std::string& context);
+bool fsetfilecon(int fd, const std::string& context);
 std::string lgetfilecon(const fs::path& path);
 std::string get_context_for_path(const fs::path& path);
 bool copy_path_context(const fs::path& src, const fs::path& dst);
@@ -45,7 +203,13 @@ bool mount_image(const fs::path& image_path, const fs::path& target,
                  const std::string& options = "loop,rw,noatime");
 bool repair_image(const fs::path& image_path);
 bool sync_dir(const fs::path& src, const fs::path& dst);
-bool has_files_recursive(const fs::path& path);
+// Copy a single subtree; `dst` is created with the mode/context of `src` when missing.
+// With `hardlink`, regular files are linked instead of copied where the fs allows it.
+bool copy_tree(const fs::path& src, const fs::path& dst, bool hardlink = false);
+// Copy only the top-level non-directory entries of `src` into `dst`.
+bool copy_dir_files(const fs::path& src, const fs::path& dst, bool hardlink = false);
+// Copy one file or symlink (not a directory), replacing `dst`.
+bool copy_node(const fs::path& src, const fs::path& dst, bool hardlink = false);
 bool check_tmpfs_xattr();
 
 // EROFS support
@@ -56,6 +220,9 @@ bool send_unmountable(const fs::path& target);
 bool ksu_nuke_sysfs(const std::string& target);
 int grab_ksu_fd();
 
+// Run fn(0..count-1) on at most `jobs` worker threads (jobs <= 1 runs inline).
+void parallel_for(size_t count, size_t jobs, const std::function<void(size_t)>& fn);
+
 // Process utilities
 bool camouflage_process(const std::string& name);
 
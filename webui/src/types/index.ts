@@ -93,6 +93,11 @@ export type MountStatistics = {
   dirs_mounted: number
   symlinks_created: number
   overlayfs_mounts: number
+  subtree_binds?: number
+  mounts_saved?: number
+  planned_mounts?: number
+  actual_mounts?: number
+  file_syscalls?: number
   success_rate?: number
 }
 